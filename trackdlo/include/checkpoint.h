@@ -0,0 +1,67 @@
+#pragma once
+
+#include "trackdlo.h"
+
+#include <mutex>
+#include <condition_variable>
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+using Eigen::MatrixXd;
+
+// tracker state of one DLO, in result_frame_id
+struct dlo_state {
+    std::string name;
+    MatrixXd Y;
+    double sigma2;
+    std::vector<double> geodesic_coord;
+    std::vector<bool> vis;
+};
+
+// intrinsics and extrinsics of one camera
+struct camera_state {
+    std::string camera_info_topic;
+    std::string frame_id;
+    MatrixXd proj_matrix;
+    bool has_extrinsics;
+    Eigen::Isometry3d camera_to_result;
+};
+
+// everything the tracker node needs to resume tracking without waiting for camera_info or a new initialization.
+// stamp is the wall time (s) the state was taken at
+struct tracker_checkpoint {
+    double stamp;
+    std::string result_frame_id;
+    std::vector<camera_state> cameras;
+    std::vector<dlo_state> dlos;
+};
+
+// writes the checkpoint to a temporary file next to path and renames it over path, so a crash while writing
+// leaves the previous checkpoint intact. throws std::runtime_error if the file cannot be written
+void write_checkpoint (const std::string& path, const tracker_checkpoint& checkpoint);
+
+// throws std::invalid_argument if there is no checkpoint at path or it is truncated, corrupt or of another version
+tracker_checkpoint read_checkpoint (const std::string& path);
+
+// writes checkpoints on its own thread. submit only hands the checkpoint over; if the thread is still busy with
+// the previous one, the checkpoint waiting to be written is replaced by the newer one
+class checkpoint_writer
+{
+    public:
+        checkpoint_writer (const std::string& path);
+        ~checkpoint_writer ();
+        void submit (tracker_checkpoint checkpoint);
+
+    private:
+        std::string path_;
+        std::mutex mutex_;
+        std::condition_variable ready_;
+        tracker_checkpoint pending_;
+        bool has_pending_;
+        bool stop_;
+        std::thread thread_;
+        void run ();
+};
+
+#endif
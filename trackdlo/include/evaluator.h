@@ -1,6 +1,7 @@
 #pragma once
 
 #include "trackdlo.h"
+#include "segmentation.h"
 
 #ifndef EVALUATOR_H
 #define EVALUATOR_H
@@ -31,6 +32,18 @@ class evaluator
         void increment_image_counter ();
         int image_counter ();
 
+        // time to recover: an error above the threshold starts a loss episode that ends once the error drops below
+        // it again. times are in bag seconds
+        void set_recovery_threshold (double recovery_threshold);
+        void update_recovery (double time_from_start, double cur_error);
+        void report_recovery ();
+
+        // simulated occlusion in image pixels, once wait_before_occlusion has passed: for bag 0 the bounding box of
+        // the first pct_occlusion percent of num_of_nodes sorted ground-truth nodes projected with proj_matrix (plus
+        // a 30 pixel border), a fixed rectangle for the other bags. empty if nothing is occluded. throws
+        // std::invalid_argument for an unknown bag
+        cv::Rect occlusion_rect (const MatrixXd& Y_true, const MatrixXd& proj_matrix, int num_of_nodes, int image_cols, int image_rows);
+
     private:
         int length_;
         int trial_;
@@ -47,6 +60,11 @@ class evaluator
         double bag_rate_;
         int image_counter_;
         int num_of_nodes_;
+        color_lut marker_lut_;
+        double recovery_threshold_;
+        double loss_started_at_;
+        std::vector<double> recovery_times_;
+        std::string result_file (std::string suffix);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "trackdlo.h"
+
+#ifndef INITIALIZER_H
+#define INITIALIZER_H
+
+using Eigen::MatrixXd;
+using cv::Mat;
+
+// one-pixel-wide skeleton of a binary mask (CV_8U, non-zero for members) by Zhang-Suen thinning, 255 on the skeleton
+Mat thin_mask (const Mat& mask);
+
+// partial implementation of paper "Deformable One-Dimensional Object Detection for Routing and Manipulation"
+// paper link: https://ieeexplore.ieee.org/abstract/document/9697357
+// smooths and thins the mask, cuts the skeleton contours into chains of segments seg_length pixels long that turn
+// by at most max_curvature degrees, prunes chains overlapping longer ones and joins the rest end to end. returns
+// the pixels of the DLO in order. throws std::invalid_argument if the mask has no DLO in it
+std::vector<cv::Point> extract_connected_skeleton (const Mat& mask, int seg_length = 8, double max_curvature = 25);
+
+// minimum-cost assignment of rows to columns of a square cost matrix (Hungarian algorithm). returns the column
+// assigned to every row
+std::vector<int> solve_assignment (const MatrixXd& cost);
+
+// least-squares cubic B-spline through the ordered points (chord-length parameterized, one control point per
+// points_per_ctrl_pt points), resampled to num_of_nodes nodes equally spaced in arc length
+MatrixXd fit_spline_nodes (const MatrixXd& points, int num_of_nodes, int points_per_ctrl_pt = 5);
+
+// initial nodes of a DLO in the camera frame from its mask and the aligned depth image (CV_16UC1 in mm or CV_32FC1
+// in m). pixels closer than depth_filter (m) are ignored. if tip_mask is not empty and the chain ends on it, the
+// nodes are reversed so they start at the tip. throws std::invalid_argument if the DLO cannot be extracted
+MatrixXd initialize_nodes (const Mat& mask,
+                           const Mat& depth_image,
+                           const MatrixXd& proj_matrix,
+                           int num_of_nodes,
+                           double depth_filter = 0,
+                           const Mat& tip_mask = Mat());
+
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "trackdlo.h"
+
+#include <atomic>
+#include <array>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+
+#ifndef METRICS_H
+#define METRICS_H
+
+// summary of the values recorded in a log_histogram over one reporting period
+struct histogram_summary {
+    uint64_t count = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+// histogram of non-negative integer values with log-linear buckets (HDR style): exact below 32, then 16 buckets
+// per power of two, so a reported percentile is at most 1/16 above the true value. any number of threads can
+// record into it without locking; take() is meant for a single reader
+class log_histogram
+{
+    public:
+        log_histogram ();
+        void record (uint64_t value);
+        // summary of the values recorded since the last call, which are cleared. values are scaled by scale
+        histogram_summary take (double scale = 1.0);
+
+    private:
+        static const int num_of_buckets = 32 + 36*16;
+        std::array<std::atomic<uint64_t>, num_of_buckets> counts_;
+        std::atomic<uint64_t> sum_;
+        std::atomic<uint64_t> max_;
+        static int bucket_index (uint64_t value);
+        static uint64_t bucket_upper_bound (int index);
+};
+
+// stages of a frame whose durations are measured. the durations of the per-DLO stages (pre-proc EM to main EM and
+// publish, the results of one DLO) are recorded once per tracked DLO, image publish once per frame
+enum tracker_stage {
+    stage_decode,
+    stage_segmentation,
+    stage_back_projection,
+    stage_downsampling,
+    stage_visibility,
+    stage_pre_proc_em,
+    stage_priors,
+    stage_main_em,
+    stage_render,
+    stage_publish,
+    stage_image_publish,
+    num_of_stages
+};
+
+// counters and histograms of the tracker node, recorded from any thread and reported at a fixed period
+struct tracker_metrics {
+    std::array<log_histogram, num_of_stages> stage_latencies;     // microseconds
+    log_histogram frame_latency;                                    // microseconds, whole frame
+    log_histogram pre_proc_iterations;
+    log_histogram main_iterations;
+    log_histogram points;                                           // downsampled points per tracked DLO
+    log_histogram precision_drift;                                  // micrometers, only with precision validation
+
+    // end-to-end latencies (microseconds) from the primary camera's image stamp to the synced frame being
+    // queued, to tracking starting on it, to its tracking results and to the end of publishing them, and the
+    // time the synchronizer held the first message of a frame until the other one arrived
+    log_histogram receive_latency;
+    log_histogram start_latency;
+    log_histogram result_latency;
+    log_histogram publish_latency;
+    log_histogram sync_wait;
+
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> dropped_frames;                           // dropped before tracking, tracking fell behind
+    std::atomic<uint64_t> superseded_frames;                        // dropped for a newer frame (newest_frame_only)
+    std::atomic<uint64_t> unmatched_messages;                       // rgb or depth messages that were never synced
+    std::atomic<uint64_t> skipped_frames;                           // not tracked, static scene
+    std::atomic<uint64_t> unhealthy_steps;
+
+    tracker_metrics ();
+    // records the time since start (steady clock) in stage_latencies[stage]
+    void record_stage (tracker_stage stage, std::chrono::steady_clock::time_point start);
+    // records the time from a sensor stamp to now (ROS time, so it follows the bag clock in playback)
+    void record_latency (log_histogram& latency, const ros::Time& stamp);
+    // reports and clears everything recorded since the last call, period seconds ago
+    diagnostic_msgs::DiagnosticStatus take_diagnostics (double period);
+};
+
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "trackdlo.h"
+
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+using Eigen::MatrixXd;
+using Eigen::VectorXd;
+
+// short-horizon motion model of the nodes, fitted to the last few tracking results: a constant velocity per node
+// (least squares over the results) with the tracker's sigma2 as the floor of the position noise. the tracking
+// thread adds results and any other thread predicts; the fit is swapped in as a whole, so neither waits on the other
+class motion_predictor
+{
+    public:
+        motion_predictor (int history_size, double max_horizon);
+        // adds a result stamped at stamp. a result with another node count, or older than the latest, restarts the history
+        void add_estimate (const ros::Time& stamp, const MatrixXd& Y, double sigma2);
+        // forgets every result, e.g. when tracking is lost
+        void reset ();
+        // nodes at time t, interpolated between the results or extrapolated from the latest one with the fitted
+        // velocities, and the standard deviation (m) of every coordinate of every node, which grows with the
+        // extrapolation. false if there is no result yet, t is before the oldest result or more than max_horizon
+        // seconds after the latest
+        bool predict (const ros::Time& t, MatrixXd& Y, VectorXd& sigma) const;
+
+    private:
+        struct motion_model {
+            std::vector<ros::Time> stamps;          // oldest first
+            std::vector<MatrixXd> Ys;
+            MatrixXd velocity;                      // m/s, one row per node
+            VectorXd noise_var;                     // per-coordinate position variance of every node
+            VectorXd velocity_var;                  // per-coordinate velocity variance of every node
+        };
+
+        int history_size_;
+        double max_horizon_;
+        std::shared_ptr<const motion_model> model_;    // only accessed through std::atomic_load / std::atomic_store
+};
+
+// publishes the predictions of a motion_predictor at a fixed rate on its own thread, as a point cloud with fields
+// x, y, z and sigma stamped with the predicted time (now - delay)
+class prediction_publisher
+{
+    public:
+        prediction_publisher (const motion_predictor& predictor, const ros::Publisher& pub, const std::string& frame_id, double rate, double delay);
+        // stops and joins the thread
+        ~prediction_publisher ();
+
+    private:
+        const motion_predictor& predictor_;
+        ros::Publisher pub_;
+        std::string frame_id_;
+        double rate_;
+        double delay_;
+        std::mutex mutex_;
+        std::condition_variable stopped_;
+        bool stop_;
+        std::thread thread_;
+
+        void run ();
+};
+
+#endif
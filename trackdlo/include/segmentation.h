@@ -0,0 +1,49 @@
+#pragma once
+
+#include "trackdlo.h"
+
+#ifndef SEGMENTATION_H
+#define SEGMENTATION_H
+
+using cv::Mat;
+
+// color range with inclusive bounds as in cv::inRange. HSV ranges use OpenCV units (H in [0, 180], S and V in [0, 255])
+struct color_range {
+    std::string name;
+    bool hsv;           // false for a BGR range
+    cv::Scalar lower;
+    cv::Scalar upper;
+};
+
+// color ranges of one DLO, as listed in a color profile
+struct dlo_colors {
+    std::string name;
+    std::vector<color_range> ranges;
+};
+
+// reads a color profile (YAML or JSON, anything cv::FileStorage can open) with any number of DLOs, each with any
+// number of named ranges. throws std::invalid_argument if the file cannot be read or a range is malformed
+std::vector<dlo_colors> load_color_profile (const std::string& path);
+
+// lookup table mapping every BGR color straight to one bit per class, where a class is any number of color ranges.
+// the table is built by converting every BGR value with cv::cvtColor once, so classifying a frame gives the same
+// mask as cvtColor + inRange (+ bitwise_or over the ranges) without materializing the HSV image
+class color_lut
+{
+    public:
+        color_lut ();
+        color_lut (const std::vector<std::vector<color_range>>& classes);
+
+        int num_of_classes () const;
+        // mask (CV_8U, 255 for members) of the pixels of a CV_8UC3 BGR image that belong to class k
+        void classify (const Mat& bgr_image, Mat& mask, int k = 0) const;
+        // masks of several classes in a single pass over the image
+        void classify (const Mat& bgr_image, std::vector<Mat>& masks, const std::vector<int>& classes) const;
+
+    private:
+        int num_of_classes_;
+        // 256^3 bits per class, indexed by (B << 16) | (G << 8) | R
+        std::vector<uint64_t> bits_;
+};
+
+#endif
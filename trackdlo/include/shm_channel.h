@@ -0,0 +1,202 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef SHM_CHANNEL_H
+#define SHM_CHANNEL_H
+
+// tracking results in POSIX shared memory, for controllers on the same host. the tracker writes every result into
+// the next slot of a ring, each slot guarded by a seqlock, so it never waits for a reader and a reader never blocks
+// it. the layout and shm_result_reader only need this header (no ROS, no Eigen); link with -lrt on older glibc.
+//
+//     shm_result_reader reader("/trackdlo_results");
+//     shm_result result;
+//     if (reader.read_latest(result)) { ... result.nodes[3*i + 0..2], result.visible[i] ... }
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the shared-memory channel needs lock-free 64-bit atomics");
+
+static const uint64_t shm_channel_magic = 0x54444c4f53484d31ULL;    // "TDLOSHM1"
+static const uint32_t shm_channel_version = 1;
+// attempts of a read at a slot that is being written before giving up, far longer than a write takes. bounds
+// the read if the writer died in the middle of a write
+static const int shm_read_attempts = 100000;
+
+// at the start of the shared memory, followed by num_of_slots slots of slot_size bytes
+struct shm_channel_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t max_nodes;
+    uint32_t num_of_slots;
+    uint32_t slot_size;
+    std::atomic<uint64_t> latest;       // sequence number of the newest complete result, 0 before the first
+};
+
+// followed by max_nodes x, y, z doubles (row-major) and max_nodes visibility bytes
+struct shm_slot_header {
+    std::atomic<uint64_t> lock;         // odd while the slot is written
+    uint64_t sequence;                  // results are numbered from 1
+    int64_t stamp;                      // image stamp, nanoseconds (ROS time)
+    uint32_t num_of_nodes;
+    uint32_t padding;
+};
+
+// a result copied out of the ring
+struct shm_result {
+    uint64_t sequence = 0;
+    int64_t stamp = 0;
+    int num_of_nodes = 0;
+    std::vector<double> nodes;          // x, y, z of every node
+    std::vector<uint8_t> visible;       // 1 if the node is visible (not self-occluded)
+};
+
+inline uint32_t shm_slot_size (uint32_t max_nodes) {
+    uint32_t size = sizeof(shm_slot_header) + max_nodes * (3 * sizeof(double) + 1);
+    return (size + 63) / 64 * 64;       // slots on separate cache lines
+}
+
+class shm_result_reader
+{
+    public:
+        // maps the channel written under name (e.g. "/trackdlo_results"). throws std::runtime_error if there is
+        // none or it is not a result channel
+        shm_result_reader (const std::string& name) {
+            int fd = shm_open(name.c_str(), O_RDONLY, 0);
+            if (fd < 0) {
+                throw std::runtime_error("no shared-memory channel " + name);
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(shm_channel_header))) {
+                close(fd);
+                throw std::runtime_error(name + " is not a result channel");
+            }
+            size_ = st.st_size;
+            void* mem = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (mem == MAP_FAILED) {
+                throw std::runtime_error("cannot map " + name);
+            }
+            base_ = static_cast<const uint8_t*>(mem);
+            header_ = reinterpret_cast<const shm_channel_header*>(base_);
+            if (header_->magic != shm_channel_magic || header_->version != shm_channel_version || header_->num_of_slots == 0 ||
+                header_->slot_size != shm_slot_size(header_->max_nodes) ||
+                sizeof(shm_channel_header) + static_cast<uint64_t>(header_->num_of_slots) * header_->slot_size > size_) {
+                munmap(const_cast<uint8_t*>(base_), size_);
+                throw std::runtime_error(name + " is not a result channel");
+            }
+        }
+
+        ~shm_result_reader () {
+            munmap(const_cast<uint8_t*>(base_), size_);
+        }
+
+        shm_result_reader (const shm_result_reader&) = delete;
+        shm_result_reader& operator= (const shm_result_reader&) = delete;
+
+        int max_nodes () const {
+            return header_->max_nodes;
+        }
+
+        // sequence number of the newest result, 0 if nothing was written yet
+        uint64_t latest_sequence () const {
+            return header_->latest.load(std::memory_order_acquire);
+        }
+
+        // copies the newest result. false if nothing was written yet or the slot stays locked
+        bool read_latest (shm_result& result) const {
+            uint64_t sequence = latest_sequence();
+            while (sequence != 0) {
+                if (read(sequence, result)) {
+                    return true;
+                }
+                // only retry if the result was overwritten by newer ones
+                uint64_t cur_sequence = latest_sequence();
+                if (cur_sequence == sequence) {
+                    return false;
+                }
+                sequence = cur_sequence;
+            }
+            return false;
+        }
+
+        // copies the result with the given sequence number. false if it was not written yet, was already
+        // overwritten (the ring holds the last num_of_slots results) or its slot stays locked for
+        // shm_read_attempts attempts (the writer died while writing it)
+        bool read (uint64_t sequence, shm_result& result) const {
+            if (sequence == 0) {
+                return false;
+            }
+            const uint8_t* slot = base_ + sizeof(shm_channel_header) + ((sequence - 1) % header_->num_of_slots) * header_->slot_size;
+            const shm_slot_header* slot_header = reinterpret_cast<const shm_slot_header*>(slot);
+            const double* nodes = reinterpret_cast<const double*>(slot + sizeof(shm_slot_header));
+            const uint8_t* visible = slot + sizeof(shm_slot_header) + header_->max_nodes * 3 * sizeof(double);
+
+            for (int attempt = 0; attempt < shm_read_attempts; attempt ++) {
+                uint64_t lock = slot_header->lock.load(std::memory_order_acquire);
+                if (lock & 1) {
+                    continue;
+                }
+                uint64_t cur_sequence = slot_header->sequence;
+                int64_t stamp = slot_header->stamp;
+                uint32_t num_of_nodes = std::min(slot_header->num_of_nodes, header_->max_nodes);
+                result.nodes.resize(3 * num_of_nodes);
+                result.visible.resize(num_of_nodes);
+                memcpy(result.nodes.data(), nodes, 3 * num_of_nodes * sizeof(double));
+                memcpy(result.visible.data(), visible, num_of_nodes);
+
+                // the copy is only valid if the writer did not touch the slot meanwhile
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot_header->lock.load(std::memory_order_relaxed) != lock) {
+                    continue;
+                }
+                if (cur_sequence != sequence) {
+                    return false;
+                }
+                result.sequence = cur_sequence;
+                result.stamp = stamp;
+                result.num_of_nodes = num_of_nodes;
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        const uint8_t* base_;
+        size_t size_;
+        const shm_channel_header* header_;
+};
+
+// creates (or replaces) the channel and writes results into it. only one writer per channel
+class shm_result_writer
+{
+    public:
+        // throws std::runtime_error if the shared memory cannot be created
+        shm_result_writer (const std::string& name, int max_nodes, int num_of_slots);
+        // removes the channel; mapped readers keep their mapping
+        ~shm_result_writer ();
+
+        shm_result_writer (const shm_result_writer&) = delete;
+        shm_result_writer& operator= (const shm_result_writer&) = delete;
+
+        // writes the next result. nodes is the num_of_nodes x 3 matrix of node positions in column-major order (as
+        // Eigen stores it), visible one flag per node. nodes past max_nodes are dropped
+        void write (int64_t stamp, const double* nodes, const std::vector<bool>& visible, int num_of_nodes);
+
+    private:
+        std::string name_;
+        uint8_t* base_;
+        size_t size_;
+        shm_channel_header* header_;
+        uint64_t sequence_;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#ifndef TRACE_H
+#define TRACE_H
+
+// trace events: TRACE_SCOPE("name") records the time from the macro to the end of the enclosing scope, and
+// TRACE_SINCE("name", start) the time since start (a steady_clock time point), in a ring buffer of the calling
+// thread. dump_trace writes the recent events of every thread as a Chrome trace
+// (chrome://tracing or ui.perfetto.dev). names must be string literals or otherwise outlive the dump. building with -DTRACKDLO_TRACING=OFF
+// compiles the macros away; otherwise tracing can still be switched off at runtime with set_tracing_enabled
+
+#ifdef TRACKDLO_TRACING
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_SINCE(name, start) trace_since(name, start)
+
+#else
+
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_SINCE(name, start) do {} while (0)
+
+#endif
+
+extern std::atomic<bool> tracing_enabled;
+
+void set_tracing_enabled (bool enabled);
+
+// nanoseconds on the steady clock
+inline int64_t trace_now () {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// appends a complete event to the calling thread's ring buffer, overwriting its oldest event once it is full
+void record_trace_event (const char* name, int64_t start, int64_t end);
+
+inline void trace_since (const char* name, std::chrono::steady_clock::time_point start) {
+    if (tracing_enabled.load(std::memory_order_relaxed)) {
+        record_trace_event(name, std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count(), trace_now());
+    }
+}
+
+// names the calling thread in the dumped traces
+void set_trace_thread_name (const std::string& name);
+
+// writes the events of every thread that ended in the last window seconds to path as Chrome trace JSON. returns
+// the number of events written, throws std::runtime_error if the file cannot be written
+int dump_trace (const std::string& path, double window);
+
+class trace_scope
+{
+    public:
+        trace_scope (const char* name) : name_(name), start_(tracing_enabled.load(std::memory_order_relaxed) ? trace_now() : -1) {}
+        ~trace_scope () {
+            if (start_ >= 0) {
+                record_trace_event(name_, start_, trace_now());
+            }
+        }
+
+    private:
+        const char* name_;
+        int64_t start_;
+};
+
+#endif
@@ -50,6 +50,54 @@
 using Eigen::MatrixXd;
 using cv::Mat;
 
+// correspondence priors in struct-of-arrays layout: prior i pulls node indices[i] towards (x[i], y[i], z[i])
+struct node_priors {
+    std::vector<int> indices;
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> z;
+
+    int size () const { return indices.size(); }
+    void clear () { indices.clear(); x.clear(); y.clear(); z.clear(); }
+    void push_back (int index, double px, double py, double pz) {
+        indices.push_back(index);
+        x.push_back(px);
+        y.push_back(py);
+        z.push_back(pz);
+    }
+};
+
+// thresholds of the health check run after every tracking step. a step is unhealthy if it crosses any enabled
+// threshold (or produces non-finite nodes), and tracking counts as lost after loss_frames unhealthy steps in a row
+struct health_thresholds {
+    double max_sigma2 = 0;                  // 0 disables
+    double min_visible_fraction = 0;        // fraction of the nodes that are visible, 0 disables
+    double max_mean_point_dist = 0;         // mean distance (m) from every point to its closest node, 0 disables
+    bool require_convergence = false;       // EM non-convergence counts as unhealthy
+    int loss_frames = 3;
+};
+
+// health of the last tracking step
+struct tracking_health {
+    bool converged = true;
+    double sigma2 = 0;
+    double visible_fraction = 1;
+    double mean_point_dist = 0;             // -1 if max_mean_point_dist is disabled
+    bool healthy = true;
+    int unhealthy_frames = 0;               // unhealthy steps in a row, including this one
+    bool lost = false;
+};
+
+// durations (ms) of the stages of the last tracking step and its EM iterations
+struct step_stats {
+    double pre_proc_em = 0;
+    double priors = 0;
+    double main_em = 0;
+    int pre_proc_iterations = 0;
+    int main_iterations = 0;
+    double precision_drift = -1;            // max node distance (m) from the all-double result, -1 unless validated
+};
+
 class trackdlo
 {
     public:
@@ -77,6 +125,14 @@ class trackdlo
         void initialize_geodesic_coord (std::vector<double> geodesic_coord);
         void initialize_nodes (MatrixXd Y_init);
         void set_sigma2 (double sigma2);
+        void set_mixed_precision (bool mixed_precision);
+        void set_precision_validation (bool precision_validation);
+        void set_fused_registration (bool fused_registration);
+        void set_health_thresholds (const health_thresholds& thresholds);
+        tracking_health get_health ();
+        // records a step with nothing of the DLO observed: the nodes are kept and the step counts as unhealthy
+        void skip_step ();
+        step_stats get_step_stats ();
 
         bool cpd_lle (MatrixXd X_orig,
                       MatrixXd& Y,
@@ -88,7 +144,7 @@ class trackdlo
                       int max_iter = 30,
                       double tol = 0.0001,
                       bool include_lle = true,
-                      std::vector<MatrixXd> correspondence_priors = {},
+                      const node_priors& correspondence_priors = node_priors(),
                       double alpha = 0,
                       std::vector<int> visible_nodes = {},
                       double k_vis = 0,
@@ -117,15 +173,115 @@ class trackdlo
         double lle_weight_;
         
         std::vector<double> geodesic_coord_;
-        std::vector<MatrixXd> correspondence_priors_;
+        node_priors correspondence_priors_;
         double visibility_threshold_;
 
+        // mixed_precision_: run the E-step in float and the M-step solve in double
+        // precision_validation_: also run every frame through the all-double path and report the drift
+        bool mixed_precision_;
+        bool precision_validation_;
+
+        // fused_registration_: find the points close to the node set once per frame for both registrations
+        // and hand work shared by the two registrations over to the second one
+        bool fused_registration_;
+
+        health_thresholds health_thresholds_;
+        tracking_health health_;
+        void update_health (const MatrixXd& X_orig, int num_of_visible_nodes, bool converged);
+
+        step_stats stats_;
+        // EM iterations of the last registration
+        int last_iterations_;
+
+        // optional inputs/outputs of cpd_lle_impl. with all of them left null, cpd_lle_impl
+        // searches the closest nodes and computes every E-step itself
+        struct registration_seed {
+            const std::vector<int>* closest_nodes = nullptr;    // closest node of every point at the initial Y
+            const MatrixXd* diff_xy = nullptr;                  // squared distances between the initial Y and X
+            const MatrixXd* first_P = nullptr;                  // first-iteration P matrix, if known in advance
+            MatrixXd* first_P_out = nullptr;                    // receives the first-iteration P matrix
+        };
+
+        // per-frame state shared by the pre-processing and the main registration
+        struct shared_frame {
+            MatrixXd X;                                 // points close to any node
+            MatrixXd X_guide;                           // points close to any guide node
+            std::vector<int> closest_nodes;             // closest node of every point in X
+            std::vector<int> closest_guide_nodes;       // closest guide node of every point in X_guide
+            MatrixXd diff_xy;                           // squared node-point distances, only kept for the visibility term
+            MatrixXd first_P;                           // first-iteration P matrix of the pre-processing registration
+        };
+        shared_frame frame_;
+
+        MatrixXd prune_point_cloud (const MatrixXd& X_orig, const MatrixXd& Y);
+        void prepare_shared_frame (const MatrixXd& X_orig, const std::vector<int>& visible_nodes_extended);
+
+        // same as cpd_lle, but X must already be pruned
+        bool cpd_lle_pruned (const MatrixXd& X,
+                             MatrixXd& Y,
+                             double& sigma2,
+                             double beta,
+                             double lambda,
+                             double lle_weight,
+                             double mu,
+                             int max_iter,
+                             double tol,
+                             bool include_lle,
+                             const node_priors& correspondence_priors,
+                             double alpha,
+                             const std::vector<int>& visible_nodes,
+                             double k_vis,
+                             double visibility_threshold,
+                             const registration_seed& seed);
+
+        template <typename Scalar>
+        bool cpd_lle_dispatch (const MatrixXd& X,
+                               MatrixXd& Y,
+                               double& sigma2,
+                               double beta,
+                               double lambda,
+                               double lle_weight,
+                               double mu,
+                               int max_iter,
+                               double tol,
+                               bool include_lle,
+                               const node_priors& correspondence_priors,
+                               double alpha,
+                               const std::vector<int>& visible_nodes,
+                               double k_vis,
+                               double visibility_threshold,
+                               const registration_seed& seed);
+
+        // NodeCount is either a node count compiled in through TRACKDLO_FIXED_NODE_COUNTS or Eigen::Dynamic
+        template <typename Scalar, int NodeCount>
+        bool cpd_lle_impl (const MatrixXd& X,
+                           MatrixXd& Y,
+                           double& sigma2,
+                           double beta,
+                           double lambda,
+                           double lle_weight,
+                           double mu,
+                           int max_iter,
+                           double tol,
+                           bool include_lle,
+                           const node_priors& correspondence_priors,
+                           double alpha,
+                           const std::vector<int>& visible_nodes,
+                           double k_vis,
+                           double visibility_threshold,
+                           const registration_seed& seed);
+
         std::vector<int> get_nearest_indices (int k, int M, int idx);
         MatrixXd calc_LLE_weights (int k, MatrixXd X);
-        std::vector<MatrixXd> traverse_geodesic (std::vector<double> geodesic_coord, const MatrixXd guide_nodes, 
-                                                 const std::vector<int> visible_nodes, int alignment);
-        std::vector<MatrixXd> traverse_euclidean (std::vector<double> geodesic_coord, const MatrixXd guide_nodes, 
-                                                  const std::vector<int> visible_nodes, int alignment, int alignment_node_idx = -1);
+        // correspondence prior engine. guide_arc_ holds the cumulative arc length along the guide nodes;
+        // prior_sum_ and prior_count_ accumulate the priors of all marches so overlapping ones are averaged
+        std::vector<double> guide_arc_;
+        MatrixXd prior_sum_;
+        std::vector<int> prior_count_;
+
+        void reset_priors ();
+        void march_priors (const std::vector<int>& visible_nodes, int start, int direction);
+        void merge_priors ();
 
 };
 
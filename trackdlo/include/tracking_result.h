@@ -0,0 +1,41 @@
+#pragma once
+
+#include <ros/ros.h>
+#include <Eigen/Dense>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef TRACKING_RESULT_H
+#define TRACKING_RESULT_H
+
+// publisher of the compact tracking result (msg/TrackingResult.msg). the generated message is declared in
+// namespace trackdlo, which clashes with the tracker class, so only tracking_result.cpp includes it and this
+// header must not include trackdlo.h
+class tracking_result_publisher
+{
+    public:
+        tracking_result_publisher ();
+        ~tracking_result_publisher ();
+        void advertise (ros::NodeHandle& nh, const std::string& topic, int queue_size);
+        // fills the message, which is kept between frames, from Y (nodes in one copy of its column-major storage)
+        // and vis, and publishes it. times in ms
+        void publish (const ros::Time& stamp,
+                      const std::string& frame_id,
+                      const Eigen::MatrixXd& Y,
+                      const std::vector<bool>& vis,
+                      double sigma2,
+                      int pre_proc_iterations,
+                      int main_iterations,
+                      double pre_proc_em_time,
+                      double priors_time,
+                      double main_em_time);
+        // publishes the last message again with a new stamp, if there is one
+        void republish (const ros::Time& stamp);
+
+    private:
+        struct state;
+        std::unique_ptr<state> state_;
+};
+
+#endif
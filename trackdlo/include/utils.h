@@ -2,6 +2,8 @@
 
 #include "trackdlo.h"
 
+#include <cstring>
+
 #ifndef UTILS_H
 #define UTILS_H
 
@@ -18,14 +20,90 @@ template <typename T> void print_1d_vector (const std::vector<T>& vec) {
     std::cout << std::endl;
 }
 
-double pt2pt_dis_sq (MatrixXd pt1, MatrixXd pt2);
-double pt2pt_dis (MatrixXd pt1, MatrixXd pt2);
+// geometry helpers are templated on the Eigen expression type so they work for any scalar type
+// (the mixed-precision E-step calls them on float matrices) and for row blocks without copying
+template <typename Derived1, typename Derived2>
+typename Derived1::Scalar pt2pt_dis_sq (const Eigen::MatrixBase<Derived1>& pt1, const Eigen::MatrixBase<Derived2>& pt2) {
+    return (pt1 - pt2).rowwise().squaredNorm().sum();
+}
+
+template <typename Derived1, typename Derived2>
+typename Derived1::Scalar pt2pt_dis (const Eigen::MatrixBase<Derived1>& pt1, const Eigen::MatrixBase<Derived2>& pt2) {
+    return (pt1 - pt2).rowwise().norm().sum();
+}
 
 void reg (MatrixXd pts, MatrixXd& Y, double& sigma2, int M, double mu = 0, int max_iter = 50);
 void remove_row(MatrixXd& matrix, unsigned int rowToRemove);
 MatrixXd sort_pts (MatrixXd Y_0);
 
-std::vector<MatrixXd> line_sphere_intersection (MatrixXd point_A, MatrixXd point_B, MatrixXd sphere_center, double radius);
+// batched segment kernels: the segments of a polyline (consecutive rows of vertices) are processed together
+
+// segments solved together by polyline_sphere_exit, in fixed-size arrays
+static const int sphere_exit_batch_size = 8;
+
+// returns the first segment, walking from row lo (direction = 1) or from row hi (direction = -1), through which the
+// polyline between rows lo and hi leaves the sphere, as the lower row index of the segment (-1 if there is none).
+// t is set to the exit parameter along that segment in walking direction. the segments are solved
+// sphere_exit_batch_size at a time, stopping at the first batch with an exit
+int polyline_sphere_exit (const MatrixXd& vertices, int lo, int hi, int direction, const Eigen::Vector3d& sphere_center, double radius, double& t);
+
+// distance between pt and the closest point (closest_pt) on the polyline. throws std::invalid_argument if the
+// polyline has no vertices
+double point_polyline_distance (const MatrixXd& vertices, const Eigen::RowVector3d& pt, Eigen::RowVector3d& closest_pt);
+
+// reduced-resolution processing: every factor x factor block of pixels becomes one pixel
+
+// pools a CV_8U mask and its depth image (CV_16UC1 or CV_32FC1, 0 for no measurement). a block is in the pooled mask
+// if any of its mask pixels has a depth measurement, and its pooled depth is the closest measured depth among those
+// mask pixels (among all of its pixels if it is not in the mask), so thin objects and occluder edges survive pooling
+void pool_mask_and_depth (const Mat& mask, const Mat& depth, int factor, Mat& pooled_mask, Mat& pooled_depth);
+
+// projection matrix of the pooled image: pooled pixel (u, v) covers full-resolution pixels factor*u to factor*u + factor-1
+MatrixXd scale_projection (const MatrixXd& proj_matrix, int factor);
+
+// back-projects the masked pixels of a depth image (CV_16UC1 in mm or CV_32FC1 in m) into cloud, colored from the
+// BGR image. pixels without a depth measurement are skipped. throws std::invalid_argument for other depth types
+void mask_to_point_cloud (const Mat& mask, const Mat& depth, const Mat& bgr_image, const MatrixXd& proj_matrix, pcl::PointCloud<pcl::PointXYZRGB>& cloud);
+
+// fraction of the DLO pixels (in either mask) inside roi that changed between two frames, sampling every stride-th
+// row and column. a sampled pixel changed if it entered or left the mask, or if its depth moved by more than
+// depth_tolerance (in m) while in both masks. both frames must have the same size and depth type
+double mask_change_fraction (const Mat& mask, const Mat& depth, const Mat& prev_mask, const Mat& prev_depth, cv::Rect roi, int stride, double depth_tolerance);
+
+// zero-copy access by pixel to an organized PointCloud2 with FLOAT32 x, y and z fields. the message must outlive
+// the view. throws std::invalid_argument if the cloud is not organized, the fields are missing, it is not in host
+// byte order or its data does not cover its declared layout
+class organized_cloud_view
+{
+    public:
+        organized_cloud_view ();
+        organized_cloud_view (const sensor_msgs::PointCloud2& cloud_msg);
+
+        int rows () const { return rows_; }
+        int cols () const { return cols_; }
+        float x (int row, int col) const { return field(row, col, x_offset_); }
+        float y (int row, int col) const { return field(row, col, y_offset_); }
+        float z (int row, int col) const { return field(row, col, z_offset_); }
+
+        // z of every pixel as a CV_32FC1 depth image in meters (NaN for missing points)
+        Mat depth_image () const;
+
+    private:
+        float field (int row, int col, int offset) const {
+            float value;
+            std::memcpy(&value, data_ + row*row_step_ + col*point_step_ + offset, sizeof(float));
+            return value;
+        }
+
+        const uint8_t* data_;
+        int rows_;
+        int cols_;
+        size_t row_step_;
+        size_t point_step_;
+        int x_offset_;
+        int y_offset_;
+        int z_offset_;
+};
 
 visualization_msgs::MarkerArray MatrixXd2MarkerArray (MatrixXd Y,
                                                       std::string marker_frame, 
@@ -49,7 +127,38 @@ visualization_msgs::MarkerArray MatrixXd2MarkerArray (std::vector<MatrixXd> Y,
                                                       std::vector<float> occluded_node_color = {},
                                                       std::vector<float> occluded_line_color = {});
 
-MatrixXd cross_product (MatrixXd vec1, MatrixXd vec2);
-double dot_product (MatrixXd vec1, MatrixXd vec2);
+// fills markers with two markers, a SPHERE_LIST of the nodes of Y and a LINE_LIST of the edges between consecutive
+// nodes. markers is meant to be kept between frames so its buffers are reused. nodes with vis false (if vis is
+// given) and the edges touching them get the occluded colors
+void MatrixXd2MarkerList (visualization_msgs::MarkerArray& markers,
+                          const MatrixXd& Y,
+                          const std::string& marker_frame,
+                          const std::string& marker_ns,
+                          const std::vector<float>& node_color,
+                          const std::vector<float>& line_color,
+                          double node_scale = 0.01,
+                          double line_scale = 0.005,
+                          const std::vector<bool>& vis = {},
+                          const std::vector<float>& occluded_node_color = {},
+                          const std::vector<float>& occluded_line_color = {});
+
+// writes the rows of Y into pc_msg as a dense cloud of float x, y, z points, reusing its buffer
+void MatrixXd2PointCloud2 (sensor_msgs::PointCloud2& pc_msg, const MatrixXd& Y);
+
+template <typename Derived1, typename Derived2>
+Eigen::Matrix<typename Derived1::Scalar, 1, 3> cross_product (const Eigen::MatrixBase<Derived1>& vec1, const Eigen::MatrixBase<Derived2>& vec2) {
+    Eigen::Matrix<typename Derived1::Scalar, 1, 3> ret;
+
+    ret(0, 0) = vec1(0, 1)*vec2(0, 2) - vec1(0, 2)*vec2(0, 1);
+    ret(0, 1) = -(vec1(0, 0)*vec2(0, 2) - vec1(0, 2)*vec2(0, 0));
+    ret(0, 2) = vec1(0, 0)*vec2(0, 1) - vec1(0, 1)*vec2(0, 0);
+
+    return ret;
+}
+
+template <typename Derived1, typename Derived2>
+typename Derived1::Scalar dot_product (const Eigen::MatrixBase<Derived1>& vec1, const Eigen::MatrixBase<Derived2>& vec2) {
+    return vec1(0, 0)*vec2(0, 0) + vec1(0, 1)*vec2(0, 1) + vec1(0, 2)*vec2(0, 2);
+}
 
 #endif
\ No newline at end of file
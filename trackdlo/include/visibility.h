@@ -0,0 +1,31 @@
+#pragma once
+
+#include "trackdlo.h"
+
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+using Eigen::MatrixXd;
+using cv::Mat;
+
+// per-node visibility of the tracked chain, stored as bitsets indexed by node
+struct node_visibility {
+    std::vector<bool> visible;          // in view, not self-occluded, not behind an observed surface and close to the point cloud
+    std::vector<bool> self_occluded;    // behind another part of the chain
+};
+
+// rasterizes the projected chain (edges dlo_pixel_width pixels wide) into a depth buffer limited to the chain's
+// bounding box and compares every node's depth against it and against the observed depth image (CV_16UC1 in mm
+// or CV_32FC1 in m). node_pt_dists holds the distance between every node and its closest point in the point cloud
+node_visibility compute_node_visibility (const MatrixXd& Y,
+                                         const MatrixXd& proj_matrix,
+                                         const Mat& depth_image,
+                                         const std::vector<double>& node_pt_dists,
+                                         double visibility_threshold,
+                                         int dlo_pixel_width);
+
+// visible nodes with the gaps between two visible nodes at most d_vis apart along the DLO (geodesic_coord) filled,
+// since a minor mid-section occlusion is usually fine
+std::vector<int> extend_visible_nodes (const std::vector<int>& visible_nodes, const std::vector<double>& geodesic_coord, double d_vis);
+
+#endif
@@ -0,0 +1,254 @@
+#include "../include/checkpoint.h"
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+
+using Eigen::MatrixXd;
+
+// file layout: magic, version, payload size and FNV-1a hash of the payload, then the payload. numbers are stored
+// in the machine's byte order, the checkpoint is only read back on the machine that wrote it
+static const char checkpoint_magic[8] = {'T', 'D', 'L', 'O', 'C', 'K', 'P', 'T'};
+static const uint32_t checkpoint_version = 1;
+
+static uint64_t fnv1a (const std::string& data) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// appends values to the payload
+class payload_writer
+{
+    public:
+        std::string data;
+
+        template <typename T>
+        void put (const T& value) {
+            data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        void put_string (const std::string& value) {
+            put<uint32_t>(value.size());
+            data.append(value);
+        }
+
+        void put_matrix (const MatrixXd& value) {
+            put<uint32_t>(value.rows());
+            put<uint32_t>(value.cols());
+            data.append(reinterpret_cast<const char*>(value.data()), value.size() * sizeof(double));
+        }
+};
+
+// reads values back from the payload. throws std::invalid_argument when reading past its end
+class payload_reader
+{
+    public:
+        payload_reader (const std::string& data) : data_(data), pos_(0) {}
+
+        template <typename T>
+        T get () {
+            T value;
+            take(&value, sizeof(T));
+            return value;
+        }
+
+        std::string get_string () {
+            std::string value(get<uint32_t>(), '\0');
+            take(&value[0], value.size());
+            return value;
+        }
+
+        MatrixXd get_matrix () {
+            uint32_t rows = get<uint32_t>();
+            uint32_t cols = get<uint32_t>();
+            if (static_cast<uint64_t>(rows) * cols * sizeof(double) > data_.size() - pos_) {
+                throw std::invalid_argument("checkpoint is truncated");
+            }
+            MatrixXd value(rows, cols);
+            take(value.data(), value.size() * sizeof(double));
+            return value;
+        }
+
+    private:
+        const std::string& data_;
+        size_t pos_;
+
+        void take (void* dst, size_t size) {
+            if (size > data_.size() - pos_) {
+                throw std::invalid_argument("checkpoint is truncated");
+            }
+            memcpy(dst, data_.data() + pos_, size);
+            pos_ += size;
+        }
+};
+
+void write_checkpoint (const std::string& path, const tracker_checkpoint& checkpoint) {
+    payload_writer payload;
+    payload.put<double>(checkpoint.stamp);
+    payload.put_string(checkpoint.result_frame_id);
+
+    payload.put<uint32_t>(checkpoint.cameras.size());
+    for (const camera_state& camera : checkpoint.cameras) {
+        payload.put_string(camera.camera_info_topic);
+        payload.put_string(camera.frame_id);
+        payload.put_matrix(camera.proj_matrix);
+        payload.put<uint8_t>(camera.has_extrinsics);
+        payload.put_matrix(camera.camera_to_result.matrix());
+    }
+
+    payload.put<uint32_t>(checkpoint.dlos.size());
+    for (const dlo_state& dlo : checkpoint.dlos) {
+        payload.put_string(dlo.name);
+        payload.put_matrix(dlo.Y);
+        payload.put<double>(dlo.sigma2);
+        payload.put<uint32_t>(dlo.geodesic_coord.size());
+        for (double coord : dlo.geodesic_coord) {
+            payload.put<double>(coord);
+        }
+        payload.put<uint32_t>(dlo.vis.size());
+        for (bool visible : dlo.vis) {
+            payload.put<uint8_t>(visible);
+        }
+    }
+
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        uint64_t size = payload.data.size();
+        uint64_t hash = fnv1a(payload.data);
+        file.write(checkpoint_magic, sizeof(checkpoint_magic));
+        file.write(reinterpret_cast<const char*>(&checkpoint_version), sizeof(checkpoint_version));
+        file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        file.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+        file.write(payload.data.data(), payload.data.size());
+        file.close();
+        if (!file) {
+            throw std::runtime_error("Cannot write checkpoint " + tmp_path);
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot replace checkpoint " + path);
+    }
+}
+
+tracker_checkpoint read_checkpoint (const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::invalid_argument("no checkpoint at " + path);
+    }
+
+    char magic[sizeof(checkpoint_magic)];
+    uint32_t version = 0;
+    uint64_t size = 0;
+    uint64_t hash = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&size), sizeof(size));
+    file.read(reinterpret_cast<char*>(&hash), sizeof(hash));
+    if (!file || memcmp(magic, checkpoint_magic, sizeof(magic)) != 0) {
+        throw std::invalid_argument(path + " is not a tracker checkpoint");
+    }
+    if (version != checkpoint_version) {
+        throw std::invalid_argument("checkpoint version " + std::to_string(version) + " is not supported");
+    }
+
+    std::string data(size, '\0');
+    file.read(&data[0], size);
+    if (file.gcount() != static_cast<std::streamsize>(size) || fnv1a(data) != hash) {
+        throw std::invalid_argument("checkpoint is truncated or corrupt");
+    }
+
+    payload_reader payload(data);
+    tracker_checkpoint checkpoint;
+    checkpoint.stamp = payload.get<double>();
+    checkpoint.result_frame_id = payload.get_string();
+
+    uint32_t num_of_cameras = payload.get<uint32_t>();
+    for (uint32_t c = 0; c < num_of_cameras; c ++) {
+        camera_state camera;
+        camera.camera_info_topic = payload.get_string();
+        camera.frame_id = payload.get_string();
+        camera.proj_matrix = payload.get_matrix();
+        camera.has_extrinsics = payload.get<uint8_t>();
+        MatrixXd camera_to_result = payload.get_matrix();
+        if (camera.proj_matrix.rows() != 3 || camera.proj_matrix.cols() != 4 || camera_to_result.rows() != 4 || camera_to_result.cols() != 4) {
+            throw std::invalid_argument("checkpoint has a malformed camera");
+        }
+        camera.camera_to_result.matrix() = camera_to_result;
+        checkpoint.cameras.push_back(camera);
+    }
+
+    uint32_t num_of_dlos = payload.get<uint32_t>();
+    for (uint32_t k = 0; k < num_of_dlos; k ++) {
+        dlo_state dlo;
+        dlo.name = payload.get_string();
+        dlo.Y = payload.get_matrix();
+        dlo.sigma2 = payload.get<double>();
+        dlo.geodesic_coord.resize(payload.get<uint32_t>());
+        for (double& coord : dlo.geodesic_coord) {
+            coord = payload.get<double>();
+        }
+        dlo.vis.resize(payload.get<uint32_t>());
+        for (int i = 0; i < dlo.vis.size(); i ++) {
+            dlo.vis[i] = payload.get<uint8_t>();
+        }
+        if (dlo.Y.cols() != 3 || dlo.geodesic_coord.size() != dlo.Y.rows() || dlo.vis.size() != dlo.Y.rows()) {
+            throw std::invalid_argument("checkpoint has a malformed DLO " + dlo.name);
+        }
+        checkpoint.dlos.push_back(dlo);
+    }
+
+    return checkpoint;
+}
+
+checkpoint_writer::checkpoint_writer (const std::string& path) {
+    path_ = path;
+    has_pending_ = false;
+    stop_ = false;
+    thread_ = std::thread(&checkpoint_writer::run, this);
+}
+
+checkpoint_writer::~checkpoint_writer () {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    ready_.notify_one();
+    thread_.join();
+}
+
+void checkpoint_writer::submit (tracker_checkpoint checkpoint) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = std::move(checkpoint);
+        has_pending_ = true;
+    }
+    ready_.notify_one();
+}
+
+void checkpoint_writer::run () {
+    while (true) {
+        tracker_checkpoint checkpoint;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [this] { return has_pending_ || stop_; });
+            if (!has_pending_) {
+                return;
+            }
+            checkpoint = std::move(pending_);
+            has_pending_ = false;
+        }
+
+        try {
+            write_checkpoint(path_, checkpoint);
+        }
+        catch (const std::runtime_error& e) {
+            ROS_WARN_STREAM_THROTTLE(10, e.what());
+        }
+    }
+}
@@ -1,6 +1,7 @@
 #include "../include/utils.h"
 #include "../include/trackdlo.h"
 #include "../include/evaluator.h"
+#include "../include/segmentation.h"
 
 #include <iostream>
 #include <fstream>
@@ -27,6 +28,14 @@ evaluator::evaluator (int length, int trial, int pct_occlusion, std::string alg,
     bag_rate_ = bag_rate;
     num_of_nodes_ = num_of_nodes;
     image_counter_ = 0;
+    recovery_threshold_ = 0.03;
+    loss_started_at_ = -1;
+
+    // red (hue wraps around) and yellow marker colors
+    std::vector<color_range> marker_colors = {{"red_1", true, cv::Scalar(130, 60, 50), cv::Scalar(255, 255, 255)},
+                                              {"red_2", true, cv::Scalar(0, 60, 50), cv::Scalar(10, 255, 255)},
+                                              {"yellow", true, cv::Scalar(15, 100, 80), cv::Scalar(40, 255, 255)}};
+    marker_lut_ = color_lut({marker_colors});
 }
 
 int evaluator::image_counter () {
@@ -151,40 +160,10 @@ MatrixXd evaluator::sort_pts (MatrixXd Y_0, MatrixXd head) {
 }
 
 MatrixXd evaluator::get_ground_truth_nodes (Mat rgb_img, pcl::PointCloud<pcl::PointXYZRGB> cloud_xyz) {
-    Mat mask_blue, mask_red_1, mask_red_2, mask_red, mask_yellow, mask_markers, mask, mask_rgb;
-    Mat cur_image_hsv, mask_without_occlusion_block;
+    Mat mask_markers;
 
-    // convert color
-    cv::cvtColor(rgb_img, cur_image_hsv, cv::COLOR_BGR2HSV);
-
-    std::vector<int> lower_blue = {90, 80, 80};
-    std::vector<int> upper_blue = {130, 255, 255};
-
-    std::vector<int> lower_red_1 = {130, 60, 50};
-    std::vector<int> upper_red_1 = {255, 255, 255};
-
-    std::vector<int> lower_red_2 = {0, 60, 50};
-    std::vector<int> upper_red_2 = {10, 255, 255};
-
-    std::vector<int> lower_yellow = {15, 100, 80};
-    std::vector<int> upper_yellow = {40, 255, 255};
-
-    // filter blue
-    cv::inRange(cur_image_hsv, cv::Scalar(lower_blue[0], lower_blue[1], lower_blue[2]), cv::Scalar(upper_blue[0], upper_blue[1], upper_blue[2]), mask_blue);
-
-    // filter red
-    cv::inRange(cur_image_hsv, cv::Scalar(lower_red_1[0], lower_red_1[1], lower_red_1[2]), cv::Scalar(upper_red_1[0], upper_red_1[1], upper_red_1[2]), mask_red_1);
-    cv::inRange(cur_image_hsv, cv::Scalar(lower_red_2[0], lower_red_2[1], lower_red_2[2]), cv::Scalar(upper_red_2[0], upper_red_2[1], upper_red_2[2]), mask_red_2);
-
-    // filter yellow
-    cv::inRange(cur_image_hsv, cv::Scalar(lower_yellow[0], lower_yellow[1], lower_yellow[2]), cv::Scalar(upper_yellow[0], upper_yellow[1], upper_yellow[2]), mask_yellow);
-
-    // combine red mask
-    cv::bitwise_or(mask_red_1, mask_red_2, mask_red);
-    // combine overall mask
-    cv::bitwise_or(mask_red, mask_blue, mask_without_occlusion_block);
-    cv::bitwise_or(mask_yellow, mask_without_occlusion_block, mask_without_occlusion_block);
-    cv::bitwise_or(mask_red, mask_yellow, mask_markers);
+    // red and yellow markers
+    marker_lut_.classify(rgb_img, mask_markers);
 
     // simple blob detector
     std::vector<cv::KeyPoint> keypoints_markers;
@@ -260,17 +239,8 @@ double evaluator::get_piecewise_error (MatrixXd Y_track, MatrixXd Y_true) {
     std::vector<MatrixXd> closest_pts_on_Y_true = {};
 
     for (int idx = 0; idx < Y_track.rows(); idx ++) {
-        double dist = -1;
-        MatrixXd closest_pt = MatrixXd::Zero(1, 3);
-
-        for (int i = 0; i < Y_true.rows()-1; i ++) {
-            MatrixXd closest_pt_i = MatrixXd::Zero(1, 3);
-            double dist_i = calc_min_distance(Y_true.row(i), Y_true.row(i+1), Y_track.row(idx), closest_pt_i);
-            if (dist == -1 || dist_i < dist) {
-                dist = dist_i;
-                closest_pt = closest_pt_i.replicate(1, 1);
-            }
-        }
+        Eigen::RowVector3d closest_pt;
+        double dist = point_polyline_distance(Y_true, Y_track.row(idx), closest_pt);
 
         total_distances_to_curve += dist;
         closest_pts_on_Y_true.push_back(closest_pt);
@@ -290,44 +260,94 @@ double evaluator::compute_and_save_error (MatrixXd Y_track, MatrixXd Y_true) {
     double cur_frame_error = (E1 + E2) / 2;
     errors_.push_back(cur_frame_error);
 
-    std::string dir;
+    std::string dir = result_file("error");
+
+    double time_diff;
+    time_diff = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time_).count();
+    time_diff = time_diff / 1000.0 * bag_rate_;
+
+    if (cleared_file_ = false) {
+        std::ofstream error_list (dir);
+        error_list << std::to_string(time_diff - start_record_at_) + " " + std::to_string(cur_frame_error) + "\n";
+        error_list.close();
+        cleared_file_ = true;
+    }
+    else {
+        std::ofstream error_list (dir, std::fstream::app);
+        error_list << std::to_string(time_diff - start_record_at_) + " " + std::to_string(cur_frame_error) + "\n";
+        error_list.close();
+    }
+
+    return cur_frame_error;
+}
+
+// file for this run's results, e.g. trackdlo_0_25_stationary_error.txt
+std::string evaluator::result_file (std::string suffix) {
+    std::string bag_name;
     // 0 -> statinary.bag; 1 -> with_gripper_perpendicular.bag; 2 -> with_gripper_parallel.bag
     if (bag_file_ == 0) {
-        dir = save_location_ + alg_ + "_" + std::to_string(trial_) + "_" + std::to_string(pct_occlusion_) + "_stationary_error.txt";
+        bag_name = "stationary";
     }
     else if (bag_file_ == 1) {
-        dir = save_location_ + alg_ + "_" + std::to_string(trial_) + "_" + std::to_string(pct_occlusion_) + "_perpendicular_motion_error.txt";
+        bag_name = "perpendicular_motion";
     }
     else if (bag_file_ == 2) {
-        dir = save_location_ + alg_ + "_" + std::to_string(trial_) + "_" + std::to_string(pct_occlusion_) + "_parallel_motion_error.txt";
+        bag_name = "parallel_motion";
     }
     else if (bag_file_ == 4) {
-        dir = save_location_ + alg_ + "_" + std::to_string(trial_) + "_" + std::to_string(pct_occlusion_) + "_short_rope_folding_error.txt";
+        bag_name = "short_rope_folding";
     }
     else if (bag_file_ == 5) {
-        dir = save_location_ + alg_ + "_" + std::to_string(trial_) + "_" + std::to_string(pct_occlusion_) + "_short_rope_stationary_error.txt";
+        bag_name = "short_rope_stationary";
     }
     else {
         throw std::invalid_argument("Invalid bag file ID!");
     }
 
-    double time_diff;
-    time_diff = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time_).count();
-    time_diff = time_diff / 1000.0 * bag_rate_;
+    return save_location_ + alg_ + "_" + std::to_string(trial_) + "_" + std::to_string(pct_occlusion_) + "_" + bag_name + "_" + suffix + ".txt";
+}
 
-    if (cleared_file_ = false) {
-        std::ofstream error_list (dir);
-        error_list << std::to_string(time_diff - start_record_at_) + " " + std::to_string(cur_frame_error) + "\n";
-        error_list.close();
-        cleared_file_ = true;
+void evaluator::set_recovery_threshold (double recovery_threshold) {
+    recovery_threshold_ = recovery_threshold;
+}
+
+void evaluator::update_recovery (double time_from_start, double cur_error) {
+    if (loss_started_at_ == -1) {
+        if (cur_error > recovery_threshold_) {
+            loss_started_at_ = time_from_start;
+            std::cout << "tracking lost at " << time_from_start << " s (error = " << cur_error << ")" << std::endl;
+        }
+        return;
     }
-    else {
-        std::ofstream error_list (dir, std::fstream::app);
-        error_list << std::to_string(time_diff - start_record_at_) + " " + std::to_string(cur_frame_error) + "\n";
-        error_list.close();
+
+    if (cur_error <= recovery_threshold_) {
+        double time_to_recover = time_from_start - loss_started_at_;
+        recovery_times_.push_back(time_to_recover);
+        std::cout << "recovered in " << time_to_recover << " s" << std::endl;
+
+        std::ofstream recovery_list (result_file("recovery"), std::fstream::app);
+        recovery_list << std::to_string(loss_started_at_ - start_record_at_) + " " + std::to_string(time_to_recover) + "\n";
+        recovery_list.close();
+
+        loss_started_at_ = -1;
     }
+}
 
-    return cur_frame_error;
+void evaluator::report_recovery () {
+    double total = 0;
+    double longest = 0;
+    for (double time_to_recover : recovery_times_) {
+        total += time_to_recover;
+        longest = std::max(longest, time_to_recover);
+    }
+
+    std::cout << "loss episodes: " << recovery_times_.size() + (loss_started_at_ == -1 ? 0 : 1) << std::endl;
+    if (!recovery_times_.empty()) {
+        std::cout << "mean time to recover: " << total / recovery_times_.size() << " s, longest: " << longest << " s" << std::endl;
+    }
+    if (loss_started_at_ != -1) {
+        std::cout << "not recovered by the end of the run" << std::endl;
+    }
 }
 
 double evaluator::compute_error (MatrixXd Y_track, MatrixXd Y_true) {
@@ -338,4 +358,48 @@ double evaluator::compute_error (MatrixXd Y_track, MatrixXd Y_true) {
     double cur_frame_error = (E1 + E2) / 2;
     
     return cur_frame_error;
-}
\ No newline at end of file
+}
+
+cv::Rect evaluator::occlusion_rect (const MatrixXd& Y_true, const MatrixXd& proj_matrix, int num_of_nodes, int image_cols, int image_rows) {
+    if (bag_file_ == 1) {
+        return cv::Rect(cv::Point(840, 408), cv::Point(1191, 678));
+    }
+    else if (bag_file_ == 2) {
+        return cv::Rect(cv::Point(780, 120), cv::Point(1050, 290));
+    }
+    else if (bag_file_ == 4) {
+        return cv::Rect(cv::Point(543, 276), cv::Point(738, 383));
+    }
+    else if (bag_file_ == 5) {
+        return cv::Rect(cv::Point(300, 317), cv::Point(698, 440));
+    }
+    else if (bag_file_ != 0) {
+        throw std::invalid_argument("Invalid bag file ID!");
+    }
+
+    // simulate occlusion: occlude the first n nodes
+    // strategy: first calculate the 3D boundary box based on point cloud, then project the two corners back to the image
+    int num_of_occluded_nodes = std::min(static_cast<int>(num_of_nodes * pct_occlusion_ / 100.0), static_cast<int>(Y_true.rows()));
+    if (num_of_occluded_nodes == 0) {
+        return cv::Rect();
+    }
+
+    MatrixXd corners = MatrixXd::Zero(2, 4);
+    corners.block(0, 0, 1, 3) = Y_true.topRows(num_of_occluded_nodes).colwise().minCoeff();
+    corners.block(1, 0, 1, 3) = Y_true.topRows(num_of_occluded_nodes).colwise().maxCoeff();
+    corners.col(3) = MatrixXd::Ones(2, 1);
+    MatrixXd image_coords = (proj_matrix * corners.transpose()).transpose();
+
+    int pix_coord_1_x = static_cast<int>(image_coords(0, 0)/image_coords(0, 2));
+    int pix_coord_1_y = static_cast<int>(image_coords(0, 1)/image_coords(0, 2));
+    int pix_coord_2_x = static_cast<int>(image_coords(1, 0)/image_coords(1, 2));
+    int pix_coord_2_y = static_cast<int>(image_coords(1, 1)/image_coords(1, 2));
+
+    // the projected corners can be any two opposite corners of the box
+    int extra_border = 30;
+    int top_left_x = std::max(std::min(pix_coord_1_x, pix_coord_2_x) - extra_border, 0);
+    int top_left_y = std::max(std::min(pix_coord_1_y, pix_coord_2_y) - extra_border, 0);
+    int bottom_right_x = std::min(std::max(pix_coord_1_x, pix_coord_2_x) + extra_border, image_cols - 1);
+    int bottom_right_y = std::min(std::max(pix_coord_1_y, pix_coord_2_y) + extra_border, image_rows - 1);
+    return cv::Rect(cv::Point(top_left_x, top_left_y), cv::Point(bottom_right_x, bottom_right_y));
+}
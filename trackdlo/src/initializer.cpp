@@ -0,0 +1,540 @@
+#include "../include/utils.h"
+#include "../include/initializer.h"
+
+#include <stdexcept>
+
+using Eigen::MatrixXd;
+using Eigen::VectorXd;
+using cv::Mat;
+
+Mat thin_mask (const Mat& mask) {
+    // 0/1 image with a one pixel border, so the neighbors of every pixel exist
+    Mat img = Mat::zeros(mask.rows + 2, mask.cols + 2, CV_8U);
+    for (int i = 0; i < mask.rows; i ++) {
+        for (int j = 0; j < mask.cols; j ++) {
+            img.at<uchar>(i+1, j+1) = mask.at<uchar>(i, j) != 0;
+        }
+    }
+
+    std::vector<cv::Point> to_remove;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int pass = 0; pass < 2; pass ++) {
+            to_remove.clear();
+            for (int i = 1; i < img.rows-1; i ++) {
+                for (int j = 1; j < img.cols-1; j ++) {
+                    if (img.at<uchar>(i, j) == 0) {
+                        continue;
+                    }
+
+                    // neighbors p2 to p9, clockwise from the top
+                    uchar p[8] = {img.at<uchar>(i-1, j), img.at<uchar>(i-1, j+1), img.at<uchar>(i, j+1), img.at<uchar>(i+1, j+1),
+                                  img.at<uchar>(i+1, j), img.at<uchar>(i+1, j-1), img.at<uchar>(i, j-1), img.at<uchar>(i-1, j-1)};
+                    int neighbors = 0;
+                    int transitions = 0;
+                    for (int k = 0; k < 8; k ++) {
+                        neighbors += p[k];
+                        transitions += (p[k] == 0 && p[(k+1)%8] == 1);
+                    }
+                    if (neighbors < 2 || neighbors > 6 || transitions != 1) {
+                        continue;
+                    }
+
+                    // first pass removes south-east boundary and north-west corner pixels, second pass the opposite
+                    bool remove = (pass == 0) ? (p[0]*p[2]*p[4] == 0 && p[2]*p[4]*p[6] == 0)
+                                              : (p[0]*p[2]*p[6] == 0 && p[0]*p[4]*p[6] == 0);
+                    if (remove) {
+                        to_remove.push_back(cv::Point(j, i));
+                    }
+                }
+            }
+
+            for (const cv::Point& pt : to_remove) {
+                img.at<uchar>(pt.y, pt.x) = 0;
+            }
+            changed = changed || !to_remove.empty();
+        }
+    }
+
+    Mat skeleton = img(cv::Rect(1, 1, mask.cols, mask.rows)) * 255;
+    return skeleton;
+}
+
+// from geeksforgeeks: https://www.geeksforgeeks.org/check-if-two-given-line-segments-intersect/
+// 0 if p, q and r are collinear, 1 if they turn clockwise and 2 if counterclockwise
+static int orientation (const cv::Point2d& p, const cv::Point2d& q, const cv::Point2d& r) {
+    double val = (q.y - p.y) * (r.x - q.x) - (q.x - p.x) * (r.y - q.y);
+    if (val > 0) {
+        return 1;
+    }
+    else if (val < 0) {
+        return 2;
+    }
+    return 0;
+}
+
+// whether q lies on segment pr, given that the three are collinear
+static bool on_segment (const cv::Point2d& p, const cv::Point2d& q, const cv::Point2d& r) {
+    return q.x <= std::max(p.x, r.x) && q.x >= std::min(p.x, r.x) && q.y <= std::max(p.y, r.y) && q.y >= std::min(p.y, r.y);
+}
+
+static bool segments_intersect (const cv::Point2d& p1, const cv::Point2d& q1, const cv::Point2d& p2, const cv::Point2d& q2) {
+    int o1 = orientation(p1, q1, p2);
+    int o2 = orientation(p1, q1, q2);
+    int o3 = orientation(p2, q2, p1);
+    int o4 = orientation(p2, q2, q1);
+
+    // general case, then the collinear special cases
+    return (o1 != o2 && o3 != o4) ||
+           (o1 == 0 && on_segment(p1, p2, q1)) ||
+           (o2 == 0 && on_segment(p1, q2, q1)) ||
+           (o3 == 0 && on_segment(p2, p1, q2)) ||
+           (o4 == 0 && on_segment(p2, q1, q2));
+}
+
+// corners (in order around it) of the rectangle of the given width centered on segment pt1 pt2
+static std::vector<cv::Point2d> build_rect (const cv::Point& pt1, const cv::Point& pt2, double width) {
+    double line_angle = atan2(pt2.y - pt1.y, pt2.x - pt1.x);
+    cv::Point2d offset(width/2.0 * cos(line_angle + M_PI/2), width/2.0 * sin(line_angle + M_PI/2));
+    cv::Point2d p1(pt1.x, pt1.y);
+    cv::Point2d p2(pt2.x, pt2.y);
+    return {p1 + offset, p1 - offset, p2 - offset, p2 + offset};
+}
+
+static bool rects_overlap (const std::vector<cv::Point2d>& rect1, const std::vector<cv::Point2d>& rect2) {
+    for (int i = 0; i < 4; i ++) {
+        for (int j = 0; j < 4; j ++) {
+            if (segments_intersect(rect1[i], rect1[(i+1)%4], rect2[j], rect2[(j+1)%4])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static double chain_length (const std::vector<cv::Point>& chain) {
+    double length = 0;
+    for (int i = 0; i < static_cast<int>(chain.size())-1; i ++) {
+        length += cv::norm(chain[i+1] - chain[i]);
+    }
+    return length;
+}
+
+// angle (rad) between two vectors, 0 if either has zero length
+static double angle_between (const cv::Point2d& vec1, const cv::Point2d& vec2) {
+    double norms = cv::norm(vec1) * cv::norm(vec2);
+    if (norms == 0) {
+        return 0;
+    }
+    return acos(std::min(1.0, std::max(-1.0, vec1.dot(vec2) / norms)));
+}
+
+// cost of joining an end of chain1 to an end of chain2 (from_end1: the end of chain1 rather than its start, same
+// for to_end2): their distance and how much the joined chain would have to turn at both ends
+static double join_cost (const std::vector<cv::Point>& chain1, const std::vector<cv::Point>& chain2, bool from_end1, bool to_end2, double w_e, double w_c) {
+    cv::Point2d tip1 = from_end1 ? chain1[chain1.size()-1] : chain1[0];
+    cv::Point2d before_tip1 = from_end1 ? chain1[chain1.size()-2] : chain1[1];
+    cv::Point2d tip2 = to_end2 ? chain2[chain2.size()-1] : chain2[0];
+    cv::Point2d before_tip2 = to_end2 ? chain2[chain2.size()-2] : chain2[1];
+
+    // the gap, walked from chain1 to chain2
+    cv::Point2d gap = tip2 - tip1;
+    double cost_euclidean = cv::norm(gap);
+    double cost_curvature_1 = angle_between(gap, tip1 - before_tip1);
+    double cost_curvature_2 = angle_between(gap, before_tip2 - tip2);
+    return w_e * cost_euclidean + w_c * (cost_curvature_1 + cost_curvature_2) / 2.0;
+}
+
+std::vector<int> solve_assignment (const MatrixXd& cost) {
+    int n = cost.rows();
+
+    // row and column potentials and the row matched to every column, 1-based with column 0 as the virtual start
+    std::vector<double> u(n+1, 0.0);
+    std::vector<double> v(n+1, 0.0);
+    std::vector<int> matched_row(n+1, 0);
+    std::vector<int> way(n+1, 0);
+
+    for (int i = 1; i <= n; i ++) {
+        matched_row[0] = i;
+        int j0 = 0;
+        std::vector<double> min_slack(n+1, std::numeric_limits<double>::infinity());
+        std::vector<bool> used(n+1, false);
+
+        // grow an alternating path from row i until it reaches a free column
+        do {
+            used[j0] = true;
+            int i0 = matched_row[j0];
+            double delta = std::numeric_limits<double>::infinity();
+            int j1 = 0;
+            for (int j = 1; j <= n; j ++) {
+                if (used[j]) {
+                    continue;
+                }
+                double slack = cost(i0-1, j-1) - u[i0] - v[j];
+                if (slack < min_slack[j]) {
+                    min_slack[j] = slack;
+                    way[j] = j0;
+                }
+                if (min_slack[j] < delta) {
+                    delta = min_slack[j];
+                    j1 = j;
+                }
+            }
+            for (int j = 0; j <= n; j ++) {
+                if (used[j]) {
+                    u[matched_row[j]] += delta;
+                    v[j] -= delta;
+                }
+                else {
+                    min_slack[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (matched_row[j0] != 0);
+
+        // flip the path
+        do {
+            int j1 = way[j0];
+            matched_row[j0] = matched_row[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+
+    std::vector<int> assignment(n, -1);
+    for (int j = 1; j <= n; j ++) {
+        assignment[matched_row[j]-1] = j-1;
+    }
+    return assignment;
+}
+
+std::vector<cv::Point> extract_connected_skeleton (const Mat& mask, int seg_length, double max_curvature) {
+    // smooth the mask: for a binary mask the 15x15 median is the majority vote
+    Mat smoothed;
+    cv::medianBlur(mask, smoothed, 15);
+
+    // skeletonization
+    Mat skeleton = thin_mask(smoothed);
+
+    // extract contour
+    std::vector<std::vector<cv::Point>> contours;
+    std::vector<cv::Vec4i> hierarchy;
+    cv::findContours(skeleton, contours, hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+
+    // cut every contour into chains of segments whose directions change by at most max_curvature
+    std::vector<std::vector<cv::Point>> chains = {};
+    double min_cos = cos(max_curvature / 180.0 * M_PI);
+    for (const std::vector<cv::Point>& contour : contours) {
+        std::vector<cv::Point> chain = {};
+        bool has_start = false;
+        bool has_last_dir = false;
+        cv::Point seg_start;
+        cv::Point last_segment_dir;
+
+        for (int i = 0; i < contour.size(); i ++) {
+            // reached the end of the contour
+            if (i == contour.size()-1) {
+                if (!chain.empty()) {
+                    chains.push_back(chain);
+                }
+                break;
+            }
+
+            if (!has_start) {
+                seg_start = contour[i];
+                has_start = true;
+            }
+
+            // keep traversing until reach segment length
+            if (cv::norm(contour[i] - seg_start) <= seg_length) {
+                continue;
+            }
+
+            cv::Point seg_end = contour[i];
+            cv::Point segment_dir = seg_end - seg_start;
+            if (!has_last_dir) {
+                last_segment_dir = segment_dir;
+                has_last_dir = true;
+            }
+            else if (segment_dir.dot(last_segment_dir) / (cv::norm(segment_dir) * cv::norm(last_segment_dir)) >= min_cos) {
+                // direction has not changed much: add the segment to the chain
+                if (chain.empty()) {
+                    chain.push_back(seg_start);
+                }
+                chain.push_back(seg_end);
+
+                seg_start = seg_end;
+                last_segment_dir = segment_dir;
+            }
+            else {
+                // direction changed: start a new chain
+                if (!chain.empty()) {
+                    chains.push_back(chain);
+                }
+                chain = {};
+                has_start = false;
+                has_last_dir = false;
+            }
+        }
+    }
+
+    // pruning: repeatedly take the longest remaining chain and cut the segments overlapping it out of the others
+    // (the contour of a skeleton runs along both sides of it, so every part is found twice)
+    double rect_width = 3;
+    std::vector<std::vector<cv::Point>> pruned_chains = {};
+    std::vector<std::vector<cv::Point>> leftover_chains = chains;
+    while (!leftover_chains.empty()) {
+        auto longest = std::max_element(leftover_chains.begin(), leftover_chains.end(),
+            [](const std::vector<cv::Point>& a, const std::vector<cv::Point>& b) {
+                return chain_length(a) < chain_length(b);
+            }
+        );
+        std::vector<cv::Point> cur_chain = *longest;
+        leftover_chains.erase(longest);
+        if (cur_chain.size() < 2) {
+            continue;
+        }
+        pruned_chains.push_back(cur_chain);
+
+        std::vector<std::vector<cv::Point2d>> cur_rects = {};
+        for (int k = 0; k < cur_chain.size()-1; k ++) {
+            cur_rects.push_back(build_rect(cur_chain[k], cur_chain[k+1], rect_width));
+        }
+
+        for (std::vector<cv::Point>& test_chain : leftover_chains) {
+            std::vector<cv::Point> new_test_chain = {};
+            for (int l = 0; l < static_cast<int>(test_chain.size())-1; l ++) {
+                std::vector<cv::Point2d> test_rect = build_rect(test_chain[l], test_chain[l+1], rect_width);
+                bool no_overlap = true;
+                for (const std::vector<cv::Point2d>& cur_rect : cur_rects) {
+                    if (rects_overlap(cur_rect, test_rect)) {
+                        no_overlap = false;
+                        break;
+                    }
+                }
+                // only keep the segment if it does not overlap any segment of the current chain
+                if (no_overlap) {
+                    if (new_test_chain.empty()) {
+                        new_test_chain.push_back(test_chain[l]);
+                    }
+                    new_test_chain.push_back(test_chain[l+1]);
+                }
+            }
+            test_chain = new_test_chain;
+        }
+    }
+
+    if (pruned_chains.empty()) {
+        throw std::invalid_argument("No DLO chain found in the mask");
+    }
+    if (pruned_chains.size() == 1) {
+        return pruned_chains[0];
+    }
+
+    // join the chains end to end by a minimum-cost assignment between their tips, plus the DLO's two ends
+    // cost matrix entry label format: chain 1 start, chain 1 end, chain 2 start, chain 2 end, ..., DLO end, DLO end
+    int num_of_chains = pruned_chains.size();
+    int matrix_size = 2*num_of_chains + 2;
+    MatrixXd cost_matrix = MatrixXd::Zero(matrix_size, matrix_size);
+    double w_e = 0.001;
+    double w_c = 1;
+    for (int i = 0; i < num_of_chains; i ++) {
+        for (int j = 0; j < num_of_chains; j ++) {
+            // matching a chain with itself (or its own other tip) is discouraged
+            if (i == j) {
+                cost_matrix.block(2*i, 2*j, 2, 2).setConstant(100000);
+            }
+            else {
+                cost_matrix(2*i, 2*j) = join_cost(pruned_chains[i], pruned_chains[j], false, false, w_e, w_c);
+                cost_matrix(2*i, 2*j+1) = join_cost(pruned_chains[i], pruned_chains[j], false, true, w_e, w_c);
+                cost_matrix(2*i+1, 2*j) = join_cost(pruned_chains[i], pruned_chains[j], true, false, w_e, w_c);
+                cost_matrix(2*i+1, 2*j+1) = join_cost(pruned_chains[i], pruned_chains[j], true, true, w_e, w_c);
+            }
+        }
+    }
+
+    // cost for being the DLO's two ends
+    cost_matrix.rightCols(2).setConstant(1000);
+    cost_matrix.bottomRows(2).setConstant(1000);
+    cost_matrix.bottomRightCorner(2, 2).setConstant(100000);
+
+    std::vector<int> col_idx = solve_assignment(cost_matrix);
+
+    // walk from the tip assigned to the DLO end to the other DLO end
+    std::vector<cv::Point> ordered = {};
+    int cur_idx = col_idx[matrix_size-1];
+    for (int n = 0; n < num_of_chains && cur_idx < 2*num_of_chains; n ++) {
+        std::vector<cv::Point> cur_chain = pruned_chains[cur_idx / 2];
+        if (cur_idx % 2 == 1) {
+            std::reverse(cur_chain.begin(), cur_chain.end());
+        }
+        ordered.insert(ordered.end(), cur_chain.begin(), cur_chain.end());
+
+        // where this chain's other tip connects to
+        cur_idx = (cur_idx % 2 == 0) ? col_idx[cur_idx+1] : col_idx[cur_idx-1];
+    }
+
+    return ordered;
+}
+
+// cubic B-spline basis functions at t on the clamped knot vector
+static void bspline_basis (const std::vector<double>& knots, int num_of_ctrl_pts, double t, Eigen::Ref<Eigen::RowVectorXd, 0, Eigen::InnerStride<>> basis) {
+    const int degree = 3;
+
+    // knot span containing t, the last non-empty one for t = 1
+    int span = degree;
+    while (span < num_of_ctrl_pts-1 && t >= knots[span+1]) {
+        span += 1;
+    }
+
+    // Cox-de Boor on the degree+1 non-zero functions
+    double N[degree+1] = {1.0, 0.0, 0.0, 0.0};
+    double left[degree+1];
+    double right[degree+1];
+    for (int d = 1; d <= degree; d ++) {
+        left[d] = t - knots[span+1-d];
+        right[d] = knots[span+d] - t;
+        double saved = 0.0;
+        for (int r = 0; r < d; r ++) {
+            double temp = N[r] / (right[r+1] + left[d-r]);
+            N[r] = saved + right[r+1]*temp;
+            saved = left[d-r]*temp;
+        }
+        N[d] = saved;
+    }
+
+    basis.setZero();
+    for (int k = 0; k <= degree; k ++) {
+        basis(span-degree+k) = N[k];
+    }
+}
+
+MatrixXd fit_spline_nodes (const MatrixXd& points, int num_of_nodes, int points_per_ctrl_pt) {
+    const int degree = 3;
+    int num_of_pts = points.rows();
+    if (num_of_pts < degree+1 || num_of_nodes < 2) {
+        throw std::invalid_argument("Too few points (" + std::to_string(num_of_pts) + ") to fit the DLO");
+    }
+
+    // chord-length parameterization
+    VectorXd params = VectorXd::Zero(num_of_pts);
+    for (int i = 1; i < num_of_pts; i ++) {
+        params(i) = params(i-1) + (points.row(i) - points.row(i-1)).norm();
+    }
+    if (params(num_of_pts-1) <= 0) {
+        throw std::invalid_argument("The DLO points are all at the same position");
+    }
+    params /= params(num_of_pts-1);
+
+    // clamped uniform knots
+    int num_of_ctrl_pts = std::max(degree+1, std::min(num_of_pts, num_of_pts / std::max(1, points_per_ctrl_pt)));
+    std::vector<double> knots(num_of_ctrl_pts + degree + 1, 0.0);
+    for (int i = 0; i < knots.size(); i ++) {
+        if (i > num_of_ctrl_pts-1) {
+            knots[i] = 1.0;
+        }
+        else if (i > degree) {
+            knots[i] = static_cast<double>(i - degree) / (num_of_ctrl_pts - degree);
+        }
+    }
+
+    // least squares with a small penalty on the second differences of the control points, which smooths out
+    // depth noise and keeps knot spans without data well defined
+    MatrixXd basis = MatrixXd::Zero(num_of_pts, num_of_ctrl_pts);
+    for (int i = 0; i < num_of_pts; i ++) {
+        bspline_basis(knots, num_of_ctrl_pts, params(i), basis.row(i));
+    }
+    MatrixXd second_diff = MatrixXd::Zero(num_of_ctrl_pts-2, num_of_ctrl_pts);
+    for (int i = 0; i < num_of_ctrl_pts-2; i ++) {
+        second_diff(i, i) = 1;
+        second_diff(i, i+1) = -2;
+        second_diff(i, i+2) = 1;
+    }
+    double smoothing = 1e-3;
+    MatrixXd normal = basis.transpose()*basis + smoothing*second_diff.transpose()*second_diff;
+    MatrixXd ctrl_pts = normal.ldlt().solve(basis.transpose()*points);
+
+    // sample the spline densely and resample it equally spaced in arc length
+    int num_of_samples = std::max(1000, 20*num_of_nodes);
+    MatrixXd samples(num_of_samples, 3);
+    Eigen::RowVectorXd sample_basis(num_of_ctrl_pts);
+    for (int i = 0; i < num_of_samples; i ++) {
+        bspline_basis(knots, num_of_ctrl_pts, static_cast<double>(i) / (num_of_samples-1), sample_basis);
+        samples.row(i) = sample_basis * ctrl_pts;
+    }
+    std::vector<double> arc(num_of_samples, 0.0);
+    for (int i = 1; i < num_of_samples; i ++) {
+        arc[i] = arc[i-1] + (samples.row(i) - samples.row(i-1)).norm();
+    }
+
+    MatrixXd nodes(num_of_nodes, 3);
+    int seg = 0;
+    for (int n = 0; n < num_of_nodes; n ++) {
+        double target = arc[num_of_samples-1] * n / (num_of_nodes-1);
+        while (seg < num_of_samples-2 && arc[seg+1] < target) {
+            seg += 1;
+        }
+        double seg_len = arc[seg+1] - arc[seg];
+        double t = (seg_len > 0) ? std::min(1.0, std::max(0.0, (target - arc[seg]) / seg_len)) : 0.0;
+        nodes.row(n) = (1-t)*samples.row(seg) + t*samples.row(seg+1);
+    }
+
+    return nodes;
+}
+
+// observed depth at (row, col) in meters, 0 if there is no measurement
+static double depth_at (const Mat& depth_image, int row, int col) {
+    if (depth_image.type() == CV_16UC1) {
+        return depth_image.at<uint16_t>(row, col) / 1000.0;
+    }
+    float depth = depth_image.at<float>(row, col);
+    return std::isfinite(depth) ? depth : 0.0;
+}
+
+MatrixXd initialize_nodes (const Mat& mask, const Mat& depth_image, const MatrixXd& proj_matrix, int num_of_nodes, double depth_filter, const Mat& tip_mask) {
+    if (depth_image.type() != CV_16UC1 && depth_image.type() != CV_32FC1) {
+        throw std::invalid_argument("initialize_nodes: depth image must be CV_16UC1 (mm) or CV_32FC1 (m)");
+    }
+
+    // filter the mask based on depth values
+    Mat filtered_mask = mask.clone();
+    if (depth_filter > 0) {
+        for (int i = 0; i < mask.rows; i ++) {
+            for (int j = 0; j < mask.cols; j ++) {
+                if (depth_at(depth_image, i, j) < depth_filter) {
+                    filtered_mask.at<uchar>(i, j) = 0;
+                }
+            }
+        }
+    }
+
+    // the pixels of the DLO in order
+    std::vector<cv::Point> pixels = extract_connected_skeleton(filtered_mask, 8, 25);
+
+    // start at the tip if the chain ends on it
+    if (!tip_mask.empty() && tip_mask.at<uchar>(pixels.back().y, pixels.back().x) != 0) {
+        std::reverse(pixels.begin(), pixels.end());
+    }
+
+    double fx = proj_matrix(0, 0);
+    double fy = proj_matrix(1, 1);
+    double cx = proj_matrix(0, 2);
+    double cy = proj_matrix(1, 2);
+
+    // do not include those without depth values
+    std::vector<Eigen::RowVector3d> points = {};
+    for (const cv::Point& pixel : pixels) {
+        double pc_z = depth_at(depth_image, pixel.y, pixel.x);
+        if (pc_z <= depth_filter || pc_z <= 0) {
+            continue;
+        }
+        points.push_back(Eigen::RowVector3d((pixel.x - cx) * pc_z / fx, (pixel.y - cy) * pc_z / fy, pc_z));
+    }
+
+    MatrixXd chain_3d(points.size(), 3);
+    for (int i = 0; i < points.size(); i ++) {
+        chain_3d.row(i) = points[i];
+    }
+
+    return fit_spline_nodes(chain_3d, num_of_nodes);
+}
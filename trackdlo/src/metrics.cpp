@@ -0,0 +1,175 @@
+#include "../include/metrics.h"
+#include "../include/trace.h"
+
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+
+// values are capped below 2^40 (12 days in microseconds)
+static const uint64_t max_value = (1ULL << 40) - 1;
+
+log_histogram::log_histogram () {
+    for (std::atomic<uint64_t>& count : counts_) {
+        count = 0;
+    }
+    sum_ = 0;
+    max_ = 0;
+}
+
+int log_histogram::bucket_index (uint64_t value) {
+    if (value < 32) {
+        return value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - 4;
+    return 32 + (shift - 1)*16 + static_cast<int>((value >> shift) - 16);
+}
+
+uint64_t log_histogram::bucket_upper_bound (int index) {
+    if (index < 32) {
+        return index;
+    }
+    int shift = (index - 32) / 16 + 1;
+    uint64_t sub_bucket = (index - 32) % 16 + 16;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+void log_histogram::record (uint64_t value) {
+    value = std::min(value, max_value);
+    counts_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t cur_max = max_.load(std::memory_order_relaxed);
+    while (value > cur_max && !max_.compare_exchange_weak(cur_max, value, std::memory_order_relaxed)) {}
+}
+
+histogram_summary log_histogram::take (double scale) {
+    std::array<uint64_t, num_of_buckets> counts;
+    uint64_t total = 0;
+    for (int i = 0; i < num_of_buckets; i ++) {
+        counts[i] = counts_[i].exchange(0, std::memory_order_relaxed);
+        total += counts[i];
+    }
+    uint64_t sum = sum_.exchange(0, std::memory_order_relaxed);
+    uint64_t max = max_.exchange(0, std::memory_order_relaxed);
+
+    histogram_summary summary;
+    summary.count = total;
+    if (total == 0) {
+        return summary;
+    }
+    summary.mean = scale * sum / total;
+    summary.max = scale * max;
+
+    // smallest bucket holding at least the requested fraction of the values, reported by its upper bound
+    std::vector<double> fractions = {0.5, 0.9, 0.99};
+    std::vector<double*> percentiles = {&summary.p50, &summary.p90, &summary.p99};
+    uint64_t cumulative = 0;
+    int p = 0;
+    for (int i = 0; i < num_of_buckets && p < fractions.size(); i ++) {
+        cumulative += counts[i];
+        while (p < fractions.size() && cumulative >= std::ceil(fractions[p] * total)) {
+            *percentiles[p] = scale * std::min(bucket_upper_bound(i), max);
+            p += 1;
+        }
+    }
+
+    return summary;
+}
+
+tracker_metrics::tracker_metrics () {
+    frames = 0;
+    dropped_frames = 0;
+    superseded_frames = 0;
+    unmatched_messages = 0;
+    skipped_frames = 0;
+    unhealthy_steps = 0;
+}
+
+static const char* stage_names[num_of_stages] = {"decode", "segmentation", "back-projection", "downsampling", "visibility",
+                                                  "pre-proc EM", "priors", "main EM", "render", "publish", "image publish"};
+
+void tracker_metrics::record_stage (tracker_stage stage, std::chrono::steady_clock::time_point start) {
+    stage_latencies[stage].record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    TRACE_SINCE(stage_names[stage], start);
+}
+
+void tracker_metrics::record_latency (log_histogram& latency, const ros::Time& stamp) {
+    double elapsed = (ros::Time::now() - stamp).toSec();
+    latency.record(static_cast<uint64_t>(std::max(0.0, elapsed) * 1e6));
+}
+
+static void add_summary (diagnostic_msgs::DiagnosticStatus& status, const std::string& name, const histogram_summary& summary, int precision) {
+    auto format = [precision](double value) {
+        std::ostringstream stream;
+        stream << std::fixed << std::setprecision(precision) << value;
+        return stream.str();
+    };
+
+    diagnostic_msgs::KeyValue value;
+    value.key = name;
+    value.value = "p50 " + format(summary.p50) + ", p90 " + format(summary.p90) + ", p99 " + format(summary.p99) +
+                  ", max " + format(summary.max) + ", mean " + format(summary.mean) + ", n " + std::to_string(summary.count);
+    status.values.push_back(value);
+}
+
+static void add_value (diagnostic_msgs::DiagnosticStatus& status, const std::string& name, const std::string& text) {
+    diagnostic_msgs::KeyValue value;
+    value.key = name;
+    value.value = text;
+    status.values.push_back(value);
+}
+
+diagnostic_msgs::DiagnosticStatus tracker_metrics::take_diagnostics (double period) {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = "trackdlo: tracker";
+    status.hardware_id = "trackdlo";
+
+    uint64_t cur_frames = frames.exchange(0);
+    uint64_t cur_dropped_frames = dropped_frames.exchange(0);
+    uint64_t cur_superseded_frames = superseded_frames.exchange(0);
+    uint64_t cur_unmatched_messages = unmatched_messages.exchange(0);
+    uint64_t cur_skipped_frames = skipped_frames.exchange(0);
+    uint64_t cur_unhealthy_steps = unhealthy_steps.exchange(0);
+
+    add_value(status, "frame rate (Hz)", std::to_string(cur_frames / period));
+    add_value(status, "frames", std::to_string(cur_frames));
+    add_value(status, "dropped frames", std::to_string(cur_dropped_frames));
+    add_value(status, "superseded frames", std::to_string(cur_superseded_frames));
+    add_value(status, "unmatched messages", std::to_string(cur_unmatched_messages));
+    add_value(status, "skipped frames", std::to_string(cur_skipped_frames));
+    add_value(status, "unhealthy steps", std::to_string(cur_unhealthy_steps));
+
+    // latencies in ms
+    add_summary(status, "sensor to received (ms)", receive_latency.take(0.001), 2);
+    add_summary(status, "sensor to tracking start (ms)", start_latency.take(0.001), 2);
+    add_summary(status, "sensor to result (ms)", result_latency.take(0.001), 2);
+    add_summary(status, "sensor to published (ms)", publish_latency.take(0.001), 2);
+    add_summary(status, "sync wait (ms)", sync_wait.take(0.001), 2);
+    add_summary(status, "frame (ms)", frame_latency.take(0.001), 2);
+    for (int stage = 0; stage < num_of_stages; stage ++) {
+        add_summary(status, std::string(stage_names[stage]) + " (ms)", stage_latencies[stage].take(0.001), 2);
+    }
+    add_summary(status, "pre-proc EM iterations", pre_proc_iterations.take(), 0);
+    add_summary(status, "main EM iterations", main_iterations.take(), 0);
+    add_summary(status, "points", points.take(), 0);
+    histogram_summary drift = precision_drift.take(0.001);
+    if (drift.count > 0) {
+        add_summary(status, "mixed precision drift (mm)", drift, 3);
+    }
+
+    if (cur_frames == 0) {
+        status.level = diagnostic_msgs::DiagnosticStatus::STALE;
+        status.message = "no frames";
+    }
+    else if (cur_dropped_frames > 0 || cur_unmatched_messages > 0 || cur_unhealthy_steps > 0) {
+        status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+        status.message = std::to_string(cur_dropped_frames) + " dropped frames, " + std::to_string(cur_unmatched_messages) + " unmatched messages, " +
+                         std::to_string(cur_unhealthy_steps) + " unhealthy steps";
+    }
+    else {
+        status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.message = "tracking";
+    }
+    return status;
+}
@@ -0,0 +1,164 @@
+#include "../include/predictor.h"
+
+motion_predictor::motion_predictor (int history_size, double max_horizon) {
+    history_size_ = std::max(1, history_size);
+    max_horizon_ = max_horizon;
+}
+
+void motion_predictor::add_estimate (const ros::Time& stamp, const MatrixXd& Y, double sigma2) {
+    std::shared_ptr<const motion_model> old_model = std::atomic_load(&model_);
+    std::shared_ptr<motion_model> model = std::make_shared<motion_model>();
+
+    // keep the newest history_size - 1 results of a matching history
+    if (old_model && old_model->Ys.back().rows() == Y.rows() && stamp > old_model->stamps.back()) {
+        int first = std::max(0, static_cast<int>(old_model->stamps.size()) - (history_size_ - 1));
+        model->stamps.assign(old_model->stamps.begin() + first, old_model->stamps.end());
+        model->Ys.assign(old_model->Ys.begin() + first, old_model->Ys.end());
+    }
+    model->stamps.push_back(stamp);
+    model->Ys.push_back(Y);
+
+    int n = model->stamps.size();
+    int M = Y.rows();
+    model->velocity = MatrixXd::Zero(M, 3);
+    model->noise_var = VectorXd::Constant(M, sigma2);
+    model->velocity_var = VectorXd::Zero(M);
+
+    if (n >= 2) {
+        // least-squares line through the positions of every node, times relative to the latest result
+        std::vector<double> t(n);
+        double t_mean = 0;
+        for (int i = 0; i < n; i ++) {
+            t[i] = (model->stamps[i] - stamp).toSec();
+            t_mean += t[i] / n;
+        }
+        double sxx = 0;
+        MatrixXd Y_mean = MatrixXd::Zero(M, 3);
+        for (int i = 0; i < n; i ++) {
+            sxx += (t[i] - t_mean) * (t[i] - t_mean);
+            Y_mean += model->Ys[i] / n;
+        }
+        for (int i = 0; i < n; i ++) {
+            model->velocity += (t[i] - t_mean) / sxx * (model->Ys[i] - Y_mean);
+        }
+
+        // residual variance of the fit, at least the tracker's
+        if (n > 2) {
+            VectorXd residual = VectorXd::Zero(M);
+            for (int i = 0; i < n; i ++) {
+                residual += (model->Ys[i] - Y_mean - (t[i] - t_mean) * model->velocity).rowwise().squaredNorm();
+            }
+            model->noise_var = (residual / (3 * (n - 2))).cwiseMax(sigma2);
+        }
+        model->velocity_var = model->noise_var / sxx;
+    }
+
+    std::atomic_store(&model_, std::shared_ptr<const motion_model>(model));
+}
+
+void motion_predictor::reset () {
+    std::atomic_store(&model_, std::shared_ptr<const motion_model>());
+}
+
+bool motion_predictor::predict (const ros::Time& t, MatrixXd& Y, VectorXd& sigma) const {
+    std::shared_ptr<const motion_model> model = std::atomic_load(&model_);
+    if (!model || t < model->stamps.front()) {
+        return false;
+    }
+
+    double horizon = (t - model->stamps.back()).toSec();
+    if (horizon > max_horizon_) {
+        return false;
+    }
+
+    // extrapolate from the latest result
+    if (horizon >= 0) {
+        Y = model->Ys.back() + horizon * model->velocity;
+        sigma = (model->noise_var + horizon * horizon * model->velocity_var).cwiseSqrt();
+        return true;
+    }
+
+    // interpolate between the results around t, stamps[i-1] <= t < stamps[i]
+    int i = model->stamps.size() - 1;
+    while (model->stamps[i-1] > t) {
+        i -= 1;
+    }
+    double w = (t - model->stamps[i-1]).toSec() / (model->stamps[i] - model->stamps[i-1]).toSec();
+    Y = (1 - w) * model->Ys[i-1] + w * model->Ys[i];
+    sigma = model->noise_var.cwiseSqrt();
+    return true;
+}
+
+prediction_publisher::prediction_publisher (const motion_predictor& predictor, const ros::Publisher& pub, const std::string& frame_id, double rate, double delay)
+    : predictor_(predictor) {
+    pub_ = pub;
+    frame_id_ = frame_id;
+    rate_ = rate;
+    delay_ = delay;
+    stop_ = false;
+    thread_ = std::thread(&prediction_publisher::run, this);
+}
+
+prediction_publisher::~prediction_publisher () {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    stopped_.notify_one();
+    thread_.join();
+}
+
+void prediction_publisher::run () {
+    // x, y, z and sigma of every node as float32, the message is reused
+    sensor_msgs::PointCloud2 pc_msg;
+    pc_msg.header.frame_id = frame_id_;
+    std::vector<std::string> field_names = {"x", "y", "z", "sigma"};
+    for (int f = 0; f < field_names.size(); f ++) {
+        sensor_msgs::PointField field;
+        field.name = field_names[f];
+        field.offset = f * sizeof(float);
+        field.datatype = sensor_msgs::PointField::FLOAT32;
+        field.count = 1;
+        pc_msg.fields.push_back(field);
+    }
+    pc_msg.height = 1;
+    pc_msg.point_step = field_names.size() * sizeof(float);
+    pc_msg.is_bigendian = false;
+    pc_msg.is_dense = true;
+
+    MatrixXd Y;
+    VectorXd sigma;
+    std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / rate_));
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        // fixed rate; after a stall, restart from now instead of catching up
+        next += period;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (next < now) {
+            next = now;
+        }
+        if (stopped_.wait_until(lock, next, [this] { return stop_; })) {
+            return;
+        }
+
+        ros::Time t = ros::Time::now() - ros::Duration(delay_);
+        if (!predictor_.predict(t, Y, sigma)) {
+            continue;
+        }
+
+        pc_msg.header.stamp = t;
+        pc_msg.width = Y.rows();
+        pc_msg.row_step = pc_msg.point_step * pc_msg.width;
+        pc_msg.data.resize(pc_msg.row_step);
+        float* points = reinterpret_cast<float*>(pc_msg.data.data());
+        for (int i = 0; i < Y.rows(); i ++) {
+            points[4*i] = Y(i, 0);
+            points[4*i + 1] = Y(i, 1);
+            points[4*i + 2] = Y(i, 2);
+            points[4*i + 3] = sigma(i);
+        }
+        pub_.publish(pc_msg);
+    }
+}
@@ -24,6 +24,7 @@ double bag_rate;
 int num_of_nodes;
 bool save_images;
 bool save_errors;
+double recovery_threshold = 0.03;
 
 int callback_count = 0;
 evaluator tracking_evaluator;
@@ -50,12 +51,14 @@ sensor_msgs::ImagePtr Callback(const sensor_msgs::ImageConstPtr& image_msg, cons
     if (tracking_evaluator.exit_time() == -1) {
         if (callback_count >= tracking_evaluator.length() - 3) {
             std::cout << "Shutting down evaluator..." << std::endl;
+            tracking_evaluator.report_recovery();
             ros::shutdown();
         }
     }
     else {
         if (time_from_start > tracking_evaluator.exit_time() || callback_count >= tracking_evaluator.length() - 3) {
             std::cout << "Shutting down evaluator..." << std::endl;
+            tracking_evaluator.report_recovery();
             ros::shutdown();
         }
     }
@@ -110,175 +113,17 @@ sensor_msgs::ImagePtr Callback(const sensor_msgs::ImageConstPtr& image_msg, cons
             std::cout << "Y_true size: " << Y_true.rows() << "; Y_track size: " << Y_track.rows() << std::endl;
 
             if (time_from_start > tracking_evaluator.recording_start_time() + tracking_evaluator.wait_before_occlusion()) {
-                if (bag_file == 0) {
-                    // simulate occlusion: occlude the first n nodes
-                    // strategy: first calculate the 3D boundary box based on point cloud, then project the four corners back to the image
-                    int num_of_occluded_nodes = static_cast<int>(Y_track.rows() * tracking_evaluator.pct_occlusion() / 100.0);
-
-                    if (num_of_occluded_nodes != 0) {
-
-                        double min_x = Y_true(0, 0);
-                        double min_y = Y_true(0, 1);
-                        double min_z = Y_true(0, 2);
-
-                        double max_x = Y_true(0, 0);
-                        double max_y = Y_true(0, 1);
-                        double max_z = Y_true(0, 2);
-
-                        for (int i = 0; i < num_of_occluded_nodes; i ++) {
-                            if (Y_true(i, 0) < min_x) {
-                                min_x = Y_true(i, 0);
-                            }
-                            if (Y_true(i, 1) < min_y) {
-                                min_y = Y_true(i, 1);
-                            }
-                            if (Y_true(i, 2) < min_z) {
-                                min_z = Y_true(i, 2);
-                            }
-
-                            if (Y_true(i, 0) > max_x) {
-                                max_x = Y_true(i, 0);
-                            }
-                            if (Y_true(i, 1) > max_y) {
-                                max_y = Y_true(i, 1);
-                            }
-                            if (Y_true(i, 2) > max_z) {
-                                max_z = Y_true(i, 2);
-                            }
-                        }
-
-                        MatrixXd min_corner(1, 3);
-                        min_corner << min_x, min_y, min_z;
-                        MatrixXd max_corner(1, 3);
-                        max_corner << max_x, max_y, max_z;
-
-                        MatrixXd corners = MatrixXd::Zero(2, 3);
-                        corners.row(0) = min_corner.replicate(1, 1);
-                        corners.row(1) = max_corner.replicate(1, 1);
-
-                        // project to find occlusion block coorindate
-                        MatrixXd nodes_h = corners.replicate(1, 1);
-                        nodes_h.conservativeResize(nodes_h.rows(), nodes_h.cols()+1);
-                        nodes_h.col(nodes_h.cols()-1) = MatrixXd::Ones(nodes_h.rows(), 1);
-                        MatrixXd image_coords = (proj_matrix * nodes_h.transpose()).transpose();
-
-                        int pix_coord_1_x = static_cast<int>(image_coords(0, 0)/image_coords(0, 2));
-                        int pix_coord_1_y = static_cast<int>(image_coords(0, 1)/image_coords(0, 2));
-                        int pix_coord_2_x = static_cast<int>(image_coords(1, 0)/image_coords(1, 2));
-                        int pix_coord_2_y = static_cast<int>(image_coords(1, 1)/image_coords(1, 2));
-                    
-                        int extra_border = 30;
-
-                        // best scenarios: min_corner and max_corner are the top left and bottom right corners
-                        if (pix_coord_1_x <= pix_coord_2_x && pix_coord_1_y <= pix_coord_2_y) {
-                            // cv::Point p1(pix_coord_1_x - extra_border, pix_coord_1_y - extra_border);
-                            // cv::Point p2(pix_coord_2_x + extra_border, pix_coord_2_y + extra_border);
-                            // cv::rectangle(occlusion_mask, p1, p2, cv::Scalar(0, 0, 0), -1);
-                            top_left_x = pix_coord_1_x - extra_border;
-                            if (top_left_x < 0) {top_left_x = 0;}
-                            top_left_y = pix_coord_1_y - extra_border;
-                            if (top_left_y < 0) {top_left_y = 0;}
-                            bottom_right_x = pix_coord_2_x + extra_border;
-                            if (bottom_right_x >= cur_image_orig.cols) {bottom_right_x = cur_image_orig.cols-1;}
-                            bottom_right_y = pix_coord_2_y + extra_border;
-                            if (bottom_right_y >= cur_image_orig.rows) {bottom_right_y = cur_image_orig.rows-1;}
-                        }
-                        // best scenarios: min_corner and max_corner are the top left and bottom right corners
-                        else if (pix_coord_2_x <= pix_coord_1_x && pix_coord_2_y <= pix_coord_1_y) {
-                            // cv::Point p1(pix_coord_2_x - extra_border, pix_coord_2_y - extra_border);
-                            // cv::Point p2(pix_coord_1_x + extra_border, pix_coord_1_y + extra_border);
-                            // cv::rectangle(occlusion_mask, p1, p2, cv::Scalar(0, 0, 0), -1);
-                            top_left_x = pix_coord_2_x - extra_border;
-                            if (top_left_x < 0) {top_left_x = 0;}
-                            top_left_y = pix_coord_2_y - extra_border;
-                            if (top_left_y < 0) {top_left_y = 0;}
-                            bottom_right_x = pix_coord_1_x + extra_border;
-                            if (bottom_right_x >= cur_image_orig.cols) {bottom_right_x = cur_image_orig.cols-1;}
-                            bottom_right_y = pix_coord_1_y + extra_border;
-                            if (bottom_right_y >= cur_image_orig.rows) {bottom_right_y = cur_image_orig.rows-1;}
-                        }
-                        // min_corner is top right, max_corner is bottom left
-                        else if (pix_coord_2_x <= pix_coord_1_x && pix_coord_1_y <= pix_coord_2_y) {
-                            // cv::Point p1(pix_coord_2_x - extra_border, pix_coord_1_y - extra_border);
-                            // cv::Point p2(pix_coord_1_x + extra_border, pix_coord_2_y + extra_border);
-                            // cv::rectangle(occlusion_mask, p1, p2, cv::Scalar(0, 0, 0), -1);
-                            top_left_x = pix_coord_2_x - extra_border;
-                            if (top_left_x < 0) {top_left_x = 0;}
-                            top_left_y = pix_coord_1_y - extra_border;
-                            if (top_left_y < 0) {top_left_y = 0;}
-                            bottom_right_x = pix_coord_1_x + extra_border;
-                            if (bottom_right_x >= cur_image_orig.cols) {bottom_right_x = cur_image_orig.cols-1;}
-                            bottom_right_y = pix_coord_2_y + extra_border;
-                            if (bottom_right_y >= cur_image_orig.rows) {bottom_right_y = cur_image_orig.rows-1;}
-                        }
-                        // max_corner is top right, min_corner is bottom left
-                        else {
-                            // cv::Point p1(pix_coord_1_x - extra_border, pix_coord_2_y - extra_border);
-                            // cv::Point p2(pix_coord_2_x + extra_border, pix_coord_1_y + extra_border);
-                            // cv::rectangle(occlusion_mask, p1, p2, cv::Scalar(0, 0, 0), -1);
-                            top_left_x = pix_coord_1_x - extra_border;
-                            if (top_left_x < 0) {top_left_x = 0;}
-                            top_left_y = pix_coord_2_y - extra_border;
-                            if (top_left_y < 0) {top_left_y = 0;}
-                            bottom_right_x = pix_coord_2_x + extra_border;
-                            if (bottom_right_x >= cur_image_orig.cols) {bottom_right_x = cur_image_orig.cols-1;}
-                            bottom_right_y = pix_coord_1_y + extra_border;
-                            if (bottom_right_y >= cur_image_orig.rows) {bottom_right_y = cur_image_orig.rows-1;}
-                        }
-
-                        std_msgs::Int32MultiArray corners_arr;
-                        corners_arr.data = {top_left_x, top_left_y, bottom_right_x, bottom_right_y};
-                        corners_arr_pub.publish(corners_arr);
-                    }
-                }
-
-                else if (bag_file == 1) {
-                    top_left_x = 840;
-                    top_left_y = 408;
-                    bottom_right_x = 1191;
-                    bottom_right_y = 678;
-
-                    std_msgs::Int32MultiArray corners_arr;
-                    corners_arr.data = {top_left_x, top_left_y, bottom_right_x, bottom_right_y};
-                    corners_arr_pub.publish(corners_arr);
-                }
-
-                else if (bag_file == 2) {
-                    top_left_x = 780;
-                    top_left_y = 120;
-                    bottom_right_x = 1050;
-                    bottom_right_y = 290;
+                cv::Rect occlusion = tracking_evaluator.occlusion_rect(Y_true, proj_matrix, Y_track.rows(), cur_image_orig.cols, cur_image_orig.rows);
+                if (!occlusion.empty()) {
+                    top_left_x = occlusion.x;
+                    top_left_y = occlusion.y;
+                    bottom_right_x = occlusion.x + occlusion.width;
+                    bottom_right_y = occlusion.y + occlusion.height;
 
                     std_msgs::Int32MultiArray corners_arr;
                     corners_arr.data = {top_left_x, top_left_y, bottom_right_x, bottom_right_y};
                     corners_arr_pub.publish(corners_arr);
                 }
-
-                else if (bag_file == 4) {
-                    top_left_x = 543;
-                    top_left_y = 276;
-                    bottom_right_x = 738;
-                    bottom_right_y = 383;
-
-                    std_msgs::Int32MultiArray corners_arr;
-                    corners_arr.data = {top_left_x, top_left_y, bottom_right_x, bottom_right_y};
-                    corners_arr_pub.publish(corners_arr);
-                }
-
-                else if (bag_file == 5) {
-                    top_left_x = 300;
-                    top_left_y = 317;
-                    bottom_right_x = 698;
-                    bottom_right_y = 440;
-
-                    std_msgs::Int32MultiArray corners_arr;
-                    corners_arr.data = {top_left_x, top_left_y, bottom_right_x, bottom_right_y};
-                    corners_arr_pub.publish(corners_arr);
-                }
-
-                else {
-                    throw std::invalid_argument("Invalid bag file ID!");
-                }
             }
 
             // compute error
@@ -289,6 +134,7 @@ sensor_msgs::ImagePtr Callback(const sensor_msgs::ImageConstPtr& image_msg, cons
                 cur_error = tracking_evaluator.compute_error(Y_track, Y_true);
             }
             std::cout << "error = " << cur_error << std::endl;
+            tracking_evaluator.update_recovery(time_from_start, cur_error);
 
             // optional pub and save result image
             if (time_from_start > tracking_evaluator.recording_start_time() + tracking_evaluator.wait_before_occlusion()) {
@@ -413,6 +259,7 @@ int main(int argc, char **argv) {
     nh.getParam("/evaluation/num_of_nodes", num_of_nodes);
     nh.getParam("/evaluation/save_images", save_images);
     nh.getParam("/evaluation/save_errors", save_errors);
+    nh.getParam("/evaluation/recovery_threshold", recovery_threshold);
 
     // get bag file length
     std::vector<std::string> topics;
@@ -447,6 +294,7 @@ int main(int argc, char **argv) {
 
     // initialize evaluator
     tracking_evaluator = evaluator(rgb_count, trial, pct_occlusion, alg, bag_file, save_location, start_record_at, exit_at, wait_before_occlusion, bag_rate, num_of_nodes);
+    tracking_evaluator.set_recovery_threshold(recovery_threshold);
 
     image_transport::ImageTransport it(nh);
     image_transport::Publisher eval_img_pub = it.advertise("/eval_img", 10);
@@ -0,0 +1,496 @@
+#include "../include/trackdlo.h"
+#include "../include/utils.h"
+#include "../include/evaluator.h"
+#include "../include/visibility.h"
+#include "../include/segmentation.h"
+#include "../include/initializer.h"
+
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+using Eigen::MatrixXd;
+using cv::Mat;
+
+// runs many tracker configurations over one recording, loaded into memory once, and reports the evaluator's error
+// against the frame time of every configuration
+
+std::string bag_dir;
+int bag_file = 0;
+std::string rgb_topic = "/camera/color/image_raw";
+std::string depth_topic = "/camera/aligned_depth_to_color/image_raw";
+std::string pointcloud_topic = "/camera/depth/color/points";
+std::string camera_info_topic = "/camera/color/camera_info";
+int num_of_nodes = 40;
+bool multi_color_dlo = true;
+std::string hsv_threshold_upper_limit = "130 255 255";
+std::string hsv_threshold_lower_limit = "90 90 30";
+int pct_occlusion = 0;
+double start_record_at = 0;
+double exit_at = -1;
+double wait_before_occlusion = 0;
+int frame_stride = 1;
+int threads = 0;
+bool mixed_precision = true;
+bool fused_registration = true;
+// a configuration fails when tracking counts as lost under these, as in trackdlo_eval.launch
+health_thresholds sweep_health_thresholds;
+std::string output = "/tmp/trackdlo_sweep.csv";
+
+// tracker parameters that can be swept, with the values used when they are neither set nor swept
+const std::vector<std::pair<std::string, double>> tracker_params = {
+    {"beta", 0.5}, {"lambda", 50000}, {"alpha", 3}, {"mu", 0.1}, {"k_vis", 500}, {"d_vis", 0.06},
+    {"visibility_threshold", 0.005}, {"dlo_pixel_width", 30}, {"beta_pre_proc", 3.0}, {"lambda_pre_proc", 1.0},
+    {"lle_weight", 10.0}, {"downsample_leaf_size", 0.005}, {"max_iter", 50}, {"tol", 0.0002}
+};
+
+typedef std::map<std::string, double> sweep_config;
+
+// one recorded frame, shared read-only by all configurations
+struct sweep_frame {
+    double time;                // seconds since the first frame
+    Mat depth;
+    Mat mask;                   // with the simulated occlusion
+    MatrixXd Y_true;            // sorted ground-truth nodes, empty if the frame is not scored
+};
+
+struct sweep_result {
+    bool failed = false;
+    std::string error_message;
+    double mean_error = 0;      // m
+    double max_error = 0;       // m
+    double mean_frame_time = 0; // ms
+    double p90_frame_time = 0;  // ms
+    int scored_frames = 0;
+    bool pareto_optimal = false;
+};
+
+MatrixXd proj_matrix(3, 4);
+MatrixXd Y_init;
+std::vector<double> init_geodesic_coord;
+std::vector<sweep_frame> frames;
+evaluator frame_evaluator;
+
+// back-projection reads colors from an image the size of the frames; the tracker ignores them, so every frame
+// shares one black image
+Mat blank_image;
+
+double param_value (const XmlRpc::XmlRpcValue& value) {
+    if (value.getType() == XmlRpc::XmlRpcValue::TypeInt) {
+        return static_cast<int>(const_cast<XmlRpc::XmlRpcValue&>(value));
+    }
+    if (value.getType() == XmlRpc::XmlRpcValue::TypeDouble) {
+        return static_cast<double>(const_cast<XmlRpc::XmlRpcValue&>(value));
+    }
+    throw std::invalid_argument("sweep values must be numbers");
+}
+
+// every combination of the values in grid (parameter name -> list of values or a single value) on top of base
+std::vector<sweep_config> expand_grid (const sweep_config& base, XmlRpc::XmlRpcValue& grid) {
+    std::vector<sweep_config> configs = {base};
+    if (grid.getType() != XmlRpc::XmlRpcValue::TypeStruct) {
+        return configs;
+    }
+
+    for (XmlRpc::XmlRpcValue::iterator it = grid.begin(); it != grid.end(); ++it) {
+        if (base.count(it->first) == 0) {
+            throw std::invalid_argument("cannot sweep unknown parameter " + it->first);
+        }
+        std::vector<double> values;
+        if (it->second.getType() == XmlRpc::XmlRpcValue::TypeArray) {
+            for (int i = 0; i < it->second.size(); i ++) {
+                values.push_back(param_value(it->second[i]));
+            }
+        }
+        else {
+            values.push_back(param_value(it->second));
+        }
+
+        std::vector<sweep_config> expanded;
+        for (const sweep_config& config : configs) {
+            for (double value : values) {
+                sweep_config cur_config = config;
+                cur_config[it->first] = value;
+                expanded.push_back(cur_config);
+            }
+        }
+        configs = expanded;
+    }
+    return configs;
+}
+
+cv::Scalar parse_hsv (const std::string& text) {
+    std::istringstream stream(text);
+    double h, s, v;
+    if (!(stream >> h >> s >> v)) {
+        throw std::invalid_argument("malformed HSV limit \"" + text + "\"");
+    }
+    return cv::Scalar(h, s, v);
+}
+
+// reads the recording once: decodes every frame_stride-th synced rgb/depth frame, segments it, applies the
+// simulated occlusion and finds its ground truth. the first frame the DLO can be extracted from initializes it
+void load_frames () {
+    std::vector<color_range> ranges;
+    if (multi_color_dlo) {
+        ranges.push_back({"blue", true, cv::Scalar(90, 90, 30), cv::Scalar(130, 255, 255)});
+        ranges.push_back({"green", true, cv::Scalar(58, 130, 50), cv::Scalar(90, 255, 255)});
+    }
+    else {
+        ranges.push_back({"user", true, parse_hsv(hsv_threshold_lower_limit), parse_hsv(hsv_threshold_upper_limit)});
+    }
+    color_lut lut(std::vector<std::vector<color_range>>{ranges});
+
+    bool scored = (bag_file != 3);
+    std::vector<std::string> topics = {rgb_topic, depth_topic, camera_info_topic};
+    if (scored) {
+        topics.push_back(pointcloud_topic);
+    }
+    rosbag::Bag bag(bag_dir, rosbag::bagmode::Read);
+    rosbag::View view(bag, rosbag::TopicQuery(topics));
+
+    // messages of the same frame share a stamp
+    struct pending_frame {
+        sensor_msgs::ImageConstPtr rgb;
+        sensor_msgs::ImageConstPtr depth;
+        sensor_msgs::PointCloud2ConstPtr cloud;
+    };
+    std::map<ros::Time, pending_frame> pending;
+    bool has_proj_matrix = false;
+    bool has_first_stamp = false;
+    ros::Time first_stamp;
+    MatrixXd head_node;
+    int synced_frames = 0;
+
+    for (const rosbag::MessageInstance& msg : view) {
+        if (msg.getTopic() == camera_info_topic) {
+            if (!has_proj_matrix) {
+                sensor_msgs::CameraInfoConstPtr info = msg.instantiate<sensor_msgs::CameraInfo>();
+                for (int i = 0; i < info->P.size(); i ++) {
+                    proj_matrix(i/4, i%4) = info->P[i];
+                }
+                has_proj_matrix = true;
+            }
+            continue;
+        }
+
+        ros::Time stamp;
+        if (msg.getTopic() == rgb_topic) {
+            sensor_msgs::ImageConstPtr rgb = msg.instantiate<sensor_msgs::Image>();
+            stamp = rgb->header.stamp;
+            pending[stamp].rgb = rgb;
+        }
+        else if (msg.getTopic() == depth_topic) {
+            sensor_msgs::ImageConstPtr depth = msg.instantiate<sensor_msgs::Image>();
+            stamp = depth->header.stamp;
+            pending[stamp].depth = depth;
+        }
+        else {
+            sensor_msgs::PointCloud2ConstPtr cloud = msg.instantiate<sensor_msgs::PointCloud2>();
+            stamp = cloud->header.stamp;
+            pending[stamp].cloud = cloud;
+        }
+
+        const pending_frame& cur = pending[stamp];
+        if (!cur.rgb || !cur.depth || (scored && !cur.cloud) || !has_proj_matrix) {
+            continue;
+        }
+        pending_frame synced = cur;
+        // anything older than a complete frame will never be completed
+        pending.erase(pending.begin(), pending.upper_bound(stamp));
+
+        if (!has_first_stamp) {
+            first_stamp = stamp;
+            has_first_stamp = true;
+        }
+        double time = (stamp - first_stamp).toSec();
+        if (exit_at != -1 && time > exit_at) {
+            break;
+        }
+        synced_frames += 1;
+        if (Y_init.size() != 0 && (synced_frames - 1) % frame_stride != 0) {
+            continue;
+        }
+
+        Mat image = cv_bridge::toCvShare(synced.rgb, "bgr8")->image;
+        sweep_frame frame;
+        frame.time = time;
+        frame.depth = cv_bridge::toCvCopy(synced.depth)->image;
+        lut.classify(image, frame.mask);
+
+        if (Y_init.size() == 0) {
+            try {
+                Y_init = initialize_nodes(frame.mask, frame.depth, proj_matrix, num_of_nodes);
+            }
+            catch (const std::invalid_argument& e) {
+                ROS_WARN_STREAM("cannot initialize from the frame at " + std::to_string(time) + " s: " + e.what());
+                continue;
+            }
+
+            // ground truth starts at the end with the smaller x, as in the evaluation
+            head_node = (Y_init(0, 0) > Y_init(Y_init.rows()-1, 0)) ? Y_init.bottomRows(1) : Y_init.topRows(1);
+            init_geodesic_coord = {0.0};
+            for (int i = 0; i < Y_init.rows()-1; i ++) {
+                init_geodesic_coord.push_back(init_geodesic_coord.back() + (Y_init.row(i+1) - Y_init.row(i)).norm());
+            }
+            blank_image = Mat::zeros(image.size(), CV_8UC3);
+            continue;
+        }
+
+        if (scored && time > start_record_at) {
+            pcl::PCLPointCloud2 cloud;
+            pcl_conversions::toPCL(*synced.cloud, cloud);
+            pcl::PointCloud<pcl::PointXYZRGB> cloud_xyz;
+            pcl::fromPCLPointCloud2(cloud, cloud_xyz);
+            MatrixXd gt_nodes = frame_evaluator.get_ground_truth_nodes(image, cloud_xyz);
+            if (gt_nodes.rows() >= 2) {
+                frame.Y_true = frame_evaluator.sort_pts(gt_nodes, head_node);
+                head_node = frame.Y_true.topRows(1);
+            }
+
+            if (time > start_record_at + wait_before_occlusion && frame.Y_true.rows() > 0) {
+                cv::Rect occlusion = frame_evaluator.occlusion_rect(frame.Y_true, proj_matrix, num_of_nodes, image.cols, image.rows);
+                frame.mask(occlusion & cv::Rect(0, 0, image.cols, image.rows)).setTo(0);
+            }
+        }
+
+        frames.push_back(frame);
+    }
+
+    if (Y_init.size() == 0) {
+        throw std::runtime_error("could not initialize the DLO from any frame of " + bag_dir);
+    }
+}
+
+// tracks every frame with one configuration
+sweep_result run_config (const sweep_config& config) {
+    trackdlo tracker(num_of_nodes, config.at("visibility_threshold"), config.at("beta"), config.at("lambda"), config.at("alpha"), config.at("k_vis"),
+                     config.at("mu"), static_cast<int>(config.at("max_iter")), config.at("tol"), config.at("beta_pre_proc"), config.at("lambda_pre_proc"),
+                     config.at("lle_weight"));
+    tracker.set_mixed_precision(mixed_precision);
+    tracker.set_fused_registration(fused_registration);
+    tracker.set_health_thresholds(sweep_health_thresholds);
+    tracker.initialize_nodes(Y_init);
+    tracker.initialize_geodesic_coord(init_geodesic_coord);
+    double leaf_size = config.at("downsample_leaf_size");
+    double visibility_threshold = config.at("visibility_threshold");
+    int dlo_pixel_width = static_cast<int>(config.at("dlo_pixel_width"));
+    double d_vis = config.at("d_vis");
+
+    // a diverged or lost run fails: its errors are meaningless (NaN would also never be dominated in the front)
+    sweep_result result;
+    auto fail = [&result](const std::string& message) {
+        result.failed = true;
+        result.error_message = message;
+        return result;
+    };
+
+    MatrixXd Y = Y_init;
+    std::vector<double> frame_times;
+    std::vector<double> errors;
+    for (const sweep_frame& frame : frames) {
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+        pcl::PointCloud<pcl::PointXYZRGB> cur_pc;
+        mask_to_point_cloud(frame.mask, frame.depth, blank_image, proj_matrix, cur_pc);
+        pcl::PointCloud<pcl::PointXYZRGB> cur_pc_downsampled;
+        pcl::VoxelGrid<pcl::PointXYZRGB> sor;
+        sor.setInputCloud(cur_pc.makeShared());
+        sor.setLeafSize(leaf_size, leaf_size, leaf_size);
+        sor.filter(cur_pc_downsampled);
+        MatrixXd X = cur_pc_downsampled.getMatrixXfMap().topRows(3).transpose().cast<double>();
+
+        std::vector<double> shortest_node_pt_dists(Y.rows(), 100000.0);
+        for (int m = 0; m < Y.rows(); m ++) {
+            for (int n = 0; n < X.rows(); n ++) {
+                shortest_node_pt_dists[m] = std::min(shortest_node_pt_dists[m], (Y.row(m) - X.row(n)).norm());
+            }
+        }
+        node_visibility visibility = compute_node_visibility(Y, proj_matrix, frame.depth, shortest_node_pt_dists, visibility_threshold, dlo_pixel_width);
+        std::vector<int> visible_nodes = {};
+        for (int i = 0; i < Y.rows(); i ++) {
+            if (visibility.visible[i]) {
+                visible_nodes.push_back(i);
+            }
+        }
+
+        // nothing of the DLO in view: hold the result
+        if (!visible_nodes.empty() && X.rows() > 0) {
+            tracker.tracking_step(X, visible_nodes, extend_visible_nodes(visible_nodes, init_geodesic_coord, d_vis), proj_matrix, frame.mask.rows, frame.mask.cols);
+            Y = tracker.get_tracking_result();
+            if (!Y.allFinite()) {
+                return fail("diverged at " + std::to_string(frame.time) + " s");
+            }
+            if (tracker.get_health().lost) {
+                return fail("tracking lost at " + std::to_string(frame.time) + " s");
+            }
+        }
+        frame_times.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count() / 1000.0);
+
+        if (frame.Y_true.rows() > 0) {
+            double error = frame_evaluator.compute_error(Y, frame.Y_true);
+            if (!std::isfinite(error)) {
+                return fail("non-finite error at " + std::to_string(frame.time) + " s");
+            }
+            errors.push_back(error);
+        }
+    }
+
+    result.scored_frames = errors.size();
+    for (double error : errors) {
+        result.mean_error += error / errors.size();
+        result.max_error = std::max(result.max_error, error);
+    }
+    for (double frame_time : frame_times) {
+        result.mean_frame_time += frame_time / frame_times.size();
+    }
+    if (!frame_times.empty()) {
+        std::sort(frame_times.begin(), frame_times.end());
+        result.p90_frame_time = frame_times[static_cast<int>(0.9 * (frame_times.size() - 1))];
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    ros::init(argc, argv, "sweep");
+    ros::NodeHandle nh;
+
+    nh.getParam("/sweep/bag_dir", bag_dir);
+    nh.getParam("/sweep/bag_file", bag_file);
+    nh.getParam("/sweep/rgb_topic", rgb_topic);
+    nh.getParam("/sweep/depth_topic", depth_topic);
+    nh.getParam("/sweep/pointcloud_topic", pointcloud_topic);
+    nh.getParam("/sweep/camera_info_topic", camera_info_topic);
+    nh.getParam("/sweep/num_of_nodes", num_of_nodes);
+    nh.getParam("/sweep/multi_color_dlo", multi_color_dlo);
+    nh.getParam("/sweep/hsv_threshold_upper_limit", hsv_threshold_upper_limit);
+    nh.getParam("/sweep/hsv_threshold_lower_limit", hsv_threshold_lower_limit);
+    nh.getParam("/sweep/pct_occlusion", pct_occlusion);
+    nh.getParam("/sweep/start_record_at", start_record_at);
+    nh.getParam("/sweep/exit_at", exit_at);
+    nh.getParam("/sweep/wait_before_occlusion", wait_before_occlusion);
+    nh.getParam("/sweep/frame_stride", frame_stride);
+    nh.getParam("/sweep/threads", threads);
+    nh.getParam("/sweep/mixed_precision", mixed_precision);
+    nh.getParam("/sweep/fused_registration", fused_registration);
+    nh.getParam("/sweep/output", output);
+    sweep_health_thresholds.min_visible_fraction = 0.05;
+    sweep_health_thresholds.max_mean_point_dist = 0.05;
+    sweep_health_thresholds.loss_frames = 5;
+    nh.getParam("/sweep/health_max_sigma2", sweep_health_thresholds.max_sigma2);
+    nh.getParam("/sweep/health_min_visible_fraction", sweep_health_thresholds.min_visible_fraction);
+    nh.getParam("/sweep/health_max_mean_point_dist", sweep_health_thresholds.max_mean_point_dist);
+    nh.getParam("/sweep/health_require_convergence", sweep_health_thresholds.require_convergence);
+    nh.getParam("/sweep/health_loss_frames", sweep_health_thresholds.loss_frames);
+    frame_stride = std::max(1, frame_stride);
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // every parameter not swept keeps its /sweep/<name> value, or its default
+    sweep_config base;
+    for (const std::pair<std::string, double>& param : tracker_params) {
+        base[param.first] = param.second;
+        nh.getParam("/sweep/" + param.first, base[param.first]);
+    }
+    XmlRpc::XmlRpcValue grid;
+    nh.getParam("/sweep/grid", grid);
+    std::vector<sweep_config> configs = expand_grid(base, grid);
+
+    frame_evaluator = evaluator(0, 0, pct_occlusion, "trackdlo", bag_file, "", start_record_at, exit_at, wait_before_occlusion, 1.0, num_of_nodes);
+
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    load_frames();
+    double load_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count() / 1000.0;
+    ROS_INFO_STREAM("loaded " + std::to_string(frames.size()) + " frames in " + std::to_string(load_time) + " s, running " + std::to_string(configs.size()) +
+                    " configurations on " + std::to_string(threads) + " threads");
+
+    // every worker takes the next configuration until none is left
+    // configurations left when the node is shut down keep this
+    sweep_result not_run;
+    not_run.failed = true;
+    not_run.error_message = "not run";
+    std::vector<sweep_result> results(configs.size(), not_run);
+    std::atomic<int> next_config(0);
+    std::atomic<int> finished_configs(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t ++) {
+        workers.push_back(std::thread([&]() {
+            for (int c = next_config ++; c < configs.size() && ros::ok(); c = next_config ++) {
+                try {
+                    results[c] = run_config(configs[c]);
+                }
+                catch (const std::exception& e) {
+                    results[c].error_message = e.what();
+                }
+                ROS_INFO_STREAM("configuration " + std::to_string(c) + (results[c].failed ? " failed: " + results[c].error_message : " done") +
+                                " (" + std::to_string(++ finished_configs) + "/" + std::to_string(configs.size()) + ")");
+            }
+        }));
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    // pareto-optimal: no other configuration is at least as accurate and as fast, and better in one of them
+    for (int i = 0; i < results.size(); i ++) {
+        if (results[i].failed) {
+            continue;
+        }
+        results[i].pareto_optimal = true;
+        for (int j = 0; j < results.size() && results[i].pareto_optimal; j ++) {
+            if (j == i || results[j].failed) {
+                continue;
+            }
+            if (results[j].mean_error <= results[i].mean_error && results[j].mean_frame_time <= results[i].mean_frame_time &&
+                (results[j].mean_error < results[i].mean_error || results[j].mean_frame_time < results[i].mean_frame_time)) {
+                results[i].pareto_optimal = false;
+            }
+        }
+    }
+
+    std::ofstream file(output);
+    for (const std::pair<std::string, double>& param : tracker_params) {
+        file << param.first << ",";
+    }
+    file << "mean_error_mm,max_error_mm,mean_frame_ms,p90_frame_ms,scored_frames,pareto_optimal,failure\n";
+    for (int c = 0; c < configs.size(); c ++) {
+        for (const std::pair<std::string, double>& param : tracker_params) {
+            file << configs[c].at(param.first) << ",";
+        }
+        const sweep_result& result = results[c];
+        file << result.mean_error * 1000 << "," << result.max_error * 1000 << "," << result.mean_frame_time << "," << result.p90_frame_time << ","
+             << result.scored_frames << "," << result.pareto_optimal << ",\"" << result.error_message << "\"\n";
+    }
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Cannot write " + output);
+    }
+
+    // the pareto front, fastest first
+    std::vector<int> front;
+    for (int c = 0; c < configs.size(); c ++) {
+        if (results[c].pareto_optimal) {
+            front.push_back(c);
+        }
+    }
+    std::sort(front.begin(), front.end(), [&](int a, int b) { return results[a].mean_frame_time < results[b].mean_frame_time; });
+    ROS_INFO_STREAM("wrote " + output + ", pareto-optimal configurations:");
+    for (int c : front) {
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(2) << "  " << results[c].mean_frame_time << " ms/frame, " << results[c].mean_error * 1000 << " mm:";
+        for (const std::pair<std::string, double>& param : tracker_params) {
+            if (grid.getType() == XmlRpc::XmlRpcValue::TypeStruct && grid.hasMember(param.first)) {
+                line << " " << param.first << " " << std::defaultfloat << configs[c].at(param.first);
+            }
+        }
+        ROS_INFO_STREAM(line.str());
+    }
+}
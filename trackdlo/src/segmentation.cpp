@@ -0,0 +1,134 @@
+#include "../include/segmentation.h"
+
+#include <stdexcept>
+
+using cv::Mat;
+
+// lower or upper bound of a range: a sequence of three numbers
+static cv::Scalar read_bound (const cv::FileNode& node, const std::string& what) {
+    if (!node.isSeq() || node.size() != 3) {
+        throw std::invalid_argument("Color profile: " + what + " must be a list of three numbers");
+    }
+    return cv::Scalar(static_cast<double>(node[0]), static_cast<double>(node[1]), static_cast<double>(node[2]));
+}
+
+std::vector<dlo_colors> load_color_profile (const std::string& path) {
+    cv::FileStorage profile(path, cv::FileStorage::READ);
+    if (!profile.isOpened()) {
+        throw std::invalid_argument("Could not open color profile " + path);
+    }
+
+    cv::FileNode dlos = profile["dlos"];
+    if (!dlos.isSeq() || dlos.size() == 0) {
+        throw std::invalid_argument("Color profile " + path + " does not list any DLO under 'dlos'");
+    }
+
+    std::vector<dlo_colors> result = {};
+    for (int i = 0; i < dlos.size(); i ++) {
+        dlo_colors dlo;
+        dlo.name = dlos[i]["name"].empty() ? "dlo_" + std::to_string(i) : static_cast<std::string>(dlos[i]["name"]);
+
+        cv::FileNode colors = dlos[i]["colors"];
+        if (!colors.isSeq() || colors.size() == 0) {
+            throw std::invalid_argument("Color profile: DLO " + dlo.name + " has no colors");
+        }
+        for (int j = 0; j < colors.size(); j ++) {
+            color_range range;
+            range.name = colors[j]["name"].empty() ? "color_" + std::to_string(j) : static_cast<std::string>(colors[j]["name"]);
+
+            std::string space = colors[j]["space"].empty() ? "hsv" : static_cast<std::string>(colors[j]["space"]);
+            if (space != "hsv" && space != "bgr") {
+                throw std::invalid_argument("Color profile: unknown color space " + space + " for " + dlo.name + "/" + range.name);
+            }
+            range.hsv = (space == "hsv");
+            range.lower = read_bound(colors[j]["lower"], dlo.name + "/" + range.name + " lower");
+            range.upper = read_bound(colors[j]["upper"], dlo.name + "/" + range.name + " upper");
+            dlo.ranges.push_back(range);
+        }
+        result.push_back(dlo);
+    }
+
+    return result;
+}
+
+// number of 64-bit words per class
+static const int words_per_class = (256 * 256 * 256) / 64;
+
+color_lut::color_lut () {
+    num_of_classes_ = 0;
+}
+
+color_lut::color_lut (const std::vector<std::vector<color_range>>& classes) {
+    num_of_classes_ = classes.size();
+    bits_.assign(num_of_classes_ * words_per_class, 0);
+
+    // one row holding all (G, R) combinations for every value of B
+    Mat bgr_row(1, 256 * 256, CV_8UC3);
+    Mat hsv_row, in_range;
+    for (int b = 0; b < 256; b ++) {
+        uchar* pixel = bgr_row.ptr<uchar>(0);
+        for (int i = 0; i < 256 * 256; i ++) {
+            pixel[3*i] = b;
+            pixel[3*i + 1] = i >> 8;
+            pixel[3*i + 2] = i & 255;
+        }
+        cv::cvtColor(bgr_row, hsv_row, cv::COLOR_BGR2HSV);
+
+        for (int k = 0; k < num_of_classes_; k ++) {
+            uint64_t* plane = bits_.data() + k * words_per_class;
+            for (const color_range& range : classes[k]) {
+                cv::inRange(range.hsv ? hsv_row : bgr_row, range.lower, range.upper, in_range);
+                const uchar* member = in_range.ptr<uchar>(0);
+                for (int i = 0; i < 256 * 256; i ++) {
+                    if (member[i] != 0) {
+                        uint32_t idx = (static_cast<uint32_t>(b) << 16) | i;
+                        plane[idx >> 6] |= uint64_t(1) << (idx & 63);
+                    }
+                }
+            }
+        }
+    }
+}
+
+int color_lut::num_of_classes () const {
+    return num_of_classes_;
+}
+
+void color_lut::classify (const Mat& bgr_image, Mat& mask, int k) const {
+    mask.create(bgr_image.rows, bgr_image.cols, CV_8U);
+    const uint64_t* plane = bits_.data() + k * words_per_class;
+
+    // one memory-bound pass: a table lookup per pixel, rows split across threads
+    cv::parallel_for_(cv::Range(0, bgr_image.rows), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i ++) {
+            const uchar* pixel = bgr_image.ptr<uchar>(i);
+            uchar* out = mask.ptr<uchar>(i);
+            for (int j = 0; j < bgr_image.cols; j ++) {
+                uint32_t idx = (static_cast<uint32_t>(pixel[3*j]) << 16) | (static_cast<uint32_t>(pixel[3*j + 1]) << 8) | pixel[3*j + 2];
+                out[j] = ((plane[idx >> 6] >> (idx & 63)) & 1) ? 255 : 0;
+            }
+        }
+    });
+}
+
+void color_lut::classify (const Mat& bgr_image, std::vector<Mat>& masks, const std::vector<int>& classes) const {
+    int num_of_masks = classes.size();
+    masks.resize(num_of_masks);
+    std::vector<const uint64_t*> planes(num_of_masks);
+    for (int k = 0; k < num_of_masks; k ++) {
+        masks[k].create(bgr_image.rows, bgr_image.cols, CV_8U);
+        planes[k] = bits_.data() + classes[k] * words_per_class;
+    }
+
+    cv::parallel_for_(cv::Range(0, bgr_image.rows), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i ++) {
+            const uchar* pixel = bgr_image.ptr<uchar>(i);
+            for (int j = 0; j < bgr_image.cols; j ++) {
+                uint32_t idx = (static_cast<uint32_t>(pixel[3*j]) << 16) | (static_cast<uint32_t>(pixel[3*j + 1]) << 8) | pixel[3*j + 2];
+                for (int k = 0; k < num_of_masks; k ++) {
+                    masks[k].ptr<uchar>(i)[j] = ((planes[k][idx >> 6] >> (idx & 63)) & 1) ? 255 : 0;
+                }
+            }
+        }
+    });
+}
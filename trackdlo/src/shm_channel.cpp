@@ -0,0 +1,80 @@
+#include "../include/shm_channel.h"
+
+#include <new>
+
+shm_result_writer::shm_result_writer (const std::string& name, int max_nodes, int num_of_slots) {
+    if (max_nodes <= 0 || num_of_slots <= 0) {
+        throw std::invalid_argument("shared-memory channel needs max_nodes and num_of_slots > 0");
+    }
+    name_ = name;
+    sequence_ = 0;
+
+    uint32_t slot_size = shm_slot_size(max_nodes);
+    size_ = sizeof(shm_channel_header) + static_cast<size_t>(num_of_slots) * slot_size;
+
+    // a channel left behind by a previous run is replaced, readers still mapping it keep the old memory
+    shm_unlink(name_.c_str());
+    int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create shared-memory channel " + name_);
+    }
+    if (ftruncate(fd, size_) != 0) {
+        close(fd);
+        shm_unlink(name_.c_str());
+        throw std::runtime_error("Cannot size shared-memory channel " + name_);
+    }
+    void* mem = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        shm_unlink(name_.c_str());
+        throw std::runtime_error("Cannot map shared-memory channel " + name_);
+    }
+    base_ = static_cast<uint8_t*>(mem);
+
+    // the memory starts zeroed; the magic is stored last so a reader never accepts a half-initialized header
+    for (int s = 0; s < num_of_slots; s ++) {
+        new (base_ + sizeof(shm_channel_header) + s * slot_size) shm_slot_header();
+    }
+    header_ = new (base_) shm_channel_header();
+    header_->version = shm_channel_version;
+    header_->max_nodes = max_nodes;
+    header_->num_of_slots = num_of_slots;
+    header_->slot_size = slot_size;
+    header_->latest.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = shm_channel_magic;
+}
+
+shm_result_writer::~shm_result_writer () {
+    munmap(base_, size_);
+    shm_unlink(name_.c_str());
+}
+
+void shm_result_writer::write (int64_t stamp, const double* nodes, const std::vector<bool>& visible, int num_of_nodes) {
+    sequence_ += 1;
+    uint32_t max_nodes = header_->max_nodes;
+    uint32_t num_of_written_nodes = std::min(static_cast<uint32_t>(std::max(num_of_nodes, 0)), max_nodes);
+
+    uint8_t* slot = base_ + sizeof(shm_channel_header) + ((sequence_ - 1) % header_->num_of_slots) * header_->slot_size;
+    shm_slot_header* slot_header = reinterpret_cast<shm_slot_header*>(slot);
+    double* slot_nodes = reinterpret_cast<double*>(slot + sizeof(shm_slot_header));
+    uint8_t* slot_visible = slot + sizeof(shm_slot_header) + max_nodes * 3 * sizeof(double);
+
+    // seqlock: odd while writing, the data stores may not move above the odd store
+    uint64_t lock = slot_header->lock.load(std::memory_order_relaxed);
+    slot_header->lock.store(lock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot_header->sequence = sequence_;
+    slot_header->stamp = stamp;
+    slot_header->num_of_nodes = num_of_written_nodes;
+    for (uint32_t i = 0; i < num_of_written_nodes; i ++) {
+        slot_nodes[3*i] = nodes[i];
+        slot_nodes[3*i + 1] = nodes[num_of_nodes + i];
+        slot_nodes[3*i + 2] = nodes[2*num_of_nodes + i];
+        slot_visible[i] = (i < visible.size()) ? visible[i] : 1;
+    }
+
+    slot_header->lock.store(lock + 2, std::memory_order_release);
+    header_->latest.store(sequence_, std::memory_order_release);
+}
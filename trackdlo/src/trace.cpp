@@ -0,0 +1,171 @@
+#include "../include/trace.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+std::atomic<bool> tracing_enabled(true);
+
+void set_tracing_enabled (bool enabled) {
+    tracing_enabled = enabled;
+}
+
+// events per thread, a power of two. at about 100 events per frame this holds the last 20 s at 30 fps
+static const uint64_t trace_capacity = 1 << 16;
+
+// the fields are atomics so that dump_trace can read a buffer while its thread keeps writing; every field is
+// written and read with relaxed ordering, the buffer's head publishes the event
+struct trace_event {
+    std::atomic<const char*> name;
+    std::atomic<int64_t> start;
+    std::atomic<int64_t> end;
+};
+
+struct trace_buffer {
+    int tid;
+    std::string thread_name;            // guarded by buffers_mutex
+    std::atomic<uint64_t> head;         // number of events ever recorded
+    std::unique_ptr<trace_event[]> events;
+    std::atomic<bool> thread_exited;
+};
+
+// every thread's buffer, created on the thread's first event. the buffers of exited threads are dropped when
+// the next thread registers
+static std::mutex buffers_mutex;
+static std::vector<std::shared_ptr<trace_buffer>> buffers;
+static int next_tid = 0;
+
+// marks the thread's buffer as exited when the thread ends
+struct trace_buffer_owner {
+    std::shared_ptr<trace_buffer> buffer;
+    ~trace_buffer_owner () {
+        if (buffer) {
+            buffer->thread_exited = true;
+        }
+    }
+};
+
+static trace_buffer& thread_buffer () {
+    thread_local trace_buffer_owner owner;
+    if (!owner.buffer) {
+        std::shared_ptr<trace_buffer> buffer = std::make_shared<trace_buffer>();
+        buffer->head = 0;
+        buffer->events.reset(new trace_event[trace_capacity]);
+        buffer->thread_exited = false;
+
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [](const std::shared_ptr<trace_buffer>& b) { return b->thread_exited.load(); }), buffers.end());
+        buffer->tid = next_tid ++;
+        buffer->thread_name = "thread " + std::to_string(buffer->tid);
+        buffers.push_back(buffer);
+        owner.buffer = buffer;
+    }
+    return *owner.buffer;
+}
+
+void record_trace_event (const char* name, int64_t start, int64_t end) {
+    trace_buffer& buffer = thread_buffer();
+    uint64_t pos = buffer.head.load(std::memory_order_relaxed);
+    trace_event& event = buffer.events[pos & (trace_capacity - 1)];
+    event.name.store(name, std::memory_order_relaxed);
+    event.start.store(start, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+    buffer.head.store(pos + 1, std::memory_order_release);
+}
+
+void set_trace_thread_name (const std::string& name) {
+    trace_buffer& buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    buffer.thread_name = name;
+}
+
+// quotes a name for JSON
+static std::string json_string (const std::string& value) {
+    std::string quoted = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+int dump_trace (const std::string& path, double window) {
+    struct copied_event {
+        const char* name;
+        int64_t start;
+        int64_t end;
+        int tid;
+    };
+
+    std::vector<std::shared_ptr<trace_buffer>> cur_buffers;
+    std::vector<std::string> thread_names;
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        cur_buffers = buffers;
+        for (const std::shared_ptr<trace_buffer>& buffer : cur_buffers) {
+            thread_names.push_back(buffer->thread_name);
+        }
+    }
+
+    int64_t window_start = trace_now() - static_cast<int64_t>(window * 1e9);
+    std::vector<copied_event> events;
+    for (const std::shared_ptr<trace_buffer>& buffer : cur_buffers) {
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = (head > trace_capacity) ? head - trace_capacity : 0;
+        std::vector<copied_event> buffer_events;
+        for (uint64_t pos = first; pos < head; pos ++) {
+            const trace_event& event = buffer->events[pos & (trace_capacity - 1)];
+            buffer_events.push_back({event.name.load(std::memory_order_relaxed), event.start.load(std::memory_order_relaxed), event.end.load(std::memory_order_relaxed), buffer->tid});
+        }
+
+        // events the thread may have overwritten while they were copied are dropped
+        uint64_t new_head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first_valid = (new_head + 1 > trace_capacity) ? new_head + 1 - trace_capacity : 0;
+        for (uint64_t pos = std::max(first, first_valid); pos < head; pos ++) {
+            const copied_event& event = buffer_events[pos - first];
+            if (event.end >= window_start) {
+                events.push_back(event);
+            }
+        }
+    }
+
+    int64_t origin = events.empty() ? 0 : events[0].start;
+    for (const copied_event& event : events) {
+        origin = std::min(origin, event.start);
+    }
+
+    // metadata naming the threads, then complete events with timestamps in microseconds
+    std::vector<std::string> entries;
+    for (int i = 0; i < cur_buffers.size(); i ++) {
+        entries.push_back("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " + std::to_string(cur_buffers[i]->tid) + ", \"args\": {\"name\": " + json_string(thread_names[i]) + "}}");
+    }
+    for (const copied_event& event : events) {
+        std::ostringstream entry;
+        entry << std::fixed << std::setprecision(3);
+        entry << "{\"name\": " << json_string(event.name) << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.tid
+              << ", \"ts\": " << (event.start - origin) / 1000.0 << ", \"dur\": " << (event.end - event.start) / 1000.0 << "}";
+        entries.push_back(entry.str());
+    }
+
+    std::ostringstream json;
+    json << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    for (int i = 0; i < entries.size(); i ++) {
+        json << entries[i] << (i + 1 < entries.size() ? ",\n" : "\n");
+    }
+    json << "]}\n";
+
+    std::ofstream file(path);
+    file << json.str();
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Cannot write trace " + path);
+    }
+    return events.size();
+}
@@ -1,5 +1,6 @@
 #include "../include/utils.h"
 #include "../include/trackdlo.h"
+#include "../include/trace.h"
 
 using Eigen::MatrixXd;
 using Eigen::RowVectorXd;
@@ -25,6 +26,10 @@ trackdlo::trackdlo(int num_of_nodes) {
     geodesic_coord_ = {};
     correspondence_priors_ = {};
     visibility_threshold_ = 0.02;
+    mixed_precision_ = true;
+    precision_validation_ = false;
+    fused_registration_ = true;
+    last_iterations_ = 0;
 }
 
 trackdlo::trackdlo(int num_of_nodes,
@@ -56,6 +61,10 @@ trackdlo::trackdlo(int num_of_nodes,
     tol_ = tol;
     geodesic_coord_ = {};
     correspondence_priors_ = {};
+    mixed_precision_ = true;
+    precision_validation_ = false;
+    fused_registration_ = true;
+    last_iterations_ = 0;
 }
 
 double trackdlo::get_sigma2 () {
@@ -71,7 +80,13 @@ MatrixXd trackdlo::get_guide_nodes () {
 }
 
 std::vector<MatrixXd> trackdlo::get_correspondence_pairs () {
-    return correspondence_priors_;
+    std::vector<MatrixXd> pairs = {};
+    for (int i = 0; i < correspondence_priors_.size(); i ++) {
+        MatrixXd pair(1, 4);
+        pair << correspondence_priors_.indices[i], correspondence_priors_.x[i], correspondence_priors_.y[i], correspondence_priors_.z[i];
+        pairs.push_back(pair);
+    }
+    return pairs;
 }
 
 void trackdlo::initialize_geodesic_coord (std::vector<double> geodesic_coord) {
@@ -89,6 +104,70 @@ void trackdlo::set_sigma2 (double sigma2) {
     sigma2_ = sigma2;
 }
 
+void trackdlo::set_mixed_precision (bool mixed_precision) {
+    mixed_precision_ = mixed_precision;
+}
+
+void trackdlo::set_precision_validation (bool precision_validation) {
+    precision_validation_ = precision_validation;
+}
+
+
+void trackdlo::set_fused_registration (bool fused_registration) {
+    fused_registration_ = fused_registration;
+}
+
+void trackdlo::set_health_thresholds (const health_thresholds& thresholds) {
+    health_thresholds_ = thresholds;
+}
+
+step_stats trackdlo::get_step_stats () {
+    return stats_;
+}
+
+tracking_health trackdlo::get_health () {
+    return health_;
+}
+
+void trackdlo::update_health (const MatrixXd& X_orig, int num_of_visible_nodes, bool converged) {
+    health_.converged = converged;
+    health_.sigma2 = sigma2_;
+    health_.visible_fraction = static_cast<double>(num_of_visible_nodes) / Y_.rows();
+
+    const health_thresholds& t = health_thresholds_;
+
+    // mean distance from every point to its closest node, a pass over all points, so only when it is checked
+    health_.mean_point_dist = -1;
+    if (t.max_mean_point_dist > 0) {
+        double dist_sum = 0;
+        for (int n = 0; n < X_orig.rows(); n ++) {
+            dist_sum += sqrt((Y_.rowwise() - X_orig.row(n)).rowwise().squaredNorm().minCoeff());
+        }
+        health_.mean_point_dist = (X_orig.rows() > 0) ? dist_sum / X_orig.rows() : 0;
+    }
+
+    health_.healthy = Y_.allFinite() && std::isfinite(sigma2_) &&
+                      (t.max_sigma2 <= 0 || sigma2_ <= t.max_sigma2) &&
+                      (t.min_visible_fraction <= 0 || health_.visible_fraction >= t.min_visible_fraction) &&
+                      (t.max_mean_point_dist <= 0 || health_.mean_point_dist <= t.max_mean_point_dist) &&
+                      (!t.require_convergence || converged);
+
+    health_.unhealthy_frames = health_.healthy ? 0 : health_.unhealthy_frames + 1;
+    health_.lost = health_.unhealthy_frames >= std::max(1, t.loss_frames);
+}
+
+void trackdlo::skip_step () {
+    // no registration ran, so there is nothing that failed to converge
+    stats_ = step_stats();
+    health_.converged = true;
+    health_.sigma2 = sigma2_;
+    health_.visible_fraction = 0;
+    health_.mean_point_dist = -1;
+    health_.healthy = false;
+    health_.unhealthy_frames += 1;
+    health_.lost = health_.unhealthy_frames >= std::max(1, health_thresholds_.loss_frames);
+}
+
 std::vector<int> trackdlo::get_nearest_indices (int k, int M, int idx) {
     std::vector<int> indices_arr;
     if (idx - k < 0) {
@@ -158,23 +237,7 @@ MatrixXd trackdlo::calc_LLE_weights (int k, MatrixXd X) {
     return W;
 }
 
-bool trackdlo::cpd_lle (MatrixXd X_orig,
-                        MatrixXd& Y,
-                        double& sigma2,
-                        double beta,
-                        double lambda,
-                        double lle_weight,
-                        double mu,
-                        int max_iter,
-                        double tol,
-                        bool include_lle,
-                        std::vector<MatrixXd> correspondence_priors,
-                        double alpha,
-                        std::vector<int> visible_nodes,
-                        double k_vis,
-                        double visibility_threshold) 
-{
-    // prune X
+MatrixXd trackdlo::prune_point_cloud (const MatrixXd& X_orig, const MatrixXd& Y) {
     MatrixXd X_temp = MatrixXd::Zero(X_orig.rows(), 3);
     int valid_pt_counter = 0;
     for (int i = 0; i < X_orig.rows(); i ++) {
@@ -192,7 +255,204 @@ bool trackdlo::cpd_lle (MatrixXd X_orig,
             valid_pt_counter += 1;
         }
     }
-    MatrixXd X = X_temp.topRows(valid_pt_counter);
+    return X_temp.topRows(valid_pt_counter);
+}
+
+// one pass over all point-node distances that prunes the point cloud for both registrations 
+// and records the closest node of every remaining point
+void trackdlo::prepare_shared_frame (const MatrixXd& X_orig, const std::vector<int>& visible_nodes_extended) {
+    int M = Y_.rows();
+    int N_orig = X_orig.rows();
+
+    // index of every node among the guide nodes, -1 if the node is not a guide node
+    std::vector<int> guide_index(M, -1);
+    for (int i = 0; i < visible_nodes_extended.size(); i ++) {
+        guide_index[visible_nodes_extended[i]] = i;
+    }
+
+    // the main registration only needs all distances for the visibility term
+    bool keep_diff_xy = visible_nodes_extended.size() != M && !visible_nodes_extended.empty() && k_vis_ != 0;
+
+    MatrixXd X_temp = MatrixXd::Zero(N_orig, 3);
+    MatrixXd X_guide_temp = MatrixXd::Zero(N_orig, 3);
+    MatrixXd diff_xy_temp;
+    if (keep_diff_xy) {
+        diff_xy_temp = MatrixXd::Zero(M, N_orig);
+    }
+    frame_.closest_nodes.clear();
+    frame_.closest_guide_nodes.clear();
+
+    Eigen::VectorXd dis_sq(M);
+    for (int n = 0; n < N_orig; n ++) {
+        double shortest_dis_sq = 100000;
+        double shortest_guide_dis_sq = 100000;
+        int closest_node = 0;
+        int closest_guide_node = 0;
+        for (int m = 0; m < M; m ++) {
+            dis_sq(m) = (Y_.row(m) - X_orig.row(n)).squaredNorm();
+            if (dis_sq(m) < shortest_dis_sq) {
+                shortest_dis_sq = dis_sq(m);
+                closest_node = m;
+            }
+            if (guide_index[m] != -1 && dis_sq(m) < shortest_guide_dis_sq) {
+                shortest_guide_dis_sq = dis_sq(m);
+                closest_guide_node = guide_index[m];
+            }
+        }
+
+        // same 0.1 m threshold as prune_point_cloud
+        if (shortest_dis_sq < 0.01) {
+            X_temp.row(frame_.closest_nodes.size()) = X_orig.row(n);
+            if (keep_diff_xy) {
+                diff_xy_temp.col(frame_.closest_nodes.size()) = dis_sq;
+            }
+            frame_.closest_nodes.push_back(closest_node);
+        }
+        if (shortest_guide_dis_sq < 0.01) {
+            X_guide_temp.row(frame_.closest_guide_nodes.size()) = X_orig.row(n);
+            frame_.closest_guide_nodes.push_back(closest_guide_node);
+        }
+    }
+
+    frame_.X = X_temp.topRows(frame_.closest_nodes.size());
+    frame_.X_guide = X_guide_temp.topRows(frame_.closest_guide_nodes.size());
+    if (keep_diff_xy) {
+        frame_.diff_xy = diff_xy_temp.leftCols(frame_.closest_nodes.size());
+    }
+    else {
+        frame_.diff_xy.resize(0, 0);
+    }
+}
+
+bool trackdlo::cpd_lle (MatrixXd X_orig,
+                        MatrixXd& Y,
+                        double& sigma2,
+                        double beta,
+                        double lambda,
+                        double lle_weight,
+                        double mu,
+                        int max_iter,
+                        double tol,
+                        bool include_lle,
+                        const node_priors& correspondence_priors,
+                        double alpha,
+                        std::vector<int> visible_nodes,
+                        double k_vis,
+                        double visibility_threshold) 
+{
+    // prune X
+    MatrixXd X = prune_point_cloud(X_orig, Y);
+
+    return cpd_lle_pruned(X, Y, sigma2, beta, lambda, lle_weight, mu, max_iter, tol, include_lle, 
+                          correspondence_priors, alpha, visible_nodes, k_vis, visibility_threshold, registration_seed());
+}
+
+bool trackdlo::cpd_lle_pruned (const MatrixXd& X,
+                               MatrixXd& Y,
+                               double& sigma2,
+                               double beta,
+                               double lambda,
+                               double lle_weight,
+                               double mu,
+                               int max_iter,
+                               double tol,
+                               bool include_lle,
+                               const node_priors& correspondence_priors,
+                               double alpha,
+                               const std::vector<int>& visible_nodes,
+                               double k_vis,
+                               double visibility_threshold,
+                               const registration_seed& seed)
+{
+    // the E-step runs in float unless mixed precision is turned off; the M-step is always solved in double
+    if (mixed_precision_) {
+        return cpd_lle_dispatch<float>(X, Y, sigma2, beta, lambda, lle_weight, mu, max_iter, tol, include_lle, 
+                                       correspondence_priors, alpha, visible_nodes, k_vis, visibility_threshold, seed);
+    }
+    else {
+        return cpd_lle_dispatch<double>(X, Y, sigma2, beta, lambda, lle_weight, mu, max_iter, tol, include_lle, 
+                                        correspondence_priors, alpha, visible_nodes, k_vis, visibility_threshold, seed);
+    }
+}
+
+// calls f with std::integral_constant<int, M> if M is one of the compile-time node counts
+template <int NodeCount, int... NodeCounts, typename Function>
+bool dispatch_fixed_node_count (int M, Function f) {
+    if (M == NodeCount) {
+        f(std::integral_constant<int, NodeCount>());
+        return true;
+    }
+    if constexpr (sizeof...(NodeCounts) > 0) {
+        return dispatch_fixed_node_count<NodeCounts...>(M, f);
+    }
+    else {
+        return false;
+    }
+}
+
+template <typename Scalar>
+bool trackdlo::cpd_lle_dispatch (const MatrixXd& X,
+                                 MatrixXd& Y,
+                                 double& sigma2,
+                                 double beta,
+                                 double lambda,
+                                 double lle_weight,
+                                 double mu,
+                                 int max_iter,
+                                 double tol,
+                                 bool include_lle,
+                                 const node_priors& correspondence_priors,
+                                 double alpha,
+                                 const std::vector<int>& visible_nodes,
+                                 double k_vis,
+                                 double visibility_threshold,
+                                 const registration_seed& seed)
+{
+    bool converged = false;
+
+#ifdef TRACKDLO_FIXED_NODE_COUNTS
+    // use the fixed-size specialization if this node count was compiled in
+    bool specialized = dispatch_fixed_node_count<TRACKDLO_FIXED_NODE_COUNTS>(Y.rows(), [&](auto node_count) {
+        converged = cpd_lle_impl<Scalar, decltype(node_count)::value>(X, Y, sigma2, beta, lambda, lle_weight, mu, max_iter, tol, include_lle, 
+                                                                     correspondence_priors, alpha, visible_nodes, k_vis, visibility_threshold, seed);
+    });
+    if (specialized) {
+        return converged;
+    }
+#endif
+
+    // dynamic-size fallback
+    converged = cpd_lle_impl<Scalar, Eigen::Dynamic>(X, Y, sigma2, beta, lambda, lle_weight, mu, max_iter, tol, include_lle, 
+                                                     correspondence_priors, alpha, visible_nodes, k_vis, visibility_threshold, seed);
+    return converged;
+}
+
+template <typename Scalar, int NodeCount>
+bool trackdlo::cpd_lle_impl (const MatrixXd& X,
+                             MatrixXd& Y,
+                             double& sigma2,
+                             double beta,
+                             double lambda,
+                             double lle_weight,
+                             double mu,
+                             int max_iter,
+                             double tol,
+                             bool include_lle,
+                             const node_priors& correspondence_priors,
+                             double alpha,
+                             const std::vector<int>& visible_nodes,
+                             double k_vis,
+                             double visibility_threshold,
+                             const registration_seed& seed) 
+{
+    // E-step quantities (distances and membership probabilities) use the Scalar type
+    using MatrixXs = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+    // M-step quantities are fixed-size (stack allocated) when NodeCount is known at compile time
+    using MatrixMM = Eigen::Matrix<double, NodeCount, NodeCount>;
+    using MatrixM3 = Eigen::Matrix<double, NodeCount, 3>;
+    using VectorM = Eigen::Matrix<double, NodeCount, 1>;
+
+    MatrixXs X_t = X.cast<Scalar>();
 
     bool converged = true;
 
@@ -200,22 +460,11 @@ bool trackdlo::cpd_lle (MatrixXd X_orig,
     int N = X.rows();
     int D = 3;
 
-    MatrixXd Y_0 = Y.replicate(1, 1);
+    MatrixM3 Y_0 = Y;
 
-    MatrixXd diff_yy = MatrixXd::Zero(M, M);
-    MatrixXd diff_yy_sqrt = MatrixXd::Zero(M, M);
-    for (int i = 0; i < M; i ++) {
-        for (int j = 0; j < M; j ++) {
-            diff_yy(i, j) = (Y_0.row(i) - Y_0.row(j)).squaredNorm();
-            diff_yy_sqrt(i, j) = (Y_0.row(i) - Y_0.row(j)).norm();
-        }
-    }
-
-    MatrixXd converted_node_dis = MatrixXd::Zero(M, M); // this is a M*M matrix in place of diff_sqrt
-    MatrixXd converted_node_dis_sq = MatrixXd::Zero(M, M);
+    MatrixMM converted_node_dis = MatrixMM::Zero(M, M); // this is a M*M matrix in place of diff_sqrt
     std::vector<double> converted_node_coord = {0.0};   // this is not squared
 
-    MatrixXd G = MatrixXd::Zero(M, M);
     double cur_sum = 0;
     for (int i = 0; i < M-1; i ++) {
         cur_sum += pt2pt_dis(Y_0.row(i+1), Y_0.row(i));
@@ -224,33 +473,30 @@ bool trackdlo::cpd_lle (MatrixXd X_orig,
 
     for (int i = 0; i < converted_node_coord.size(); i ++) {
         for (int j = 0; j < converted_node_coord.size(); j ++) {
-            converted_node_dis_sq(i, j) = pow(converted_node_coord[i] - converted_node_coord[j], 2);
-            converted_node_dis(i, j) = abs(converted_node_coord[i] - converted_node_coord[j]);
+            converted_node_dis(i, j) = fabs(converted_node_coord[i] - converted_node_coord[j]);
         }
     }
 
     // kernel matrix
-    G = 1/(2*beta * 2*beta) * (-sqrt(2)*converted_node_dis/beta).array().exp() * (2*converted_node_dis.array() + sqrt(2)*beta);
+    MatrixMM G = 1/(2*beta * 2*beta) * (-sqrt(2)*converted_node_dis/beta).array().exp() * (2*converted_node_dis.array() + sqrt(2)*beta);
 
     // get the LLE matrix
-    MatrixXd L = calc_LLE_weights(6, Y_0);
-    MatrixXd H = (MatrixXd::Identity(M, M) - L).transpose() * (MatrixXd::Identity(M, M) - L);
+    MatrixMM L = calc_LLE_weights(6, Y_0);
+    MatrixMM H = (MatrixMM::Identity(M, M) - L).transpose() * (MatrixMM::Identity(M, M) - L);
 
     // construct J
-    MatrixXd J = MatrixXd::Zero(M, M);
-    MatrixXd Y_extended = Y_0.replicate(1, 1);
+    MatrixMM J = MatrixMM::Zero(M, M);
+    MatrixM3 Y_extended = Y_0;
     if (correspondence_priors.size() != 0) {
         int num_of_correspondence_priors = correspondence_priors.size();
 
         for (int i = 0; i < num_of_correspondence_priors; i ++) {
-            MatrixXd temp = MatrixXd::Zero(1, 3);
-            int index = correspondence_priors[i](0, 0);
-            temp(0, 0) = correspondence_priors[i](0, 1);
-            temp(0, 1) = correspondence_priors[i](0, 2);
-            temp(0, 2) = correspondence_priors[i](0, 3);
+            int index = correspondence_priors.indices[i];
 
-            J.row(index) = MatrixXd::Identity(M, M).row(index);
-            Y_extended.row(index) = temp;
+            J(index, index) = 1.0;
+            Y_extended(index, 0) = correspondence_priors.x[i];
+            Y_extended(index, 1) = correspondence_priors.y[i];
+            Y_extended(index, 2) = correspondence_priors.z[i];
 
             // // enforce boundaries
             // if (i == 0 || i == num_of_correspondence_priors-1) {
@@ -259,175 +505,267 @@ bool trackdlo::cpd_lle (MatrixXd X_orig,
         }
     }
 
-    // diff_xy should be a (M * N) matrix
-    MatrixXd diff_xy = MatrixXd::Zero(M, N);
-    for (int i = 0; i < M; i ++) {
-        for (int j = 0; j < N; j ++) {
-            diff_xy(i, j) = (Y_0.row(i) - X.row(j)).squaredNorm();
-        }
-    }
+    // the full (M * N) distance matrix diff_xy is only needed for the visibility term and the initial sigma2 estimate
+    bool use_P_vis = visible_nodes.size() != M && !visible_nodes.empty() && k_vis != 0;
+    MatrixXs diff_xy;
+    MatrixXs Y_t;
+    std::vector<double> shortest_node_pt_dists(M, 0.0);
 
-    // initialize sigma2
-    if (sigma2 == 0) {
-        sigma2 = diff_xy.sum() / static_cast<double>(D * M * N);
-    }
+    // closest node of every point; found with a full search in the first iteration and 
+    // then carried over and refined with a local search along the chain
+    std::vector<int> max_p_nodes(N, 0);
+
+    // geodesic membership probabilities smaller than exp(-geodesic_band_limit) are left at zero,
+    // which truncates every column of P to a band around its closest node
+    const double geodesic_band_limit = 50.0;
 
+    last_iterations_ = 0;
     for (int it = 0; it < max_iter; it ++) {
+        TRACE_SCOPE("EM iteration");
+        last_iterations_ = it + 1;
+
+        MatrixXd P_d;
+        if (it == 0 && seed.first_P != nullptr) {
+            // the first E-step is known in advance
+            P_d = *seed.first_P;
+            max_p_nodes = *seed.closest_nodes;
+        }
+        else {
+            Y_t = Y.template cast<Scalar>();
 
-        // update diff_xy
-        std::map<int, double> shortest_node_pt_dists;
-        for (int m = 0; m < M; m ++) {
-            // for each node in Y, determine a point in X closest to it
-            // for P_vis calculations
-            double shortest_dist = 10000;
-            for (int n = 0; n < N; n ++) {
-                diff_xy(m, n) = (Y.row(m) - X.row(n)).squaredNorm();
-                double dist = (Y.row(m) - X.row(n)).norm();
-                if (dist < shortest_dist) {
-                    shortest_dist = dist;
+            // update diff_xy
+            bool full_diff_xy = use_P_vis || (it == 0 && sigma2 == 0);
+            if (full_diff_xy) {
+                if (it == 0 && seed.diff_xy != nullptr) {
+                    diff_xy = seed.diff_xy->template cast<Scalar>();
+                }
+                else {
+                    diff_xy = MatrixXs::Zero(M, N);
+                    for (int m = 0; m < M; m ++) {
+                        for (int n = 0; n < N; n ++) {
+                            diff_xy(m, n) = (Y_t.row(m) - X_t.row(n)).squaredNorm();
+                        }
+                    }
+                }
+                for (int m = 0; m < M; m ++) {
+                    // for each node in Y, determine a point in X closest to it
+                    // for P_vis calculations
+                    Scalar shortest_dist_sq = 10000;
+                    for (int n = 0; n < N; n ++) {
+                        if (diff_xy(m, n) < shortest_dist_sq) {
+                            shortest_dist_sq = diff_xy(m, n);
+                        }
+                    }
+                    double shortest_dist = sqrt(static_cast<double>(shortest_dist_sq));
+                    // if close enough to X, the node is visible
+                    if (shortest_dist <= visibility_threshold) {
+                        shortest_dist = 0;
+                    }
+                    shortest_node_pt_dists[m] = shortest_dist;
                 }
             }
-            // if close enough to X, the node is visible
-            if (shortest_dist <= visibility_threshold) {
-                shortest_dist = 0;
-            }
-            // push back the pair
-            shortest_node_pt_dists.insert(std::pair<int, double>(m, shortest_dist));
-        }
 
-        MatrixXd P = (-0.5 * diff_xy / sigma2).array().exp();
-        MatrixXd P_stored = P.replicate(1, 1);
-        double c = pow((2 * M_PI * sigma2), static_cast<double>(D)/2) * mu / (1 - mu) * static_cast<double>(M)/N;
-        P = P.array().rowwise() / (P.colwise().sum().array() + c);
+            // initialize sigma2
+            if (it == 0 && sigma2 == 0) {
+                sigma2 = static_cast<double>(diff_xy.sum()) / static_cast<double>(D * M * N);
+            }
 
-        // P matrix calculation based on geodesic distance
-        std::vector<int> max_p_nodes(P.cols(), 0);
-        MatrixXd pts_dis_sq_geodesic = MatrixXd::Zero(M, N);
+            // P matrix calculation based on geodesic distance
+            MatrixXs P = MatrixXs::Zero(M, N);
+            Scalar neg_half_inv_sigma2 = static_cast<Scalar>(-0.5 / sigma2);
+            Scalar band_dis_sq = static_cast<Scalar>(2 * sigma2 * geodesic_band_limit);
 
-        // loop through all points
-        for (int i = 0; i < N; i ++) {
-            
-            P.col(i).maxCoeff(&max_p_nodes[i]);
-            int max_p_node = max_p_nodes[i];
+            // loop through all points
+            for (int i = 0; i < N; i ++) {
 
-            int potential_2nd_max_p_node_1 = max_p_node - 1;
-            if (potential_2nd_max_p_node_1 == -1) {
-                potential_2nd_max_p_node_1 = 2;
-            }
+                // the node with the largest euclidean membership probability is the closest node
+                int max_p_node;
+                Scalar max_p_node_dis_sq;
+                if (full_diff_xy) {
+                    max_p_node_dis_sq = diff_xy.col(i).minCoeff(&max_p_node);
+                }
+                else if (it == 0 && seed.closest_nodes != nullptr) {
+                    max_p_node = (*seed.closest_nodes)[i];
+                    max_p_node_dis_sq = (Y_t.row(max_p_node) - X_t.row(i)).squaredNorm();
+                }
+                else if (it == 0) {
+                    max_p_node = 0;
+                    max_p_node_dis_sq = (Y_t.row(0) - X_t.row(i)).squaredNorm();
+                    for (int m = 1; m < M; m ++) {
+                        Scalar dis_sq = (Y_t.row(m) - X_t.row(i)).squaredNorm();
+                        if (dis_sq < max_p_node_dis_sq) {
+                            max_p_node_dis_sq = dis_sq;
+                            max_p_node = m;
+                        }
+                    }
+                }
+                else {
+                    // nodes move little between iterations, so walk along the chain from last iteration's closest node
+                    max_p_node = max_p_nodes[i];
+                    max_p_node_dis_sq = (Y_t.row(max_p_node) - X_t.row(i)).squaredNorm();
+                    while (true) {
+                        int best_neighbor = max_p_node;
+                        Scalar best_neighbor_dis_sq = max_p_node_dis_sq;
+                        if (max_p_node > 0) {
+                            Scalar dis_sq = (Y_t.row(max_p_node-1) - X_t.row(i)).squaredNorm();
+                            if (dis_sq < best_neighbor_dis_sq) {
+                                best_neighbor = max_p_node - 1;
+                                best_neighbor_dis_sq = dis_sq;
+                            }
+                        }
+                        if (max_p_node < M-1) {
+                            Scalar dis_sq = (Y_t.row(max_p_node+1) - X_t.row(i)).squaredNorm();
+                            if (dis_sq < best_neighbor_dis_sq) {
+                                best_neighbor = max_p_node + 1;
+                                best_neighbor_dis_sq = dis_sq;
+                            }
+                        }
+                        if (best_neighbor == max_p_node) {
+                            break;
+                        }
+                        max_p_node = best_neighbor;
+                        max_p_node_dis_sq = best_neighbor_dis_sq;
+                    }
+                }
+                max_p_nodes[i] = max_p_node;
 
-            int potential_2nd_max_p_node_2 = max_p_node + 1;
-            if (potential_2nd_max_p_node_2 == M) {
-                potential_2nd_max_p_node_2 = M - 3;
-            }
+                int potential_2nd_max_p_node_1 = max_p_node - 1;
+                if (potential_2nd_max_p_node_1 == -1) {
+                    potential_2nd_max_p_node_1 = 2;
+                }
 
-            int next_max_p_node;
-            if (pt2pt_dis(Y.row(potential_2nd_max_p_node_1), X.row(i)) < pt2pt_dis(Y.row(potential_2nd_max_p_node_2), X.row(i))) {
-                next_max_p_node = potential_2nd_max_p_node_1;
-            } 
-            else {
-                next_max_p_node = potential_2nd_max_p_node_2;
-            }
+                int potential_2nd_max_p_node_2 = max_p_node + 1;
+                if (potential_2nd_max_p_node_2 == M) {
+                    potential_2nd_max_p_node_2 = M - 3;
+                }
 
-            // fill the current column of pts_dis_sq_geodesic
-            pts_dis_sq_geodesic(max_p_node, i) = pt2pt_dis_sq(Y.row(max_p_node), X.row(i));
-            pts_dis_sq_geodesic(next_max_p_node, i) = pt2pt_dis_sq(Y.row(next_max_p_node), X.row(i));
+                Scalar potential_dis_sq_1 = (Y_t.row(potential_2nd_max_p_node_1) - X_t.row(i)).squaredNorm();
+                Scalar potential_dis_sq_2 = (Y_t.row(potential_2nd_max_p_node_2) - X_t.row(i)).squaredNorm();
 
-            if (max_p_node < next_max_p_node) {
-                for (int j = 0; j < max_p_node; j ++) {
-                    pts_dis_sq_geodesic(j, i) = pow(abs(converted_node_coord[j] - converted_node_coord[max_p_node]) + pt2pt_dis(Y.row(max_p_node), X.row(i)), 2);
+                int next_max_p_node;
+                Scalar next_max_p_node_dis_sq;
+                if (potential_dis_sq_1 < potential_dis_sq_2) {
+                    next_max_p_node = potential_2nd_max_p_node_1;
+                    next_max_p_node_dis_sq = potential_dis_sq_1;
+                } 
+                else {
+                    next_max_p_node = potential_2nd_max_p_node_2;
+                    next_max_p_node_dis_sq = potential_dis_sq_2;
                 }
-                for (int j = next_max_p_node; j < M; j ++) {
-                    pts_dis_sq_geodesic(j, i) = pow(abs(converted_node_coord[j] - converted_node_coord[next_max_p_node]) + pt2pt_dis(Y.row(next_max_p_node), X.row(i)), 2);
+
+                // fill the current column of P: the geodesic distance from the point to node j is its distance to the
+                // closer of the two anchor nodes plus the arc length between that anchor and node j
+                P(max_p_node, i) = exp(neg_half_inv_sigma2 * max_p_node_dis_sq);
+                P(next_max_p_node, i) = exp(neg_half_inv_sigma2 * next_max_p_node_dis_sq);
+
+                int head_anchor = std::min(max_p_node, next_max_p_node);
+                int tail_anchor = std::max(max_p_node, next_max_p_node);
+                Scalar head_anchor_dis = sqrt(head_anchor == max_p_node ? max_p_node_dis_sq : next_max_p_node_dis_sq);
+                Scalar tail_anchor_dis = sqrt(tail_anchor == max_p_node ? max_p_node_dis_sq : next_max_p_node_dis_sq);
+
+                for (int j = head_anchor - 1; j >= 0; j --) {
+                    Scalar geodesic_dis = static_cast<Scalar>(converted_node_coord[head_anchor] - converted_node_coord[j]) + head_anchor_dis;
+                    if (geodesic_dis * geodesic_dis > band_dis_sq) {
+                        break;
+                    }
+                    P(j, i) = exp(neg_half_inv_sigma2 * geodesic_dis * geodesic_dis);
                 }
-            }
-            else {
-                for (int j = 0; j < next_max_p_node; j ++) {
-                    pts_dis_sq_geodesic(j, i) = pow(abs(converted_node_coord[j] - converted_node_coord[next_max_p_node]) + pt2pt_dis(Y.row(next_max_p_node), X.row(i)), 2);
+                for (int j = tail_anchor + 1; j < M; j ++) {
+                    Scalar geodesic_dis = static_cast<Scalar>(converted_node_coord[j] - converted_node_coord[tail_anchor]) + tail_anchor_dis;
+                    if (geodesic_dis * geodesic_dis > band_dis_sq) {
+                        break;
+                    }
+                    P(j, i) = exp(neg_half_inv_sigma2 * geodesic_dis * geodesic_dis);
                 }
-                for (int j = max_p_node; j < M; j ++) {
-                    pts_dis_sq_geodesic(j, i) = pow(abs(converted_node_coord[j] - converted_node_coord[max_p_node]) + pt2pt_dis(Y.row(max_p_node), X.row(i)), 2);
+                // only reached when the two anchors are not adjacent (closest node at either end of the chain)
+                for (int j = head_anchor + 1; j < tail_anchor; j ++) {
+                    Scalar geodesic_dis = static_cast<Scalar>(converted_node_coord[j] - converted_node_coord[head_anchor]) + head_anchor_dis;
+                    P(j, i) = exp(neg_half_inv_sigma2 * geodesic_dis * geodesic_dis);
                 }
             }
-        }
 
-        // update P
-        P = (-0.5 * pts_dis_sq_geodesic / sigma2).array().exp();
+            double c = pow((2 * M_PI * sigma2), static_cast<double>(D)/2) * mu / (1 - mu) * static_cast<double>(M)/N;
 
-        
-        // modified membership probability (adapted from cdcpd)
-        if (visible_nodes.size() != Y.rows() && !visible_nodes.empty() && k_vis != 0) {
-            MatrixXd P_vis = MatrixXd::Ones(P.rows(), P.cols());
-            double total_P_vis = 0;
+            // modified membership probability (adapted from cdcpd)
+            if (use_P_vis) {
+                MatrixXs P_vis = MatrixXs::Ones(P.rows(), P.cols());
+                double total_P_vis = 0;
 
-            for (int i = 0; i < Y.rows(); i ++) {
-                double shortest_node_pt_dist = shortest_node_pt_dists[i];
+                for (int i = 0; i < Y.rows(); i ++) {
+                    double shortest_node_pt_dist = shortest_node_pt_dists[i];
 
-                double P_vis_i = exp(-k_vis * shortest_node_pt_dist);
-                total_P_vis += P_vis_i;
+                    double P_vis_i = exp(-k_vis * shortest_node_pt_dist);
+                    total_P_vis += P_vis_i;
 
-                P_vis.row(i) = P_vis_i * P_vis.row(i);
-            }
+                    P_vis.row(i) = static_cast<Scalar>(P_vis_i) * P_vis.row(i);
+                }
 
-            // normalize P_vis
-            P_vis = P_vis / total_P_vis;
+                // normalize P_vis
+                P_vis = P_vis / static_cast<Scalar>(total_P_vis);
 
-            // modify P
-            P = P.cwiseProduct(P_vis);
+                // modify P
+                P = P.cwiseProduct(P_vis);
+
+                // modify c
+                c = pow((2 * M_PI * sigma2), static_cast<double>(D)/2) * mu / (1 - mu) / N;
+                P = P.array().rowwise() / (P.colwise().sum().array() + static_cast<Scalar>(c));
+            }
+            else {
+                P = P.array().rowwise() / (P.colwise().sum().array() + static_cast<Scalar>(c));
+            }
 
-            // modify c
-            c = pow((2 * M_PI * sigma2), static_cast<double>(D)/2) * mu / (1 - mu) / N;
-            P = P.array().rowwise() / (P.colwise().sum().array() + c);
+            // hand P over to the M-step in double so that the trace terms in the sigma2 update
+            // (which nearly cancel each other) are accumulated consistently
+            P_d = P.template cast<double>();
         }
-        else {
-            P = P.array().rowwise() / (P.colwise().sum().array() + c);
+        if (it == 0 && seed.first_P_out != nullptr) {
+            *seed.first_P_out = P_d;
         }
 
-
-        MatrixXd Pt1 = P.colwise().sum();
-        MatrixXd P1 = P.rowwise().sum();
+        MatrixXd Pt1 = P_d.colwise().sum();
+        VectorM P1 = P_d.rowwise().sum();
         double Np = P1.sum();
-        MatrixXd PX = P * X;
+        MatrixM3 PX = P_d * X;
 
         // M step
-        MatrixXd A_matrix;
-        MatrixXd B_matrix;
+        MatrixMM A_matrix;
+        MatrixM3 B_matrix;
         if (include_lle) {
             if (correspondence_priors.size() != 0) {
-                A_matrix = P1.asDiagonal()*G + lambda*sigma2 * MatrixXd::Identity(M, M) + sigma2*lle_weight * H*G + alpha*J*G;
+                A_matrix = P1.asDiagonal()*G + lambda*sigma2 * MatrixMM::Identity(M, M) + sigma2*lle_weight * H*G + alpha*J*G;
                 B_matrix = PX - P1.asDiagonal()*Y_0 - sigma2*lle_weight * H*Y_0 + alpha*(Y_extended - Y_0);
             }
             else {
-                A_matrix = P1.asDiagonal()*G + lambda*sigma2 * MatrixXd::Identity(M, M) + sigma2*lle_weight * H*G;
+                A_matrix = P1.asDiagonal()*G + lambda*sigma2 * MatrixMM::Identity(M, M) + sigma2*lle_weight * H*G;
                 B_matrix = PX - P1.asDiagonal()*Y_0 - sigma2*lle_weight * H*Y_0;
             }
         }
         else {
             if (correspondence_priors.size() != 0) {
-                A_matrix = P1.asDiagonal() * G + lambda * sigma2 * MatrixXd::Identity(M, M) + alpha*J*G;
+                A_matrix = P1.asDiagonal() * G + lambda * sigma2 * MatrixMM::Identity(M, M) + alpha*J*G;
                 B_matrix = PX - P1.asDiagonal() * Y_0 + alpha*(Y_extended - Y_0);
             }
             else {
-                A_matrix = P1.asDiagonal() * G + lambda * sigma2 * MatrixXd::Identity(M, M);
+                A_matrix = P1.asDiagonal() * G + lambda * sigma2 * MatrixMM::Identity(M, M);
                 B_matrix = PX - P1.asDiagonal() * Y_0;
             }
         }
 
-        MatrixXd W = A_matrix.completeOrthogonalDecomposition().solve(B_matrix);
+        MatrixM3 W = A_matrix.completeOrthogonalDecomposition().solve(B_matrix);
 
-        MatrixXd T = Y_0 + G * W;
+        MatrixM3 T = Y_0 + G * W;
         double trXtdPt1X = (X.transpose() * Pt1.asDiagonal() * X).trace();
         double trPXtT = (PX.transpose() * T).trace();
         double trTtdP1T = (T.transpose() * P1.asDiagonal() * T).trace();
 
         sigma2 = (trXtdPt1X - 2*trPXtT + trTtdP1T) / (Np * D);
 
-        if (pt2pt_dis(Y, Y_0 + G*W) / Y.rows() < tol) {
-            Y = Y_0 + G*W;
-            ROS_INFO_STREAM("Iteration until convergence: " + std::to_string(it+1));
+        if (pt2pt_dis(Y, T) / Y.rows() < tol) {
+            Y = T;
             break;
         }
         else {
-            Y = Y_0 + G*W;
+            Y = T;
         }
 
         if (it == max_iter - 1) {
@@ -440,461 +778,107 @@ bool trackdlo::cpd_lle (MatrixXd X_orig,
     return converged;
 }
 
-// alignment: 0 --> align with head; 1 --> align with tail
-std::vector<MatrixXd> trackdlo::traverse_geodesic (std::vector<double> geodesic_coord, const MatrixXd guide_nodes, const std::vector<int> visible_nodes, int alignment) {
-    std::vector<MatrixXd> node_pairs = {};
-
-    // extreme cases: only one guide node available
-    // since this function will only be called when at least one of head or tail is visible, 
-    // the only node will be head or tail
-    if (guide_nodes.rows() == 1) {
-        MatrixXd node_pair(1, 4);
-        node_pair << visible_nodes[0], guide_nodes(0, 0), guide_nodes(0, 1), guide_nodes(0, 2);
-        node_pairs.push_back(node_pair);
-        return node_pairs;
-    }
-
-    double guide_nodes_total_dist = 0;
-    double total_seg_dist = 0;
-    
-    if (alignment == 0) {
-        // push back the first pair
-        MatrixXd node_pair(1, 4);
-        node_pair << visible_nodes[0], guide_nodes(0, 0), guide_nodes(0, 1), guide_nodes(0, 2);
-        node_pairs.push_back(node_pair);
-
-        // initialize iterators
-        int guide_nodes_it = 0;
-        int seg_dist_it = 0;
-        int last_seg_dist_it = seg_dist_it;
-
-        // ultimate terminating condition: run out of guide nodes to use. two conditions that can trigger this:
-        //   1. next visible node index - current visible node index > 1
-        //   2. currenting using the last two guide nodes
-        while (visible_nodes[guide_nodes_it+1] - visible_nodes[guide_nodes_it] == 1 && guide_nodes_it+1 <= guide_nodes.rows()-1 && seg_dist_it+1 <= geodesic_coord.size()-1) {
-            guide_nodes_total_dist += pt2pt_dis(guide_nodes.row(guide_nodes_it), guide_nodes.row(guide_nodes_it+1));
-            // now keep adding segment dists until the total seg dists exceed the current total guide node dists
-            while (guide_nodes_total_dist > total_seg_dist) {
-                // break condition
-                if (seg_dist_it == geodesic_coord.size()-1) {
-                    break;
-                }
-
-                total_seg_dist += fabs(geodesic_coord[seg_dist_it] - geodesic_coord[seg_dist_it+1]);
-                if (total_seg_dist <= guide_nodes_total_dist) {
-                    seg_dist_it += 1;
-                }
-                else {
-                    total_seg_dist -= fabs(geodesic_coord[seg_dist_it] - geodesic_coord[seg_dist_it+1]);
-                    break;
-                }
-            }
-            // additional break condition
-            if (seg_dist_it == geodesic_coord.size()-1) {
-                break;
-            }
-            // upon exit, seg_dist_it will be at the locaiton where the total seg dist is barely smaller than guide nodes total dist
-            // the node desired should be in between guide_nodes[guide_nodes_it] and guide_node[guide_nodes_it + 1]
-            // seg_dist_it will also be within guide_nodes_it and guide_nodes_it + 1
-            if (guide_nodes_it == 0 && seg_dist_it == 0) {
-                continue;
-            }
-            // if one guide nodes segment is not long enough
-            if (last_seg_dist_it == seg_dist_it) {
-                guide_nodes_it += 1;
-                continue;
-            }
-            double remaining_dist = total_seg_dist - (guide_nodes_total_dist - pt2pt_dis(guide_nodes.row(guide_nodes_it), guide_nodes.row(guide_nodes_it+1)));
-            MatrixXd temp = (guide_nodes.row(guide_nodes_it + 1) - guide_nodes.row(guide_nodes_it)) * remaining_dist / pt2pt_dis(guide_nodes.row(guide_nodes_it), guide_nodes.row(guide_nodes_it+1));
-            node_pair(0, 0) = seg_dist_it;
-            node_pair(0, 1) = temp(0, 0) + guide_nodes(guide_nodes_it, 0);
-            node_pair(0, 2) = temp(0, 1) + guide_nodes(guide_nodes_it, 1);
-            node_pair(0, 3) = temp(0, 2) + guide_nodes(guide_nodes_it, 2);
-            node_pairs.push_back(node_pair);
-
-            // update guide_nodes_it at the very end
-            guide_nodes_it += 1;
-            last_seg_dist_it = seg_dist_it;
-        }
-    }
-    else {
-        // push back the first pair
-        MatrixXd node_pair(1, 4);
-        node_pair << visible_nodes.back(), guide_nodes(guide_nodes.rows()-1, 0), guide_nodes(guide_nodes.rows()-1, 1), guide_nodes(guide_nodes.rows()-1, 2);
-        node_pairs.push_back(node_pair);
-
-        // initialize iterators
-        int guide_nodes_it = guide_nodes.rows()-1;
-        int seg_dist_it = geodesic_coord.size()-1;
-        int last_seg_dist_it = seg_dist_it;
-
-        // ultimate terminating condition: run out of guide nodes to use. two conditions that can trigger this:
-        //   1. next visible node index - current visible node index > 1
-        //   2. currenting using the last two guide nodes
-        while (visible_nodes[guide_nodes_it] - visible_nodes[guide_nodes_it-1] == 1 && guide_nodes_it-1 >= 0 && seg_dist_it-1 >= 0) {
-            guide_nodes_total_dist += pt2pt_dis(guide_nodes.row(guide_nodes_it), guide_nodes.row(guide_nodes_it-1));
-            // now keep adding segment dists until the total seg dists exceed the current total guide node dists
-            while (guide_nodes_total_dist > total_seg_dist) {
-                // break condition
-                if (seg_dist_it == 0) {
-                    break;
-                }
+void trackdlo::reset_priors () {
+    int M = Y_.rows();
 
-                total_seg_dist += fabs(geodesic_coord[seg_dist_it] - geodesic_coord[seg_dist_it-1]);
-                if (total_seg_dist <= guide_nodes_total_dist) {
-                    seg_dist_it -= 1;
-                }
-                else {
-                    total_seg_dist -= fabs(geodesic_coord[seg_dist_it] - geodesic_coord[seg_dist_it-1]);
-                    break;
-                }
-            }
-            // additional break condition
-            if (seg_dist_it == 0) {
-                break;
-            }
-            // upon exit, seg_dist_it will be at the locaiton where the total seg dist is barely smaller than guide nodes total dist
-            // the node desired should be in between guide_nodes[guide_nodes_it] and guide_node[guide_nodes_it + 1]
-            // seg_dist_it will also be within guide_nodes_it and guide_nodes_it + 1
-            if (guide_nodes_it == 0 && seg_dist_it == 0) {
-                continue;
-            }
-            // if one guide nodes segment is not long enough
-            if (last_seg_dist_it == seg_dist_it) {
-                guide_nodes_it -= 1;
-                continue;
-            }
-            double remaining_dist = total_seg_dist - (guide_nodes_total_dist - pt2pt_dis(guide_nodes.row(guide_nodes_it), guide_nodes.row(guide_nodes_it-1)));
-            MatrixXd temp = (guide_nodes.row(guide_nodes_it - 1) - guide_nodes.row(guide_nodes_it)) * remaining_dist / pt2pt_dis(guide_nodes.row(guide_nodes_it), guide_nodes.row(guide_nodes_it-1));
-            node_pair(0, 0) = seg_dist_it;
-            node_pair(0, 1) = temp(0, 0) + guide_nodes(guide_nodes_it, 0);
-            node_pair(0, 2) = temp(0, 1) + guide_nodes(guide_nodes_it, 1);
-            node_pair(0, 3) = temp(0, 2) + guide_nodes(guide_nodes_it, 2);
-            node_pairs.insert(node_pairs.begin(), node_pair);
+    correspondence_priors_.clear();
+    prior_sum_ = MatrixXd::Zero(M, 3);
+    prior_count_.assign(M, 0);
 
-            // update guide_nodes_it at the very end
-            guide_nodes_it -= 1;
-            last_seg_dist_it = seg_dist_it;
-        }
+    // cumulative arc length along the guide nodes
+    guide_arc_.assign(guide_nodes_.rows(), 0.0);
+    for (int i = 1; i < guide_nodes_.rows(); i ++) {
+        guide_arc_[i] = guide_arc_[i-1] + pt2pt_dis(guide_nodes_.row(i), guide_nodes_.row(i-1));
     }
-
-    return node_pairs;
 }
 
-std::vector<MatrixXd> trackdlo::traverse_euclidean (std::vector<double> geodesic_coord, const MatrixXd guide_nodes, const std::vector<int> visible_nodes, int alignment, int alignment_node_idx) {
-    std::vector<MatrixXd> node_pairs = {};
-
-    // extreme cases: only one guide node available
-    // since this function will only be called when at least one of head or tail is visible, 
-    // the only node will be head or tail
-    if (guide_nodes.rows() == 1) {
-        MatrixXd node_pair(1, 4);
-        node_pair << visible_nodes[0], guide_nodes(0, 0), guide_nodes(0, 1), guide_nodes(0, 2);
-        node_pairs.push_back(node_pair);
-        return node_pairs;
+// basically pure pursuit: starting from guide node start, every step places the next node (in direction +1 or -1)
+// on the guide node chain at a euclidean distance from the previous prior equal to the geodesic distance between them
+void trackdlo::march_priors (const std::vector<int>& visible_nodes, int start, int direction) {
+    TRACE_SCOPE("march_priors");
+    int num_of_guide_nodes = visible_nodes.size();
+    int M = geodesic_coord_.size();
+
+    // the chain only extends over guide nodes that are consecutive nodes of Y
+    int end = start;
+    while (end+direction >= 0 && end+direction < num_of_guide_nodes && visible_nodes[end+direction] - visible_nodes[end] == direction) {
+        end += direction;
     }
 
-    if (alignment == 0) {
-        // push back the first pair
-        MatrixXd node_pair(1, 4);
-        node_pair << visible_nodes[0], guide_nodes(0, 0), guide_nodes(0, 1), guide_nodes(0, 2);
-        node_pairs.push_back(node_pair);
-
-        std::vector<int> consecutive_visible_nodes = {};
-        for (int i = 0; i < visible_nodes.size(); i ++) {
-            if (i == visible_nodes[i]) {
-                consecutive_visible_nodes.push_back(i);
+    int node = visible_nodes[start];
+    Eigen::Vector3d center = guide_nodes_.row(start).transpose();
+    prior_sum_.row(node) += center.transpose();
+    prior_count_[node] += 1;
+
+    // arc length from the start of the chain to guide node start + k*direction
+    auto chain_arc = [&](int k) {
+        return fabs(guide_arc_[start + k*direction] - guide_arc_[start]);
+    };
+
+    // the current center lies on the k-th segment of the chain, at arc length center_arc
+    int k_center = 0;
+    double center_arc = 0;
+    int num_of_segs = abs(end - start);
+
+    while (node+direction >= 0 && node+direction < M && k_center < num_of_segs) {
+        double radius = fabs(geodesic_coord_[node+direction] - geodesic_coord_[node]);
+
+        // the chain cannot leave the sphere before arc length center_arc + radius (arc >= chord),
+        // so binary search for the segment containing that arc length and start from there
+        double target_arc = center_arc + radius;
+        int lo = k_center;
+        int hi = num_of_segs - 1;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if (chain_arc(mid) <= target_arc) {
+                lo = mid;
             }
             else {
-                break;
+                hi = mid - 1;
             }
         }
 
-        int last_found_index = 0;
-        int seg_dist_it = 0;
-        MatrixXd cur_center = guide_nodes.row(0);
-
-        // basically pure pursuit
-        while (last_found_index+1 <= consecutive_visible_nodes.size()-1 && seg_dist_it+1 <= geodesic_coord.size()-1) {
-            double look_ahead_dist = fabs(geodesic_coord[seg_dist_it+1] - geodesic_coord[seg_dist_it]);
-            bool found_intersection = false;
-            std::vector<double> intersection = {};
-
-            for (int i = last_found_index; i+1 <= consecutive_visible_nodes.size()-1; i ++) {
-                std::vector<MatrixXd> intersections = line_sphere_intersection(guide_nodes.row(i), guide_nodes.row(i+1), cur_center, look_ahead_dist);
-
-                // if no intersection found
-                if (intersections.size() == 0) {
-                    continue;
-                }
-                else if (intersections.size() == 1 && pt2pt_dis(intersections[0], guide_nodes.row(i+1)) > pt2pt_dis(cur_center, guide_nodes.row(i+1))) {
-                    continue;
-                }
-                else {
-                    found_intersection = true;
-                    last_found_index = i;
-
-                    if (intersections.size() == 2) {
-                        if (pt2pt_dis(intersections[0], guide_nodes.row(i+1)) <= pt2pt_dis(intersections[1], guide_nodes.row(i+1))) {
-                            // the first solution is closer
-                            intersection = {intersections[0](0, 0), intersections[0](0, 1), intersections[0](0, 2)};
-                            cur_center = intersections[0];
-                        }
-                        else {
-                            // the second one is closer
-                            intersection = {intersections[1](0, 0), intersections[1](0, 1), intersections[1](0, 2)};
-                            cur_center = intersections[1];
-                        }
-                    }
-                    else {
-                        intersection = {intersections[0](0, 0), intersections[0](0, 1), intersections[0](0, 2)};
-                        cur_center = intersections[0];
-                    }
-                    break;
-                }
+        // test the following segments in small batches, so that the search still stops early
+        bool found_intersection = false;
+        for (int k = lo; k < num_of_segs && !found_intersection; k += sphere_exit_batch_size) {
+            int k_last = std::min(k + sphere_exit_batch_size, num_of_segs);
+            // guide node rows covered by chain segments k to k_last-1
+            int row_lo = std::min(start + k*direction, start + k_last*direction);
+            int row_hi = std::max(start + k*direction, start + k_last*direction);
+
+            double t;
+            int seg_row = polyline_sphere_exit(guide_nodes_, row_lo, row_hi, direction, center, radius, t);
+            if (seg_row == -1) {
+                continue;
             }
 
-            if (!found_intersection) {
-                break;
-            }
-            else {
-                MatrixXd temp = MatrixXd::Zero(1, 4);
-                temp(0, 0) = seg_dist_it + 1;
-                temp(0, 1) = intersection[0];
-                temp(0, 2) = intersection[1];
-                temp(0, 3) = intersection[2];
-                node_pairs.push_back(temp);
-
-                seg_dist_it += 1;
-            }
+            found_intersection = true;
+            k_center = (direction > 0) ? seg_row - start : start - 1 - seg_row;
+            Eigen::Vector3d A = guide_nodes_.row(start + k_center*direction).transpose();
+            Eigen::Vector3d B = guide_nodes_.row(start + (k_center+1)*direction).transpose();
+            center = A + t*(B - A);
+            center_arc = chain_arc(k_center) + t*(chain_arc(k_center+1) - chain_arc(k_center));
         }
-    }
-    else if (alignment == 1){
-        // push back the first pair
-        MatrixXd node_pair(1, 4);
-        node_pair << visible_nodes.back(), guide_nodes(guide_nodes.rows()-1, 0), guide_nodes(guide_nodes.rows()-1, 1), guide_nodes(guide_nodes.rows()-1, 2);
-        node_pairs.push_back(node_pair);
 
-        std::vector<int> consecutive_visible_nodes = {};
-        for (int i = 1; i <= visible_nodes.size(); i ++) {
-            if (visible_nodes[visible_nodes.size()-i] == geodesic_coord.size()-i) {
-                consecutive_visible_nodes.push_back(geodesic_coord.size()-i);
-            }
-            else {
-                break;
-            }
+        if (!found_intersection) {
+            break;
         }
 
-        int last_found_index = guide_nodes.rows()-1;
-        int seg_dist_it = geodesic_coord.size()-1;
-        MatrixXd cur_center = guide_nodes.row(guide_nodes.rows()-1);
-
-        // basically pure pursuit
-        while (last_found_index-1 >= (guide_nodes.rows() - consecutive_visible_nodes.size()) && seg_dist_it-1 >= 0) {
-
-            double look_ahead_dist = fabs(geodesic_coord[seg_dist_it] - geodesic_coord[seg_dist_it-1]);
-
-            bool found_intersection = false;
-            std::vector<double> intersection = {};
-
-            for (int i = last_found_index; i >= (guide_nodes.rows() - consecutive_visible_nodes.size() + 1); i --) {
-                std::vector<MatrixXd> intersections = line_sphere_intersection(guide_nodes.row(i), guide_nodes.row(i-1), cur_center, look_ahead_dist);
-
-                // if no intersection found
-                if (intersections.size() == 0) {
-                    continue;
-                }
-                else if (intersections.size() == 1 && pt2pt_dis(intersections[0], guide_nodes.row(i-1)) > pt2pt_dis(cur_center, guide_nodes.row(i-1))) {
-                    continue;
-                }
-                else {
-                    found_intersection = true;
-                    last_found_index = i;
-
-                    if (intersections.size() == 2) {
-                        if (pt2pt_dis(intersections[0], guide_nodes.row(i-1)) <= pt2pt_dis(intersections[1], guide_nodes.row(i-1))) {
-                            // the first solution is closer
-                            intersection = {intersections[0](0, 0), intersections[0](0, 1), intersections[0](0, 2)};
-                            cur_center = intersections[0];
-                        }
-                        else {
-                            // the second one is closer
-                            intersection = {intersections[1](0, 0), intersections[1](0, 1), intersections[1](0, 2)};
-                            cur_center = intersections[1];
-                        }
-                    }
-                    else {
-                        intersection = {intersections[0](0, 0), intersections[0](0, 1), intersections[0](0, 2)};
-                        cur_center = intersections[0];
-                    }
-                    break;
-                }
-            }
-
-            if (!found_intersection) {
-                break;
-            }
-            else {
-                MatrixXd temp = MatrixXd::Zero(1, 4);
-                temp(0, 0) = seg_dist_it - 1;
-                temp(0, 1) = intersection[0];
-                temp(0, 2) = intersection[1];
-                temp(0, 3) = intersection[2];
-                node_pairs.push_back(temp);
-
-                seg_dist_it -= 1;
-            }
-        }
+        node += direction;
+        prior_sum_.row(node) += center.transpose();
+        prior_count_[node] += 1;
     }
-    else {
-        // push back the first pair
-        MatrixXd node_pair(1, 4);
-        node_pair << visible_nodes[alignment_node_idx], guide_nodes(alignment_node_idx, 0), guide_nodes(alignment_node_idx, 1), guide_nodes(alignment_node_idx, 2);
-        node_pairs.push_back(node_pair);
-
-        std::vector<int> consecutive_visible_nodes_2 = {visible_nodes[alignment_node_idx]};
-        for (int i = alignment_node_idx+1; i < visible_nodes.size(); i ++) {
-            if (visible_nodes[i] - visible_nodes[i-1] == 1) {
-                consecutive_visible_nodes_2.push_back(visible_nodes[i]);
-            }
-            else {
-                break;
-            }
-        }
-
-        // traverse from the alignment node to the tail node
-        int last_found_index = alignment_node_idx;
-        int seg_dist_it = visible_nodes[alignment_node_idx];
-        MatrixXd cur_center = guide_nodes.row(alignment_node_idx);
-
-        // basically pure pursuit
-        while (last_found_index+1 <= alignment_node_idx+consecutive_visible_nodes_2.size()-1 && seg_dist_it+1 <= geodesic_coord.size()-1) {
-            double look_ahead_dist = fabs(geodesic_coord[seg_dist_it+1] - geodesic_coord[seg_dist_it]);
-            bool found_intersection = false;
-            std::vector<double> intersection = {};
-
-            for (int i = last_found_index; i+1 <= alignment_node_idx+consecutive_visible_nodes_2.size()-1; i ++) {
-                std::vector<MatrixXd> intersections = line_sphere_intersection(guide_nodes.row(i), guide_nodes.row(i+1), cur_center, look_ahead_dist);
-
-                // if no intersection found
-                if (intersections.size() == 0) {
-                    continue;
-                }
-                else if (intersections.size() == 1 && pt2pt_dis(intersections[0], guide_nodes.row(i+1)) > pt2pt_dis(cur_center, guide_nodes.row(i+1))) {
-                    continue;
-                }
-                else {
-                    found_intersection = true;
-                    last_found_index = i;
-
-                    if (intersections.size() == 2) {
-                        if (pt2pt_dis(intersections[0], guide_nodes.row(i+1)) <= pt2pt_dis(intersections[1], guide_nodes.row(i+1))) {
-                            // the first solution is closer
-                            intersection = {intersections[0](0, 0), intersections[0](0, 1), intersections[0](0, 2)};
-                            cur_center = intersections[0];
-                        }
-                        else {
-                            // the second one is closer
-                            intersection = {intersections[1](0, 0), intersections[1](0, 1), intersections[1](0, 2)};
-                            cur_center = intersections[1];
-                        }
-                    }
-                    else {
-                        intersection = {intersections[0](0, 0), intersections[0](0, 1), intersections[0](0, 2)};
-                        cur_center = intersections[0];
-                    }
-                    break;
-                }
-            }
-
-            if (!found_intersection) {
-                break;
-            }
-            else {
-                MatrixXd temp = MatrixXd::Zero(1, 4);
-                temp(0, 0) = seg_dist_it + 1;
-                temp(0, 1) = intersection[0];
-                temp(0, 2) = intersection[1];
-                temp(0, 3) = intersection[2];
-                node_pairs.push_back(temp);
-
-                seg_dist_it += 1;
-            }
-        }
-
-
-        // traverse from alignment node to head node
-        std::vector<int> consecutive_visible_nodes_1 = {visible_nodes[alignment_node_idx]};
-        for (int i = alignment_node_idx-1; i >= 0; i ++) {
-            if (visible_nodes[i+1] - visible_nodes[i] == 1) {
-                consecutive_visible_nodes_1.push_back(visible_nodes[i]);
-            }
-            else {
-                break;
-            }
-        }
-
-        last_found_index = alignment_node_idx;
-        seg_dist_it = visible_nodes[alignment_node_idx];
-        cur_center = guide_nodes.row(alignment_node_idx);
-
-        // basically pure pursuit
-        while (last_found_index-1 >= alignment_node_idx-consecutive_visible_nodes_1.size() && seg_dist_it-1 >= 0) {
-            double look_ahead_dist = fabs(geodesic_coord[seg_dist_it] - geodesic_coord[seg_dist_it-1]);
-            bool found_intersection = false;
-            std::vector<double> intersection = {};
-
-            for (int i = last_found_index; i-1 >= 0; i --) {
-                std::vector<MatrixXd> intersections = line_sphere_intersection(guide_nodes.row(i), guide_nodes.row(i-1), cur_center, look_ahead_dist);
-
-                // if no intersection found
-                if (intersections.size() == 0) {
-                    continue;
-                }
-                else if (intersections.size() == 1 && pt2pt_dis(intersections[0], guide_nodes.row(i-1)) > pt2pt_dis(cur_center, guide_nodes.row(i-1))) {
-                    continue;
-                }
-                else {
-                    found_intersection = true;
-                    last_found_index = i;
-
-                    if (intersections.size() == 2) {
-                        if (pt2pt_dis(intersections[0], guide_nodes.row(i-1)) <= pt2pt_dis(intersections[1], guide_nodes.row(i-1))) {
-                            // the first solution is closer
-                            intersection = {intersections[0](0, 0), intersections[0](0, 1), intersections[0](0, 2)};
-                            cur_center = intersections[0];
-                        }
-                        else {
-                            // the second one is closer
-                            intersection = {intersections[1](0, 0), intersections[1](0, 1), intersections[1](0, 2)};
-                            cur_center = intersections[1];
-                        }
-                    }
-                    else {
-                        intersection = {intersections[0](0, 0), intersections[0](0, 1), intersections[0](0, 2)};
-                        cur_center = intersections[0];
-                    }
-                    break;
-                }
-            }
+}
 
-            if (!found_intersection) {
-                break;
-            }
-            else {
-                MatrixXd temp = MatrixXd::Zero(1, 4);
-                temp(0, 0) = seg_dist_it - 1;
-                temp(0, 1) = intersection[0];
-                temp(0, 2) = intersection[1];
-                temp(0, 3) = intersection[2];
-                node_pairs.push_back(temp);
-
-                seg_dist_it -= 1;
-            }
+// average the priors of all marches node by node
+void trackdlo::merge_priors () {
+    correspondence_priors_.clear();
+    for (int i = 0; i < prior_count_.size(); i ++) {
+        if (prior_count_[i] == 0) {
+            continue;
         }
+        correspondence_priors_.push_back(i, prior_sum_(i, 0) / prior_count_[i], prior_sum_(i, 1) / prior_count_[i], prior_sum_(i, 2) / prior_count_[i]);
     }
-
-    return node_pairs;
 }
 
 void trackdlo::tracking_step (MatrixXd X_orig, 
@@ -903,10 +887,28 @@ void trackdlo::tracking_step (MatrixXd X_orig,
                               MatrixXd proj_matrix, 
                               int img_rows, 
                               int img_cols) {
+    TRACE_SCOPE("tracking_step");
+
+    // no guide node or no point to register against
+    if (visible_nodes_extended.empty() || X_orig.rows() == 0) {
+        skip_step();
+        return;
+    }
+
+    // validation mode: replay the same frame through the all-double path on a copy of the current
+    // state, so the drift introduced by the mixed-precision E-step can be measured on recorded data
+    bool validate_precision = precision_validation_ && mixed_precision_;
+    trackdlo reference;
+    if (validate_precision) {
+        reference = *this;
+        reference.mixed_precision_ = false;
+        reference.precision_validation_ = false;
+        reference.tracking_step(X_orig, visible_nodes, visible_nodes_extended, proj_matrix, img_rows, img_cols);
+    }
     
     // variable initialization
-    correspondence_priors_ = {};
     int state = 0;
+    std::chrono::steady_clock::time_point stage_start = std::chrono::steady_clock::now();
 
     // copy visible nodes vec to guide nodes
     // not using topRows() because it caused weird bugs
@@ -921,64 +923,64 @@ void trackdlo::tracking_step (MatrixXd X_orig,
     }
 
     // determine DLO state: heading visible, tail visible, both visible, or both occluded
-    // priors_vec should be the final output; priors_vec[i] = {index, x, y, z}
+    // correspondence_priors_ is the final output; prior i = {index, x, y, z}
     double sigma2_pre_proc = sigma2_;
+    // when every node is visible, both registrations start from the same nodes, points and sigma2,
+    // so the main registration can take over the first E-step of the pre-processing registration
+    bool reuse_first_e_step = fused_registration_ && visible_nodes_extended.size() == Y_.rows() && sigma2_ != 0;
     // pre-processing registration
-    cpd_lle(X_orig, guide_nodes_, sigma2_pre_proc, beta_pre_proc_, lambda_pre_proc_, lle_weight_, mu_, max_iter_, tol_, true);
+    if (fused_registration_) {
+        prepare_shared_frame(X_orig, visible_nodes_extended);
+
+        registration_seed pre_proc_seed;
+        pre_proc_seed.closest_nodes = &frame_.closest_guide_nodes;
+        if (reuse_first_e_step) {
+            pre_proc_seed.first_P_out = &frame_.first_P;
+        }
+        cpd_lle_pruned(frame_.X_guide, guide_nodes_, sigma2_pre_proc, beta_pre_proc_, lambda_pre_proc_, lle_weight_, mu_, max_iter_, tol_, true, 
+                       {}, 0, {}, 0, 0.01, pre_proc_seed);
+    }
+    else {
+        cpd_lle(X_orig, guide_nodes_, sigma2_pre_proc, beta_pre_proc_, lambda_pre_proc_, lle_weight_, mu_, max_iter_, tol_, true);
+    }
+    stats_.pre_proc_iterations = last_iterations_;
+    stats_.pre_proc_em = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stage_start).count() / 1000.0;
+    TRACE_SINCE("pre-proc EM", stage_start);
+    stage_start = std::chrono::steady_clock::now();
+
+    reset_priors();
+    int last_guide_node = visible_nodes_extended.size() - 1;
 
     if (visible_nodes_extended.size() == Y_.rows()) {
         if (visible_nodes.size() == visible_nodes_extended.size()) {
-            ROS_INFO("All nodes visible");
+            ROS_DEBUG("All nodes visible");
         }
         else {
-            ROS_INFO("Minor occlusion");
+            ROS_DEBUG("Minor occlusion");
         }
 
-        // remap visible node locations
-        std::vector<MatrixXd> priors_vec_1 = traverse_euclidean(geodesic_coord_, guide_nodes_, visible_nodes_extended, 0);
-        std::vector<MatrixXd> priors_vec_2 = traverse_euclidean(geodesic_coord_, guide_nodes_, visible_nodes_extended, 1);
-
-        // priors vec 2 goes from last index -> first index
-        std::reverse(priors_vec_2.begin(), priors_vec_2.end());
-
-        // take average
-        correspondence_priors_ = {};
-        for (int i = 0; i < Y_.rows(); i ++) {
-            if (i < priors_vec_2[0](0, 0) && i < priors_vec_1.size()) {
-                correspondence_priors_.push_back(priors_vec_1[i]);
-            }
-            else if (i > priors_vec_1[priors_vec_1.size()-1](0, 0) && (i-(Y_.rows()-priors_vec_2.size())) < priors_vec_2.size()) {
-                correspondence_priors_.push_back(priors_vec_2[i-(Y_.rows()-priors_vec_2.size())]);
-            }
-            else {
-                correspondence_priors_.push_back((priors_vec_1[i] + priors_vec_2[i-(Y_.rows()-priors_vec_2.size())]) / 2.0);
-            }
-        }
+        // remap visible node locations from both ends and take the average
+        march_priors(visible_nodes_extended, 0, 1);
+        march_priors(visible_nodes_extended, last_guide_node, -1);
     }
-    else if (visible_nodes_extended[0] == 0 && visible_nodes_extended[visible_nodes_extended.size()-1] == Y_.rows()-1) {
-        ROS_INFO("Mid-section occluded");
-
-        correspondence_priors_ = traverse_euclidean(geodesic_coord_, guide_nodes_, visible_nodes_extended, 0);
-        std::vector<MatrixXd> priors_vec_2 = traverse_euclidean(geodesic_coord_, guide_nodes_, visible_nodes_extended, 1);
-        // priors_vec = traverse_geodesic(geodesic_coord, guide_nodes, visible_nodes, 0);
-        // std::vector<MatrixXd> priors_vec_2 = traverse_geodesic(geodesic_coord, guide_nodes, visible_nodes, 1);
+    else if (visible_nodes_extended[0] == 0 && visible_nodes_extended[last_guide_node] == Y_.rows()-1) {
+        ROS_DEBUG("Mid-section occluded");
 
-        correspondence_priors_.insert(correspondence_priors_.end(), priors_vec_2.begin(), priors_vec_2.end());
+        march_priors(visible_nodes_extended, 0, 1);
+        march_priors(visible_nodes_extended, last_guide_node, -1);
     }
     else if (visible_nodes_extended[0] == 0) {
-        ROS_INFO("Tail occluded");
+        ROS_DEBUG("Tail occluded");
 
-        correspondence_priors_ = traverse_euclidean(geodesic_coord_, guide_nodes_, visible_nodes_extended, 0);
-        // priors_vec = traverse_geodesic(geodesic_coord, guide_nodes, visible_nodes, 0);
+        march_priors(visible_nodes_extended, 0, 1);
     }
-    else if (visible_nodes_extended[visible_nodes_extended.size()-1] == Y_.rows()-1) {
-        ROS_INFO("Head occluded");
+    else if (visible_nodes_extended[last_guide_node] == Y_.rows()-1) {
+        ROS_DEBUG("Head occluded");
 
-        correspondence_priors_ = traverse_euclidean(geodesic_coord_, guide_nodes_, visible_nodes_extended, 1);
-        // priors_vec = traverse_geodesic(geodesic_coord, guide_nodes, visible_nodes, 1);
+        march_priors(visible_nodes_extended, last_guide_node, -1);
     }
     else {
-        ROS_INFO("Both ends occluded");
+        ROS_DEBUG("Both ends occluded");
 
         // determine which node moved the least
         int alignment_node_idx = -1;
@@ -990,10 +992,39 @@ void trackdlo::tracking_step (MatrixXd X_orig,
             }
         }
 
-        // std::cout << "alignment node index: " << alignment_node_idx << std::endl;
-        correspondence_priors_ = traverse_euclidean(geodesic_coord_, guide_nodes_, visible_nodes_extended, 2, alignment_node_idx);
+        // traverse from the alignment node towards the tail and towards the head
+        march_priors(visible_nodes_extended, alignment_node_idx, 1);
+        march_priors(visible_nodes_extended, alignment_node_idx, -1);
     }
 
+    merge_priors();
+    stats_.priors = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stage_start).count() / 1000.0;
+    TRACE_SINCE("priors", stage_start);
+    stage_start = std::chrono::steady_clock::now();
+
     // include_lle == false because we have no space to discuss it in the paper
-    cpd_lle (X_orig, Y_, sigma2_, beta_, lambda_, lle_weight_, mu_, max_iter_, tol_, false, correspondence_priors_, alpha_, visible_nodes_extended, k_vis_, visibility_threshold_);
+    bool converged;
+    if (fused_registration_) {
+        registration_seed seed;
+        seed.closest_nodes = &frame_.closest_nodes;
+        if (frame_.diff_xy.size() != 0) {
+            seed.diff_xy = &frame_.diff_xy;
+        }
+        if (reuse_first_e_step) {
+            seed.first_P = &frame_.first_P;
+        }
+        converged = cpd_lle_pruned(frame_.X, Y_, sigma2_, beta_, lambda_, lle_weight_, mu_, max_iter_, tol_, false, 
+                                   correspondence_priors_, alpha_, visible_nodes_extended, k_vis_, visibility_threshold_, seed);
+    }
+    else {
+        converged = cpd_lle (X_orig, Y_, sigma2_, beta_, lambda_, lle_weight_, mu_, max_iter_, tol_, false, correspondence_priors_, alpha_, visible_nodes_extended, k_vis_, visibility_threshold_);
+    }
+
+    stats_.main_iterations = last_iterations_;
+    stats_.main_em = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stage_start).count() / 1000.0;
+    TRACE_SINCE("main EM", stage_start);
+
+    update_health(X_orig, visible_nodes.size(), converged);
+
+    stats_.precision_drift = validate_precision ? (Y_ - reference.Y_).rowwise().norm().maxCoeff() : -1;
 }
\ No newline at end of file
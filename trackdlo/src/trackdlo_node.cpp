@@ -1,30 +1,35 @@
 #include "../include/trackdlo.h"
 #include "../include/utils.h"
+#include "../include/visibility.h"
+#include "../include/segmentation.h"
+#include "../include/initializer.h"
+#include "../include/checkpoint.h"
+#include "../include/metrics.h"
+#include "../include/trace.h"
+#include "../include/tracking_result.h"
+#include "../include/shm_channel.h"
+#include "../include/predictor.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <ros/callback_queue.h>
+#include <image_transport/subscriber_filter.h>
+#include <sys/stat.h>
+#include <tf2_ros/transform_listener.h>
+#include <tf2_eigen/tf2_eigen.h>
+#include <pcl/common/transforms.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <std_srvs/Trigger.h>
 
 using cv::Mat;
 using Eigen::MatrixXd;
 using Eigen::RowVectorXd;
 
-ros::Publisher pc_pub;
-ros::Publisher results_pub;
-ros::Publisher guide_nodes_pub;
-ros::Publisher corr_priors_pub;
-ros::Publisher self_occluded_pc_pub;
-ros::Publisher result_pc_pub;
-
-ros::Subscriber init_nodes_sub;
-ros::Subscriber camera_info_sub;
-
-MatrixXd Y;
-double sigma2;
-bool initialized = false;
-bool received_init_nodes = false;
-bool received_proj_matrix = false;
-MatrixXd init_nodes;
-std::vector<double> converted_node_coord = {0.0};
 Mat occlusion_mask;
 bool updated_opencv_mask = false;
-MatrixXd proj_matrix(3, 4);
 
 bool multi_color_dlo;
 double visibility_threshold;
@@ -41,17 +46,299 @@ double tol;
 double k_vis;
 double d_vis;
 double downsample_leaf_size;
+bool mixed_precision = true;
+bool validate_precision = false;
+bool fused_registration = true;
+int processing_scale = 1;
+bool use_organized_cloud = false;
+std::string rgb_transport = "raw";
+std::string depth_transport = "raw";
+int decode_threads = 2;
+double static_skip_threshold = 0;
+int static_skip_max = 10;
+int static_skip_stride = 4;
+double static_skip_depth_tolerance = 0.01;
 
 std::string camera_info_topic;
 std::string rgb_topic;
 std::string depth_topic;
+std::string pointcloud_topic;
 std::string hsv_threshold_upper_limit;
 std::string hsv_threshold_lower_limit;
 std::string result_frame_id;
 std::vector<int> upper;
 std::vector<int> lower;
+std::string color_profile = "";
+std::string color_profile_dlo = "";
+bool track_all_dlos = false;
+double color_profile_check_period = 1.0;
+bool native_init = true;
+int num_of_nodes = 30;
+double depth_filter = 0;
+health_thresholds tracking_health_thresholds;
+std::string checkpoint_path = "";
+double checkpoint_period = 1.0;
+double checkpoint_max_age = 30.0;
+double checkpoint_min_overlap = 0.5;
+double diagnostics_period = 1.0;
+
+// stage latencies and counters, published on /diagnostics every diagnostics_period seconds
+tracker_metrics metrics;
+
+// traces of the last trace_window seconds are written to trace_dir on the dump_trace service or SIGUSR1
+bool trace_enabled = true;
+double trace_window = 10.0;
+std::string trace_dir = "/tmp";
+std::atomic<bool> trace_requested(false);
+
+// results are also written to POSIX shared memory under shm_channel (with the DLO name appended when tracking
+// several), in a ring of shm_slots results of up to shm_max_nodes nodes. empty to disable
+std::string shm_channel = "";
+int shm_max_nodes = 128;
+int shm_slots = 16;
+
+// predicted node positions are published at predict_rate Hz (0 to disable), for predict_delay seconds before now,
+// from a motion model of the last predict_history results. nothing is published more than predict_max_horizon
+// seconds after the latest result
+double predict_rate = 0;
+int predict_history = 4;
+double predict_delay = 0;
+double predict_max_horizon = 0.1;
+
+// lookup table with one class per DLO, and the DLO names. the profile watcher swaps in a new one while frames are
+// being processed, so it is only accessed through std::atomic_load / std::atomic_store
+struct dlo_classifier {
+    color_lut lut;
+    std::vector<std::string> names;
+    // colors named "tip" of every DLO (same classes as lut), for the end its nodes start at when initializing
+    color_lut tip_lut;
+    std::vector<bool> has_tip;
+};
+std::shared_ptr<const dlo_classifier> dlo_lut;
+std::atomic<bool> rebuilding_lut(false);
+time_t color_profile_mtime = 0;
+
+// synced input frames, handed from the decode threads to the tracking loop
+struct input_frame {
+    sensor_msgs::ImageConstPtr image;
+    sensor_msgs::ImageConstPtr depth;
+    sensor_msgs::PointCloud2ConstPtr cloud;
+};
+
+// one calibrated RGB-D camera. camera 0 is the primary camera: every one of its frames is tracked and drawn on
+// the tracking image, and the other cameras contribute their frame closest in time to it. results are expressed
+// in result_frame_id, every camera's extrinsics come from TF (a single camera's frame is used as is)
+struct camera_input {
+    std::string rgb_topic;
+    std::string depth_topic;
+    std::string camera_info_topic;
+
+    ros::Subscriber camera_info_sub;
+    bool received_proj_matrix = false;
+    MatrixXd proj_matrix = MatrixXd::Zero(3, 4);
+    std::string frame_id;
+
+    // result frame <- camera frame, looked up once (the cameras are assumed to be rigidly mounted)
+    bool received_extrinsics = false;
+    Eigen::Isometry3d camera_to_result = Eigen::Isometry3d::Identity();
+
+    // recent frames of a secondary camera, guarded by frame_mutex
+    std::deque<input_frame> recent_frames;
+};
+// stable addresses: subscriber callbacks hold pointers to the entries
+std::vector<std::unique_ptr<camera_input>> cameras;
+double camera_sync_tolerance = 0.02;
+std::unique_ptr<tf2_ros::Buffer> tf_buffer;
+
+// frames of the primary camera wait in pending_frames (at most max_pending_frames, the oldest one is dropped when
+// tracking falls behind); secondary cameras keep their last max_recent_frames frames to be matched against them
+std::mutex frame_mutex;
+std::condition_variable frame_ready;
+std::deque<input_frame> pending_frames;
+const int max_pending_frames = 2;
+const int max_recent_frames = 5;
+
+// low-latency policy: track the newest pending frame and drop the older ones
+bool newest_frame_only = false;
+
+// first arrival of a message (rgb, depth or cloud) with each recent stamp of the primary camera, to measure how
+// long the synchronizer holds frames. stamps that are never synced are counted as unmatched
+std::mutex arrival_mutex;
+std::deque<std::pair<ros::Time, std::chrono::steady_clock::time_point>> arrivals;
+const int max_arrivals = 50;
+
+void note_arrival (const ros::Time& stamp) {
+    std::lock_guard<std::mutex> lock(arrival_mutex);
+    for (const auto& arrival : arrivals) {
+        if (arrival.first == stamp) {
+            return;
+        }
+    }
+    arrivals.push_back({stamp, std::chrono::steady_clock::now()});
+    if (arrivals.size() > max_arrivals) {
+        arrivals.pop_front();
+        metrics.unmatched_messages += 1;
+    }
+}
+
+void note_synced (const ros::Time& stamp) {
+    metrics.record_latency(metrics.receive_latency, stamp);
 
-trackdlo tracker;
+    std::lock_guard<std::mutex> lock(arrival_mutex);
+    for (auto it = arrivals.begin(); it != arrivals.end(); ) {
+        if (it->first > stamp) {
+            ++ it;
+            continue;
+        }
+        if (it->first == stamp) {
+            metrics.sync_wait.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - it->second).count());
+        }
+        else {
+            metrics.unmatched_messages += 1;
+        }
+        it = arrivals.erase(it);
+    }
+}
+
+void push_frame (int camera, const input_frame& frame) {
+    {
+        std::lock_guard<std::mutex> lock(frame_mutex);
+        std::deque<input_frame>& frames = (camera == 0) ? pending_frames : cameras[camera]->recent_frames;
+        int max_frames = (camera == 0) ? max_pending_frames : max_recent_frames;
+        if (frames.size() >= max_frames) {
+            frames.pop_front();
+            if (camera == 0) {
+                metrics.dropped_frames += 1;
+            }
+        }
+        frames.push_back(frame);
+    }
+    if (camera == 0) {
+        frame_ready.notify_one();
+    }
+}
+
+// frame of a secondary camera closest in time to stamp, with a null image if none is within camera_sync_tolerance
+input_frame closest_frame (int camera, const ros::Time& stamp) {
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    input_frame closest;
+    double closest_offset = camera_sync_tolerance;
+    for (const input_frame& frame : cameras[camera]->recent_frames) {
+        double offset = fabs((frame.image->header.stamp - stamp).toSec());
+        if (offset <= closest_offset) {
+            closest = frame;
+            closest_offset = offset;
+        }
+    }
+    return closest;
+}
+
+// one tracked DLO. every DLO has its own tracker, color class and topics; the camera input and the pre-processing
+// are shared by all of them
+struct dlo_track {
+    std::string name;
+
+    trackdlo tracker;
+    MatrixXd Y;
+    bool initialized = false;
+    bool received_init_nodes = false;
+    MatrixXd init_nodes;
+    std::vector<double> converted_node_coord = {0.0};
+    // nodes drawn as visible (not self-occluded) in the tracking image
+    std::vector<bool> vis;
+
+    ros::Subscriber init_nodes_sub;
+    ros::Publisher init_nodes_markers_pub;
+    ros::Publisher pc_pub;
+    ros::Publisher results_pub;
+    ros::Publisher guide_nodes_pub;
+    ros::Publisher corr_priors_pub;
+    ros::Publisher self_occluded_pc_pub;
+    ros::Publisher result_pc_pub;
+    tracking_result_publisher tracking_result_pub;
+    std::unique_ptr<shm_result_writer> shm_writer;
+    ros::Publisher predicted_pub;
+    std::unique_ptr<motion_predictor> predictor;
+    std::unique_ptr<prediction_publisher> prediction_pub;
+
+    // result messages, filled in place from every healthy result so their buffers are reused. they hold the last
+    // healthy results, which are republished while the scene stays static or tracking is unhealthy
+    bool has_results = false;
+    visualization_msgs::MarkerArray result_markers;
+    visualization_msgs::MarkerArray guide_nodes_markers;
+    sensor_msgs::PointCloud2 result_pc_msg;
+    sensor_msgs::PointCloud2 self_occluded_pc_msg;
+
+    // mask and depth of every camera (indexed as cameras) in the last tracked frame, empty for cameras without a
+    // frame in it. while the scene stays static the last results are republished instead of running the tracker
+    std::vector<Mat> ref_masks;
+    std::vector<Mat> ref_depths;
+    int consecutive_skips = 0;
+    int skipped_frames = 0;
+
+    // last healthy result, drawn (and republished) while tracking is unhealthy or lost, and checkpointed
+    MatrixXd good_Y;
+    std::vector<bool> good_vis;
+    double good_sigma2 = 0;
+
+    // restored from a checkpoint and not yet checked against a frame
+    bool restored = false;
+
+    // tracking lost: the last healthy results are held while the DLO is re-initialized from a recent frame in the
+    // background on reinit_thread, joined before the entry goes away. reinit_mutex guards the re-initialization state
+    bool lost = false;
+    std::chrono::steady_clock::time_point lost_at;
+    int lost_frames = 0;
+    std::mutex reinit_mutex;
+    bool reinit_running = false;
+    bool reinit_ready = false;
+    MatrixXd reinit_nodes;
+    std::thread reinit_thread;
+
+    ~dlo_track () {
+        if (reinit_thread.joinable()) {
+            reinit_thread.join();
+        }
+    }
+};
+// stable addresses: subscriber callbacks and the tracking threads hold pointers to the entries
+std::vector<std::unique_ptr<dlo_track>> dlos;
+
+// pre-processing of one camera's frame, shared by all DLOs
+struct camera_frame {
+    ros::Time stamp;
+    Mat depth;                          // full resolution, CV_16UC1 (mm) or CV_32FC1 (m)
+    organized_cloud_view cloud;         // registered organized cloud, if that is the input
+    bool has_cloud = false;
+    Mat occlusion_mask_gray;            // full resolution, empty if there is no simulated occlusion
+    Mat image;                          // BGR at processing resolution
+    MatrixXd proj_matrix;               // at processing resolution
+    int pixel_width;                    // dlo_pixel_width at processing resolution
+    Eigen::Isometry3d camera_to_result;
+    std::vector<Mat> color_masks;       // full resolution, one per tracked DLO
+    int camera = 0;                     // index in cameras
+};
+
+// runs body(i) for every i in [0, n) on OpenCV's thread pool. OpenCV runs nested parallel loops serially, so a
+// single item runs directly to keep the parallel loops inside it parallel
+template <typename Body>
+void run_parallel (int n, const Body& body) {
+    if (n == 1) {
+        body(0);
+        return;
+    }
+    cv::parallel_for_(cv::Range(0, n), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i ++) {
+            body(i);
+        }
+    });
+}
+
+// nodes in a camera's frame
+MatrixXd to_camera_frame (const MatrixXd& Y, const Eigen::Isometry3d& camera_to_result) {
+    Eigen::Isometry3d result_to_camera = camera_to_result.inverse();
+    return ((result_to_camera.linear() * Y.transpose()).colwise() + result_to_camera.translation()).transpose();
+}
 
 void update_opencv_mask (const sensor_msgs::ImageConstPtr& opencv_mask_msg) {
     occlusion_mask = cv_bridge::toCvShare(opencv_mask_msg, "bgr8")->image;
@@ -60,467 +347,995 @@ void update_opencv_mask (const sensor_msgs::ImageConstPtr& opencv_mask_msg) {
     }
 }
 
-void update_init_nodes (const sensor_msgs::PointCloud2ConstPtr& pc_msg) {
+void update_init_nodes (const sensor_msgs::PointCloud2ConstPtr& pc_msg, dlo_track& dlo) {
     pcl::PCLPointCloud2* cloud = new pcl::PCLPointCloud2;
     pcl_conversions::toPCL(*pc_msg, *cloud);
     pcl::PointCloud<pcl::PointXYZRGB> cloud_xyz;
     pcl::fromPCLPointCloud2(*cloud, cloud_xyz);
 
-    init_nodes = cloud_xyz.getMatrixXfMap().topRows(3).transpose().cast<double>();
-    received_init_nodes = true;
-    init_nodes_sub.shutdown();
+    dlo.init_nodes = cloud_xyz.getMatrixXfMap().topRows(3).transpose().cast<double>();
+    dlo.received_init_nodes = true;
+    dlo.init_nodes_sub.shutdown();
 }
 
-void update_camera_info (const sensor_msgs::CameraInfoConstPtr& cam_msg) {
+void update_camera_info (const sensor_msgs::CameraInfoConstPtr& cam_msg, camera_input& camera) {
     auto P = cam_msg->P;
     for (int i = 0; i < P.size(); i ++) {
-        proj_matrix(i/4, i%4) = P[i];
+        camera.proj_matrix(i/4, i%4) = P[i];
     }
-    received_proj_matrix = true;
-    camera_info_sub.shutdown();
+    camera.frame_id = cam_msg->header.frame_id;
+    camera.received_proj_matrix = true;
+    camera.camera_info_sub.shutdown();
 }
 
-double pre_proc_total = 0;
-double algo_total = 0;
-double pub_data_total = 0;
-int frames = 0;
+// looks up the camera's extrinsics once its frame id is known. a camera in result_frame_id (or publishing no frame
+// id) needs none, and neither does a single camera: without extra cameras result_frame_id only labels the outputs,
+// which are in the camera's frame
+bool update_extrinsics (camera_input& camera) {
+    if (camera.received_extrinsics) {
+        return true;
+    }
+    if (!camera.received_proj_matrix) {
+        return false;
+    }
+    if (camera.frame_id == "" || camera.frame_id == result_frame_id || cameras.size() == 1) {
+        camera.received_extrinsics = true;
+        return true;
+    }
 
-Mat color_thresholding (Mat cur_image_hsv) {
-    std::vector<int> lower_blue = {90, 90, 30};
-    std::vector<int> upper_blue = {130, 255, 255};
+    try {
+        geometry_msgs::TransformStamped transform = tf_buffer->lookupTransform(result_frame_id, camera.frame_id, ros::Time(0));
+        camera.camera_to_result = tf2::transformToEigen(transform);
+        camera.received_extrinsics = true;
+    }
+    catch (const tf2::TransformException& e) {
+        ROS_WARN_STREAM_THROTTLE(5, "No extrinsics for camera frame " + camera.frame_id + " yet: " + e.what());
+    }
+    return camera.received_extrinsics;
+}
 
-    std::vector<int> lower_green = {58, 130, 50};
-    std::vector<int> upper_green = {90, 255, 255};
+// starts tracking from init_nodes. geodesic_coord defaults to the arc length along init_nodes
+void initialize_dlo (dlo_track& dlo, const std::vector<double>& geodesic_coord = {}) {
+    dlo.tracker = trackdlo(dlo.init_nodes.rows(), visibility_threshold, beta, lambda, alpha, k_vis, mu, max_iter, tol, beta_pre_proc, lambda_pre_proc, lle_weight);
+    dlo.tracker.set_mixed_precision(mixed_precision);
+    dlo.tracker.set_precision_validation(validate_precision);
+    dlo.tracker.set_fused_registration(fused_registration);
+
+    dlo.tracker.set_health_thresholds(tracking_health_thresholds);
+
+    // record geodesic coord
+    dlo.converted_node_coord = {0.0};
+    double cur_sum = 0;
+    for (int i = 0; i < dlo.init_nodes.rows()-1; i ++) {
+        cur_sum += (dlo.init_nodes.row(i+1) - dlo.init_nodes.row(i)).norm();
+        dlo.converted_node_coord.push_back(cur_sum);
+    }
+    if (!geodesic_coord.empty()) {
+        dlo.converted_node_coord = geodesic_coord;
+    }
 
+    dlo.tracker.initialize_nodes(dlo.init_nodes);
+    dlo.tracker.initialize_geodesic_coord(dlo.converted_node_coord);
+    dlo.Y = dlo.init_nodes.replicate(1, 1);
+    dlo.vis.assign(dlo.Y.rows(), true);
+    dlo.good_Y = dlo.Y;
+    dlo.good_vis = dlo.vis;
+    dlo.good_sigma2 = 0;
+    dlo.restored = false;
+    if (dlo.predictor) {
+        dlo.predictor->reset();
+    }
 
-    Mat mask_blue, mask_green, mask;
+    // results and static-scene references from before a re-initialization or restore are stale
+    dlo.has_results = false;
+    dlo.ref_masks.clear();
+    dlo.ref_depths.clear();
+    dlo.consecutive_skips = 0;
 
-    // filter blue
-    cv::inRange(cur_image_hsv, cv::Scalar(lower_blue[0], lower_blue[1], lower_blue[2]), cv::Scalar(upper_blue[0], upper_blue[1], upper_blue[2]), mask_blue);
+    dlo.initialized = true;
+}
 
-    cv::inRange(cur_image_hsv, cv::Scalar(lower_green[0], lower_green[1], lower_green[2]), cv::Scalar(upper_green[0], upper_green[1], upper_green[2]), mask_green);
+// decodes one camera's frame, classifies the masks of the tracked DLOs (classes in the classifier) in one pass and
+// scales the image and intrinsics to the processing resolution. returns false if the frame cannot be used
+bool prepare_camera_frame (const input_frame& input, const camera_input& camera, const dlo_classifier& classifier, const std::vector<int>& classes, camera_frame& frame) {
+    std::chrono::steady_clock::time_point stage_start = std::chrono::steady_clock::now();
+    Mat image = cv_bridge::toCvShare(input.image, "bgr8")->image;
+    frame.stamp = input.image->header.stamp;
+    frame.camera_to_result = camera.camera_to_result;
+
+    // depth image, or the z channel of the organized cloud (used for visibility and reduced resolution)
+    frame.has_cloud = static_cast<bool>(input.cloud);
+    if (input.cloud) {
+        frame.cloud = organized_cloud_view(*input.cloud);
+        if (frame.cloud.rows() != image.rows || frame.cloud.cols() != image.cols) {
+            ROS_ERROR_STREAM("Organized point cloud (" + std::to_string(frame.cloud.cols()) + "x" + std::to_string(frame.cloud.rows()) + ") is not registered to the RGB image");
+            return false;
+        }
+        frame.depth = frame.cloud.depth_image();
+    }
+    else {
+        frame.depth = cv_bridge::toCvShare(input.depth, input.depth->encoding)->image;
+        if (frame.depth.type() != CV_16UC1 && frame.depth.type() != CV_32FC1) {
+            ROS_ERROR_STREAM("Unsupported depth encoding " + input.depth->encoding + " (expected 16UC1 in mm or 32FC1 in m)");
+            return false;
+        }
+    }
+
+    metrics.record_stage(stage_decode, stage_start);
+    stage_start = std::chrono::steady_clock::now();
+
+    // color thresholding: the masks of all DLOs in one pass
+    classifier.lut.classify(image, frame.color_masks, classes);
 
-    cv::bitwise_or(mask_green, mask_blue, mask);
+    // reduced processing resolution: scale the image and intrinsics (each DLO pools its own mask and depth)
+    frame.image = image;
+    frame.proj_matrix = camera.proj_matrix;
+    frame.pixel_width = dlo_pixel_width;
+    if (processing_scale > 1) {
+        // crop to whole blocks so every pooled pixel averages exactly its own block
+        cv::Size proc_size(image.cols / processing_scale, image.rows / processing_scale);
+        cv::Rect blocks(0, 0, proc_size.width*processing_scale, proc_size.height*processing_scale);
+        cv::resize(image(blocks), frame.image, proc_size, 0, 0, cv::INTER_AREA);
 
-    return mask;
+        frame.proj_matrix = scale_projection(camera.proj_matrix, processing_scale);
+        frame.pixel_width = std::max(1, dlo_pixel_width / processing_scale);
+    }
+    metrics.record_stage(stage_segmentation, stage_start);
+
+    return true;
 }
 
-sensor_msgs::ImagePtr Callback(const sensor_msgs::ImageConstPtr& image_msg, const sensor_msgs::ImageConstPtr& depth_msg) {
+// initial nodes (in result_frame_id) of a DLO from its full resolution mask and the camera's depth image. image is
+// only used to find the DLO's tip. throws std::invalid_argument if the DLO cannot be extracted
+MatrixXd extract_init_nodes (const Mat& mask, const Mat& image, const Mat& depth, const MatrixXd& camera_proj_matrix, const Eigen::Isometry3d& camera_to_result,
+                             const dlo_classifier& classifier, int dlo_class, int nodes) {
+    Mat tip_mask;
+    if (classifier.has_tip[dlo_class]) {
+        classifier.tip_lut.classify(image, tip_mask, dlo_class);
+    }
 
-    Mat cur_image_orig = cv_bridge::toCvShare(image_msg, "bgr8")->image;
-    Mat cur_depth = cv_bridge::toCvShare(depth_msg, depth_msg->encoding)->image;
+    MatrixXd camera_nodes = initialize_nodes(mask, depth, camera_proj_matrix, nodes, depth_filter, tip_mask);
+    return ((camera_to_result.linear() * camera_nodes.transpose()).colwise() + camera_to_result.translation()).transpose();
+}
 
-    // will get overwritten later if intialized
-    sensor_msgs::ImagePtr tracking_img_msg = cv_bridge::CvImage(std_msgs::Header(), "bgr8", cur_image_orig).toImageMsg();
-    
-    if (!initialized) {
-        if (received_init_nodes && received_proj_matrix) {
-            tracker = trackdlo(init_nodes.rows(), visibility_threshold, beta, lambda, alpha, k_vis, mu, max_iter, tol, beta_pre_proc, lambda_pre_proc, lle_weight);
-
-            sigma2 = 0.001;
-
-            // record geodesic coord
-            double cur_sum = 0;
-            for (int i = 0; i < init_nodes.rows()-1; i ++) {
-                cur_sum += (init_nodes.row(i+1) - init_nodes.row(i)).norm();
-                converted_node_coord.push_back(cur_sum);
-            }
+// initializes a DLO from its full resolution mask in a camera's frame, for DLOs without nodes from the init_nodes
+// topic, and publishes its initial nodes. on failure it is retried on the next frame
+void initialize_dlo_from_frame (dlo_track& dlo, const Mat& mask, const Mat& image, const camera_frame& frame, const camera_input& camera, const dlo_classifier& classifier, int dlo_class) {
+    std::chrono::high_resolution_clock::time_point start_time = std::chrono::high_resolution_clock::now();
+
+    try {
+        dlo.init_nodes = extract_init_nodes(mask, image, frame.depth, camera.proj_matrix, frame.camera_to_result, classifier, dlo_class, num_of_nodes);
+    }
+    catch (const std::invalid_argument& e) {
+        ROS_ERROR_STREAM(dlo.name + ": failed to initialize, retrying on the next frame: " + e.what());
+        return;
+    }
 
-            tracker.initialize_nodes(init_nodes);
-            tracker.initialize_geodesic_coord(converted_node_coord);
-            Y = init_nodes.replicate(1, 1);
+    dlo.received_init_nodes = true;
+    dlo.init_nodes_sub.shutdown();
+    initialize_dlo(dlo);
 
-            initialized = true;
+    dlo.init_nodes_markers_pub.publish(MatrixXd2MarkerArray(dlo.init_nodes, result_frame_id, "init_node_results", {0.0, 149.0/255.0, 203.0/255.0, 0.75}, {0.0, 149.0/255.0, 203.0/255.0, 0.75}));
+
+    double time_diff = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time).count() / 1000.0;
+    ROS_INFO_STREAM(dlo.name + ": initialized " + std::to_string(dlo.init_nodes.rows()) + " nodes in " + std::to_string(time_diff) + " ms");
+}
+
+// re-initializes a lost DLO from a camera frame on a background thread, with as many nodes as before. the result
+// is picked up by reinitialize_lost_dlo; on failure the next frame is tried
+void start_reinitialization (dlo_track& dlo, const Mat& mask, const Mat& image, const camera_frame& frame, const camera_input& camera,
+                             std::shared_ptr<const dlo_classifier> classifier, int dlo_class) {
+    {
+        std::lock_guard<std::mutex> lock(dlo.reinit_mutex);
+        if (dlo.reinit_running || dlo.reinit_ready) {
+            return;
         }
+        dlo.reinit_running = true;
+    }
+    // the previous attempt has finished
+    if (dlo.reinit_thread.joinable()) {
+        dlo.reinit_thread.join();
     }
-    else {
-        // log time
-        std::chrono::high_resolution_clock::time_point cur_time_cb = std::chrono::high_resolution_clock::now();
-        double time_diff;
-        std::chrono::high_resolution_clock::time_point cur_time;
 
-        Mat mask, mask_rgb, mask_without_occlusion_block;
-        Mat cur_image_hsv;
+    // the depth (and image) may point into the message buffers
+    Mat depth = frame.depth.clone();
+    Mat tip_image = classifier->has_tip[dlo_class] ? image.clone() : Mat();
+    MatrixXd camera_proj_matrix = camera.proj_matrix;
+    Eigen::Isometry3d camera_to_result = frame.camera_to_result;
+    int nodes = dlo.init_nodes.rows();
+    dlo_track* target = &dlo;
+
+    dlo.reinit_thread = std::thread([=]() {
+        MatrixXd init_nodes;
+        bool extracted = false;
+        try {
+            init_nodes = extract_init_nodes(mask, tip_image, depth, camera_proj_matrix, camera_to_result, *classifier, dlo_class, nodes);
+            extracted = true;
+        }
+        catch (const std::invalid_argument& e) {
+            ROS_WARN_STREAM(target->name + ": re-initialization failed, retrying: " + e.what());
+        }
 
-        // convert color
-        cv::cvtColor(cur_image_orig, cur_image_hsv, cv::COLOR_BGR2HSV);
+        std::lock_guard<std::mutex> lock(target->reinit_mutex);
+        target->reinit_nodes = init_nodes;
+        target->reinit_ready = extracted;
+        target->reinit_running = false;
+    });
+}
 
-        if (!multi_color_dlo) {
-            // color_thresholding
-            cv::inRange(cur_image_hsv, cv::Scalar(lower[0], lower[1], lower[2]), cv::Scalar(upper[0], upper[1], upper[2]), mask_without_occlusion_block);
+// restarts the tracker of a lost DLO once its background re-initialization finished. returns whether it did
+bool reinitialize_lost_dlo (dlo_track& dlo) {
+    {
+        std::lock_guard<std::mutex> lock(dlo.reinit_mutex);
+        if (!dlo.reinit_ready) {
+            return false;
+        }
+        dlo.init_nodes = dlo.reinit_nodes;
+        dlo.reinit_ready = false;
+    }
+
+    initialize_dlo(dlo);
+    dlo.lost = false;
+    dlo.init_nodes_markers_pub.publish(MatrixXd2MarkerArray(dlo.init_nodes, result_frame_id, "init_node_results", {0.0, 149.0/255.0, 203.0/255.0, 0.75}, {0.0, 149.0/255.0, 203.0/255.0, 0.75}));
+
+    double time_to_recover = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - dlo.lost_at).count() / 1000.0;
+    ROS_INFO_STREAM(dlo.name + ": recovered in " + std::to_string(time_to_recover) + " ms (" + std::to_string(dlo.lost_frames) + " frames held)");
+    return true;
+}
+
+// republishes the last healthy results with a fresh timestamp
+void republish_last_results (dlo_track& dlo, const ros::Time& stamp) {
+    if (!dlo.has_results) {
+        return;
+    }
+    dlo.result_pc_msg.header.stamp = stamp;
+    dlo.self_occluded_pc_msg.header.stamp = stamp;
+    dlo.results_pub.publish(dlo.result_markers);
+    dlo.result_pc_pub.publish(dlo.result_pc_msg);
+    dlo.self_occluded_pc_pub.publish(dlo.self_occluded_pc_msg);
+    dlo.tracking_result_pub.republish(stamp);
+}
+
+// runs DLO k through the per-DLO part of the pipeline (mask pooling, back-projection, visibility, tracking) with
+// every camera's frame and publishes its results
+void track_dlo (dlo_track& dlo, int k, const std::vector<camera_frame>& frames) {
+    TRACE_SCOPE("track_dlo");
+    MatrixXd& Y = dlo.Y;
+    int num_of_cameras = frames.size();
+    ros::Time stamp = frames[0].stamp;
+
+    // tracking lost: hold the last healthy results until the re-initialization finishes
+    if (dlo.lost) {
+        dlo.lost_frames += 1;
+        republish_last_results(dlo, stamp);
+        return;
+    }
+
+    // reduced processing resolution: pool the mask and depth of every camera
+    std::chrono::steady_clock::time_point stage_start = std::chrono::steady_clock::now();
+    std::vector<Mat> masks(num_of_cameras);
+    std::vector<Mat> proc_depths(num_of_cameras);
+    for (int c = 0; c < num_of_cameras; c ++) {
+        const camera_frame& frame = frames[c];
+        if (!frame.occlusion_mask_gray.empty()) {
+            cv::bitwise_and(frame.color_masks[k], frame.occlusion_mask_gray, masks[c]);
         }
         else {
-            mask_without_occlusion_block = color_thresholding(cur_image_hsv);
+            masks[c] = frame.color_masks[k];
         }
 
-        // update cur image for visualization
-        Mat cur_image;
-        Mat occlusion_mask_gray;
-        if (updated_opencv_mask) {
-            cv::cvtColor(occlusion_mask, occlusion_mask_gray, cv::COLOR_BGR2GRAY);
-            cv::bitwise_and(mask_without_occlusion_block, occlusion_mask_gray, mask);
-            cv::bitwise_and(cur_image_orig, occlusion_mask, cur_image);
+        proc_depths[c] = frame.depth;
+        if (processing_scale > 1) {
+            Mat pooled_mask;
+            pool_mask_and_depth(masks[c], frame.depth, processing_scale, pooled_mask, proc_depths[c]);
+            masks[c] = pooled_mask;
         }
-        else {
-            mask_without_occlusion_block.copyTo(mask);
-            cur_image_orig.copyTo(cur_image);
+    }
+
+    // static scene: compare every camera's mask and depth around the tracked DLO against the last tracked frame,
+    // and republish its results with a fresh timestamp if little changed in all of them
+    bool static_scene = static_skip_threshold > 0 && dlo.consecutive_skips < static_skip_max;
+    bool in_view = false;
+    for (int c = 0; c < num_of_cameras && static_scene; c ++) {
+        const camera_frame& frame = frames[c];
+        const Mat& ref_mask = (frame.camera < dlo.ref_masks.size()) ? dlo.ref_masks[frame.camera] : Mat();
+        const Mat& ref_depth = (frame.camera < dlo.ref_depths.size()) ? dlo.ref_depths[frame.camera] : Mat();
+        if (ref_mask.empty() || ref_mask.size() != masks[c].size() || ref_depth.type() != proc_depths[c].type()) {
+            static_scene = false;
+            break;
+        }
+
+        MatrixXd Y_camera = to_camera_frame(Y, frame.camera_to_result);
+        MatrixXd node_coords = (frame.proj_matrix.leftCols(3) * Y_camera.transpose()).colwise() + frame.proj_matrix.col(3);
+        int col_min = masks[c].cols;
+        int col_max = -1;
+        int row_min = masks[c].rows;
+        int row_max = -1;
+        for (int i = 0; i < Y.rows(); i ++) {
+            if (node_coords(2, i) <= 0) {
+                continue;
+            }
+            int col = static_cast<int>(node_coords(0, i) / node_coords(2, i));
+            int row = static_cast<int>(node_coords(1, i) / node_coords(2, i));
+            col_min = std::min(col_min, col);
+            col_max = std::max(col_max, col);
+            row_min = std::min(row_min, row);
+            row_max = std::max(row_max, row);
         }
+        if (col_max < col_min) {
+            // the DLO is out of this camera's view
+            continue;
+        }
+        in_view = true;
 
-        cv::cvtColor(mask, mask_rgb, cv::COLOR_GRAY2BGR);
+        // widen by the DLO width so pixels entering around the DLO are seen
+        int margin = frame.pixel_width;
+        cv::Rect roi(col_min - margin, row_min - margin, col_max - col_min + 2*margin + 1, row_max - row_min + 2*margin + 1);
+        static_scene = mask_change_fraction(masks[c], proc_depths[c], ref_mask, ref_depth, roi, static_skip_stride, static_skip_depth_tolerance) < static_skip_threshold;
+    }
+    if (static_scene && in_view) {
+        dlo.consecutive_skips += 1;
+        dlo.skipped_frames += 1;
+        metrics.skipped_frames += 1;
+        republish_last_results(dlo, stamp);
+        if (dlo.predictor) {
+            dlo.predictor->add_estimate(stamp, dlo.good_Y, dlo.good_sigma2);
+        }
+        return;
+    }
+    dlo.consecutive_skips = 0;
 
-        bool simulated_occlusion = false;
-        int occlusion_corner_i = -1;
-        int occlusion_corner_j = -1;
-        int occlusion_corner_i_2 = -1;
-        int occlusion_corner_j_2 = -1;
+    // filter point cloud: the points of every camera in result_frame_id, merged in one voxel grid
+    pcl::PointCloud<pcl::PointXYZRGB> cur_pc;
+    pcl::PointCloud<pcl::PointXYZRGB> cur_pc_downsampled;
 
-        // filter point cloud
-        pcl::PointCloud<pcl::PointXYZRGB> cur_pc;
-        pcl::PointCloud<pcl::PointXYZRGB> cur_pc_downsampled;
+    for (int c = 0; c < num_of_cameras; c ++) {
+        const camera_frame& frame = frames[c];
+        const Mat& mask = masks[c];
+        pcl::PointCloud<pcl::PointXYZRGB> camera_pc;
 
         // filter point cloud from mask
-        for (int i = 0; i < mask.rows; i ++) {
-            for (int j = 0; j < mask.cols; j ++) {
-                // for text label (visualization)
-                if (updated_opencv_mask && !simulated_occlusion && occlusion_mask_gray.at<uchar>(i, j) == 0) {
-                    occlusion_corner_i = i;
-                    occlusion_corner_j = j;
-                    simulated_occlusion = true;
-                }
-
-                // update the other corner of occlusion mask (visualization)
-                if (updated_opencv_mask && occlusion_mask_gray.at<uchar>(i, j) == 0) {
-                    occlusion_corner_i_2 = i;
-                    occlusion_corner_j_2 = j;
-                }
+        if (frame.has_cloud && processing_scale == 1) {
+            // registered points straight from the organized cloud
+            for (int i = 0; i < mask.rows; i ++) {
+                for (int j = 0; j < mask.cols; j ++) {
+                    if (mask.at<uchar>(i, j) == 0 || !std::isfinite(frame.cloud.z(i, j))) {
+                        continue;
+                    }
 
-                if (mask.at<uchar>(i, j) != 0) {
-                    // point cloud from image pixel coordinates and depth value
                     pcl::PointXYZRGB point;
-                    double pixel_x = static_cast<double>(j);
-                    double pixel_y = static_cast<double>(i);
-                    double cx = proj_matrix(0, 2);
-                    double cy = proj_matrix(1, 2);
-                    double fx = proj_matrix(0, 0);
-                    double fy = proj_matrix(1, 1);
-                    double pc_z = cur_depth.at<uint16_t>(i, j) / 1000.0;
-
-                    point.x = (pixel_x - cx) * pc_z / fx;
-                    point.y = (pixel_y - cy) * pc_z / fy;
-                    point.z = pc_z;
-
-                    // currently something so color doesn't show up in rviz
-                    point.r = cur_image_orig.at<cv::Vec3b>(i, j)[0];
-                    point.g = cur_image_orig.at<cv::Vec3b>(i, j)[1];
-                    point.b = cur_image_orig.at<cv::Vec3b>(i, j)[2];
-
-                    cur_pc.push_back(point);
+                    point.x = frame.cloud.x(i, j);
+                    point.y = frame.cloud.y(i, j);
+                    point.z = frame.cloud.z(i, j);
+                    point.r = frame.image.at<cv::Vec3b>(i, j)[0];
+                    point.g = frame.image.at<cv::Vec3b>(i, j)[1];
+                    point.b = frame.image.at<cv::Vec3b>(i, j)[2];
+                    camera_pc.push_back(point);
                 }
             }
         }
+        else {
+            mask_to_point_cloud(mask, proc_depths[c], frame.image, frame.proj_matrix, camera_pc);
+        }
 
-        // Perform downsampling
-        pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr cloudPtr(cur_pc.makeShared());
-        pcl::VoxelGrid<pcl::PointXYZRGB> sor;
-        sor.setInputCloud (cloudPtr);
-        sor.setLeafSize (downsample_leaf_size, downsample_leaf_size, downsample_leaf_size);
-        sor.filter(cur_pc_downsampled);
-
-        MatrixXd X = cur_pc_downsampled.getMatrixXfMap().topRows(3).transpose().cast<double>();
-        ROS_INFO_STREAM("Number of points in downsampled point cloud: " + std::to_string(X.rows()));
-
-        MatrixXd guide_nodes;
-        std::vector<MatrixXd> priors;
-
-        // log time
-        time_diff = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - cur_time_cb).count() / 1000.0;
-        ROS_INFO_STREAM("Before tracking step: " + std::to_string(time_diff) + " ms");
-        pre_proc_total += time_diff;
-        cur_time = std::chrono::high_resolution_clock::now();
-
-        // calculate node visibility
-        // for each node in Y, determine its shortest distance to X
-        // for each point in X, determine its shortest distance to Y
-        std::map<int, double> shortest_node_pt_dists;
-        std::vector<double> shortest_pt_node_dists(X.rows(), 100000.0);
-        for (int m = 0; m < Y.rows(); m ++) {
-            int closest_pt_idx = 0;
-            double shortest_dist = 100000;
-            // loop through all points in X
-            for (int n = 0; n < X.rows(); n ++) {
-                double dist = (Y.row(m) - X.row(n)).norm();
-                // update shortest dist for Y
-                if (dist < shortest_dist) {
-                    closest_pt_idx = n;
-                    shortest_dist = dist;
-                }
-
-                // update shortest dist for X
-                if (dist < shortest_pt_node_dists[n]) {
-                    shortest_pt_node_dists[n] = dist;
-                }
+        if (!frame.camera_to_result.isApprox(Eigen::Isometry3d::Identity())) {
+            pcl::transformPointCloud(camera_pc, camera_pc, frame.camera_to_result.matrix().cast<float>());
+        }
+        cur_pc += camera_pc;
+    }
+    metrics.record_stage(stage_back_projection, stage_start);
+    stage_start = std::chrono::steady_clock::now();
+
+    // Perform downsampling
+    pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr cloudPtr(cur_pc.makeShared());
+    pcl::VoxelGrid<pcl::PointXYZRGB> sor;
+    sor.setInputCloud (cloudPtr);
+    sor.setLeafSize (downsample_leaf_size, downsample_leaf_size, downsample_leaf_size);
+    sor.filter(cur_pc_downsampled);
+
+    MatrixXd X = cur_pc_downsampled.getMatrixXfMap().topRows(3).transpose().cast<double>();
+    metrics.record_stage(stage_downsampling, stage_start);
+    metrics.points.record(X.rows());
+    stage_start = std::chrono::steady_clock::now();
+
+    MatrixXd guide_nodes;
+    std::vector<MatrixXd> priors;
+
+    // calculate node visibility
+    // for each node in Y, determine its shortest distance to X
+    std::vector<double> shortest_node_pt_dists(Y.rows(), 100000.0);
+    for (int m = 0; m < Y.rows(); m ++) {
+        for (int n = 0; n < X.rows(); n ++) {
+            double dist = (Y.row(m) - X.row(n)).norm();
+            if (dist < shortest_node_pt_dists[m]) {
+                shortest_node_pt_dists[m] = dist;
             }
-            shortest_node_pt_dists.insert(std::pair<int, double>(m, shortest_dist));
         }
+    }
 
-        // for current nodes and edges in Y, sort them based on how far away they are from the camera
-        std::vector<double> averaged_node_camera_dists = {};
-        std::vector<int> indices_vec = {};
-        for (int i = 0; i < Y.rows()-1; i ++) {
-            averaged_node_camera_dists.push_back(((Y.row(i) + Y.row(i+1)) / 2).norm());
-            indices_vec.push_back(i);
+    // a node is visible if any camera sees it, and self-occluded if it is hidden behind the DLO in some camera
+    // and no camera sees it
+    node_visibility visibility;
+    visibility.visible.assign(Y.rows(), false);
+    visibility.self_occluded.assign(Y.rows(), false);
+    for (int c = 0; c < num_of_cameras; c ++) {
+        MatrixXd Y_camera = to_camera_frame(Y, frames[c].camera_to_result);
+        node_visibility camera_visibility = compute_node_visibility(Y_camera, frames[c].proj_matrix, proc_depths[c], shortest_node_pt_dists, visibility_threshold, frames[c].pixel_width);
+        for (int i = 0; i < Y.rows(); i ++) {
+            visibility.visible[i] = visibility.visible[i] || camera_visibility.visible[i];
+            visibility.self_occluded[i] = visibility.self_occluded[i] || camera_visibility.self_occluded[i];
         }
-        // sort
-        std::sort(indices_vec.begin(), indices_vec.end(),
-            [&](const int& a, const int& b) {
-                return (averaged_node_camera_dists[a] < averaged_node_camera_dists[b]);
-            }
-        );
-        Mat projected_edges = Mat::zeros(mask.rows, mask.cols, CV_8U);
-
-        // project Y^{t-1} onto projected_edges
-        MatrixXd Y_h = Y.replicate(1, 1);
-        Y_h.conservativeResize(Y_h.rows(), Y_h.cols()+1);
-        Y_h.col(Y_h.cols()-1) = MatrixXd::Ones(Y_h.rows(), 1);
-        MatrixXd image_coords_mask = (proj_matrix * Y_h.transpose()).transpose();
-
-        std::vector<int> visible_nodes = {};
-        std::vector<int> self_occluded_nodes = {};
-        std::vector<int> not_self_occluded_nodes = {};
-        std::vector<int> self_occluding_nodes = {};
-
-        // draw edges closest to the camera first
-        for (int idx : indices_vec) {
-            int col_1 = static_cast<int>(image_coords_mask(idx, 0)/image_coords_mask(idx, 2));
-            int row_1 = static_cast<int>(image_coords_mask(idx, 1)/image_coords_mask(idx, 2));
-
-            int col_2 = static_cast<int>(image_coords_mask(idx+1, 0)/image_coords_mask(idx+1, 2));
-            int row_2 = static_cast<int>(image_coords_mask(idx+1, 1)/image_coords_mask(idx+1, 2));
-
-            // only add to visible nodes if did not overlap with existing edges
-            if (projected_edges.at<uchar>(row_1, col_1) == 0) {
-                if (shortest_node_pt_dists[idx] <= visibility_threshold) {
-                    if (std::find(visible_nodes.begin(), visible_nodes.end(), idx) == visible_nodes.end()) {
-                        visible_nodes.push_back(idx);
-                    }
-                }
-                if (std::find(not_self_occluded_nodes.begin(), not_self_occluded_nodes.end(), idx) == not_self_occluded_nodes.end()) {
-                    not_self_occluded_nodes.push_back(idx);
-                }
-            }
+    }
 
-            // do not consider adjacent nodes directly on top of each other
-            if (projected_edges.at<uchar>(row_2, col_2) == 0) {
-                if (shortest_node_pt_dists[idx+1] <= visibility_threshold) {
-                    if (std::find(visible_nodes.begin(), visible_nodes.end(), idx+1) == visible_nodes.end()) {
-                        visible_nodes.push_back(idx+1);
-                    }
-                }
-                if (std::find(not_self_occluded_nodes.begin(), not_self_occluded_nodes.end(), idx+1) == not_self_occluded_nodes.end()) {
-                    not_self_occluded_nodes.push_back(idx+1);
-                }
-            }
+    std::vector<int> visible_nodes = {};
+    std::vector<int> self_occluded_nodes = {};
+    for (int i = 0; i < Y.rows(); i ++) {
+        if (visibility.visible[i]) {
+            visible_nodes.push_back(i);
+            visibility.self_occluded[i] = false;
+        }
+        if (visibility.self_occluded[i]) {
+            self_occluded_nodes.push_back(i);
+        }
+    }
 
-            // add edges for checking overlap with upcoming nodes
-            cv::line(projected_edges, cv::Point(col_1, row_1), cv::Point(col_2, row_2), cv::Scalar(255, 255, 255), dlo_pixel_width);
+    // extend visible nodes so that gaps as small as 2 to 3 nodes are filled
+    std::vector<int> visible_nodes_extended = extend_visible_nodes(visible_nodes, dlo.converted_node_coord, d_vis);
+    metrics.record_stage(stage_visibility, stage_start);
+
+    // step tracker
+    // with no node visible (DLO out of view or fully occluded) or no points there is nothing to register,
+    // so the step is skipped and counted as unhealthy with a visible fraction of 0
+    if (visible_nodes.empty() || X.rows() == 0) {
+        dlo.tracker.skip_step();
+    }
+    else {
+        dlo.tracker.tracking_step(X, visible_nodes, visible_nodes_extended, frames[0].proj_matrix, masks[0].rows, masks[0].cols);
+
+        step_stats stats = dlo.tracker.get_step_stats();
+        metrics.stage_latencies[stage_pre_proc_em].record(stats.pre_proc_em * 1000);
+        metrics.stage_latencies[stage_priors].record(stats.priors * 1000);
+        metrics.stage_latencies[stage_main_em].record(stats.main_em * 1000);
+        metrics.pre_proc_iterations.record(stats.pre_proc_iterations);
+        metrics.main_iterations.record(stats.main_iterations);
+        if (stats.precision_drift >= 0) {
+            metrics.precision_drift.record(stats.precision_drift * 1e6);
         }
-        
-        // obtain self-occluded nodes
-        for (int i = 0; i < Y.rows(); i ++) {
-            if (std::find(not_self_occluded_nodes.begin(), not_self_occluded_nodes.end(), i) == not_self_occluded_nodes.end()) {
-                self_occluded_nodes.push_back(i);
+    }
+    Y = dlo.tracker.get_tracking_result();
+    guide_nodes = dlo.tracker.get_guide_nodes();
+    priors = dlo.tracker.get_correspondence_pairs();
+
+    // an unhealthy step keeps the last healthy results; enough of them in a row and the DLO is re-initialized
+    tracking_health health = dlo.tracker.get_health();
+    if (!health.healthy) {
+        metrics.unhealthy_steps += 1;
+        ROS_WARN_STREAM(dlo.name + ": unhealthy tracking step (sigma2 " + std::to_string(health.sigma2) + ", visible fraction " + std::to_string(health.visible_fraction) + 
+                        (health.mean_point_dist >= 0 ? ", mean point distance " + std::to_string(health.mean_point_dist) + " m" : "") +
+                        (health.converged ? "" : ", not converged") + ")");
+        if (health.lost) {
+            ROS_ERROR_STREAM(dlo.name + ": tracking lost, re-initializing");
+            dlo.lost = true;
+            if (dlo.predictor) {
+                dlo.predictor->reset();
             }
+            dlo.lost_at = std::chrono::steady_clock::now();
+            dlo.lost_frames = 0;
         }
+        republish_last_results(dlo, stamp);
+        return;
+    }
 
-        // sort visible nodes to preserve the original connectivity
-        std::sort(visible_nodes.begin(), visible_nodes.end());
+    // nodes drawn as visible
+    for (int i = 0; i < Y.rows(); i ++) {
+        dlo.vis[i] = !visibility.self_occluded[i];
+    }
 
-        // minor mid-section occlusion is usually fine
-        // extend visible nodes so that gaps as small as 2 to 3 nodes are filled
-        std::vector<int> visible_nodes_extended = {};
-        for (int i = 0; i < visible_nodes.size()-1; i ++) {
-            visible_nodes_extended.push_back(visible_nodes[i]);
-            // extend visible nodes
-            if (fabs(converted_node_coord[visible_nodes[i+1]] - converted_node_coord[visible_nodes[i]]) <= d_vis) {
-                for (int j = 1; j < visible_nodes[i+1] - visible_nodes[i]; j ++) {
-                    visible_nodes_extended.push_back(visible_nodes[i] + j);
-                }
-            }
+    // publish the results, shared memory first. the result messages are filled in place straight from Y
+    stage_start = std::chrono::steady_clock::now();
+    if (dlo.shm_writer) {
+        if (Y.rows() > shm_max_nodes) {
+            ROS_WARN_STREAM_ONCE(dlo.name + ": " + std::to_string(Y.rows()) + " nodes, only the first shm_max_nodes are written to shared memory");
         }
-        visible_nodes_extended.push_back(visible_nodes[visible_nodes.size()-1]);
+        dlo.shm_writer->write(stamp.toNSec(), Y.data(), dlo.vis, Y.rows());
+    }
+    dlo.tracking_result_pub.publish(stamp, result_frame_id, Y, dlo.vis, dlo.tracker.get_sigma2(), stats.pre_proc_iterations, stats.main_iterations,
+                                    stats.pre_proc_em, stats.priors, stats.main_em);
+
+    MatrixXd2MarkerList(dlo.result_markers, Y, result_frame_id, "node_results", {0.0, 149.0/255.0, 203.0/255.0, 1.0}, {0.0, 149.0/255.0, 203.0/255.0, 1.0}, 0.01, 0.005, dlo.vis, {1.0, 0.0, 0.0, 1.0}, {1.0, 0.0, 0.0, 1.0});
+    MatrixXd2MarkerList(dlo.guide_nodes_markers, guide_nodes, result_frame_id, "guide_node_results", {0.0, 0.0, 0.0, 0.5}, {0.0, 0.0, 1.0, 0.5});
+    dlo.results_pub.publish(dlo.result_markers);
+    dlo.guide_nodes_pub.publish(dlo.guide_nodes_markers);
+    if (dlo.corr_priors_pub.getNumSubscribers() > 0) {
+        dlo.corr_priors_pub.publish(MatrixXd2MarkerArray(priors, result_frame_id, "corr_prior_results", {0.0, 0.0, 0.0, 0.5}, {1.0, 0.0, 0.0, 0.5}));
+    }
 
-        // store Y_0 for post processing
-        MatrixXd Y_0 = Y.replicate(1, 1);
-        
-        // step tracker
-        tracker.tracking_step(X, visible_nodes, visible_nodes_extended, proj_matrix, mask.rows, mask.cols);
-        Y = tracker.get_tracking_result();
-        guide_nodes = tracker.get_guide_nodes();
-        priors = tracker.get_correspondence_pairs();
-
-        // log time
-        time_diff = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - cur_time).count() / 1000.0;
-        ROS_INFO_STREAM("Tracking step: " + std::to_string(time_diff) + " ms");
-        algo_total += time_diff;
-        cur_time = std::chrono::high_resolution_clock::now();
-
-        // projection and pub image
-        averaged_node_camera_dists = {};
-        indices_vec = {};
-        for (int i = 0; i < Y.rows()-1; i ++) {
-            averaged_node_camera_dists.push_back(((Y.row(i) + Y.row(i+1)) / 2).norm());
-            indices_vec.push_back(i);
-        }
-        // sort
-        std::sort(indices_vec.begin(), indices_vec.end(),
-            [&](const int& a, const int& b) {
-                return (averaged_node_camera_dists[a] < averaged_node_camera_dists[b]);
-            }
-        );
-        std::reverse(indices_vec.begin(), indices_vec.end());
+    // point clouds of the results (for eval) and of the self-occluded nodes
+    MatrixXd self_occluded_Y(self_occluded_nodes.size(), 3);
+    for (int j = 0; j < self_occluded_nodes.size(); j ++) {
+        self_occluded_Y.row(j) = Y.row(self_occluded_nodes[j]);
+    }
+    MatrixXd2PointCloud2(dlo.result_pc_msg, Y);
+    MatrixXd2PointCloud2(dlo.self_occluded_pc_msg, self_occluded_Y);
+    dlo.result_pc_msg.header.frame_id = result_frame_id;
+    dlo.result_pc_msg.header.stamp = stamp;
+    dlo.self_occluded_pc_msg.header.frame_id = result_frame_id;
+    dlo.self_occluded_pc_msg.header.stamp = stamp;
+    dlo.result_pc_pub.publish(dlo.result_pc_msg);
+    dlo.self_occluded_pc_pub.publish(dlo.self_occluded_pc_msg);
+    dlo.has_results = true;
+    if (dlo.predictor) {
+        dlo.predictor->add_estimate(stamp, Y, dlo.tracker.get_sigma2());
+    }
+
+    // filtered point cloud
+    if (dlo.pc_pub.getNumSubscribers() > 0) {
+        pcl::PCLPointCloud2 cur_pc_pointcloud2;
+        pcl::toPCLPointCloud2(cur_pc_downsampled, cur_pc_pointcloud2);
+        sensor_msgs::PointCloud2 cur_pc_msg;
+        pcl_conversions::moveFromPCL(cur_pc_pointcloud2, cur_pc_msg);
+        cur_pc_msg.header.frame_id = result_frame_id;
+        dlo.pc_pub.publish(cur_pc_msg);
+    }
+    metrics.record_stage(stage_publish, stage_start);
+
+    // last healthy results
+    dlo.good_Y = Y;
+    dlo.good_vis = dlo.vis;
+    dlo.good_sigma2 = dlo.tracker.get_sigma2();
+
+    // reference for static-scene skipping (the depths may point into the message buffers)
+    if (static_skip_threshold > 0) {
+        dlo.ref_masks.assign(cameras.size(), Mat());
+        dlo.ref_depths.assign(cameras.size(), Mat());
+        for (int c = 0; c < num_of_cameras; c ++) {
+            dlo.ref_masks[frames[c].camera] = masks[c];
+            dlo.ref_depths[frames[c].camera] = proc_depths[c].clone();
+        }
+    }
+}
 
-        MatrixXd nodes_h = Y.replicate(1, 1);
-        nodes_h.conservativeResize(nodes_h.rows(), nodes_h.cols()+1);
-        nodes_h.col(nodes_h.cols()-1) = MatrixXd::Ones(nodes_h.rows(), 1);
-        MatrixXd image_coords = (proj_matrix * nodes_h.transpose()).transpose();
+// draws the nodes of Y, far edges first, in blue if visible and in red if self-occluded
+void draw_dlo (Mat& tracking_img, const MatrixXd& Y, const std::vector<bool>& vis, const MatrixXd& proj, int line_width, int node_radius) {
+    // projection and pub image
+    std::vector<double> averaged_node_camera_dists = {};
+    std::vector<int> indices_vec = {};
+    for (int i = 0; i < Y.rows()-1; i ++) {
+        averaged_node_camera_dists.push_back(((Y.row(i) + Y.row(i+1)) / 2).norm());
+        indices_vec.push_back(i);
+    }
+    // sort
+    std::sort(indices_vec.begin(), indices_vec.end(),
+        [&](const int& a, const int& b) {
+            return (averaged_node_camera_dists[a] < averaged_node_camera_dists[b]);
+        }
+    );
+    std::reverse(indices_vec.begin(), indices_vec.end());
 
-        Mat tracking_img;
-        tracking_img = 0.5*cur_image_orig + 0.5*cur_image;
+    MatrixXd nodes_h = Y.replicate(1, 1);
+    nodes_h.conservativeResize(nodes_h.rows(), nodes_h.cols()+1);
+    nodes_h.col(nodes_h.cols()-1) = MatrixXd::Ones(nodes_h.rows(), 1);
+    MatrixXd image_coords = (proj * nodes_h.transpose()).transpose();
 
-        // std::vector<int> vis = visible_nodes;
-        std::vector<int> vis = not_self_occluded_nodes;
+    // draw points
+    for (int idx : indices_vec) {
 
-        // draw points
-        for (int idx : indices_vec) {
+        int x = static_cast<int>(image_coords(idx, 0)/image_coords(idx, 2));
+        int y = static_cast<int>(image_coords(idx, 1)/image_coords(idx, 2));
 
-            int x = static_cast<int>(image_coords(idx, 0)/image_coords(idx, 2));
-            int y = static_cast<int>(image_coords(idx, 1)/image_coords(idx, 2));
+        cv::Scalar point_color;
+        cv::Scalar line_color;
 
-            cv::Scalar point_color;
-            cv::Scalar line_color;
+        if (vis[idx]) {
+            point_color = cv::Scalar(203, 149, 0);
+            line_color = cv::Scalar(203, 149, 0);
+        }
+        else {
+            point_color = cv::Scalar(0, 0, 255);
 
-            if (std::find(vis.begin(), vis.end(), idx) != vis.end()) {
-                point_color = cv::Scalar(203, 149, 0);
-                line_color = cv::Scalar(203, 149, 0);
+            // line is colored red only when both bounding nodes are not visible
+            if (!vis[idx+1]) {
+                line_color = cv::Scalar(0, 0, 255);
             }
             else {
-                point_color = cv::Scalar(0, 0, 255);
-
-                // line is colored red only when both bounding nodes are not visible
-                if (std::find(vis.begin(), vis.end(), idx+1) == vis.end()) {
-                    line_color = cv::Scalar(0, 0, 255);
-                }
-                else {
-                    line_color = cv::Scalar(203, 149, 0);
-                }
+                line_color = cv::Scalar(203, 149, 0);
             }
+        }
 
-            cv::line(tracking_img, cv::Point(x, y),
-                                   cv::Point(static_cast<int>(image_coords(idx+1, 0)/image_coords(idx+1, 2)), 
-                                             static_cast<int>(image_coords(idx+1, 1)/image_coords(idx+1, 2))),
-                                   line_color, 5);
+        cv::line(tracking_img, cv::Point(x, y),
+                               cv::Point(static_cast<int>(image_coords(idx+1, 0)/image_coords(idx+1, 2)), 
+                                         static_cast<int>(image_coords(idx+1, 1)/image_coords(idx+1, 2))),
+                               line_color, line_width);
 
-            cv::circle(tracking_img, cv::Point(x, y), 7, point_color, -1);
+        cv::circle(tracking_img, cv::Point(x, y), node_radius, point_color, -1);
 
-            if (std::find(vis.begin(), vis.end(), idx+1) != vis.end()) {
-                point_color = cv::Scalar(203, 149, 0);
-            }
-            else {
-                point_color = cv::Scalar(0, 0, 255);
+        if (vis[idx+1]) {
+            point_color = cv::Scalar(203, 149, 0);
+        }
+        else {
+            point_color = cv::Scalar(0, 0, 255);
+        }
+        cv::circle(tracking_img, cv::Point(static_cast<int>(image_coords(idx+1, 0)/image_coords(idx+1, 2)), 
+                                            static_cast<int>(image_coords(idx+1, 1)/image_coords(idx+1, 2))),
+                                            node_radius, point_color, -1);
+    }
+}
+
+// state of the cameras and of every DLO's last healthy result
+tracker_checkpoint take_checkpoint () {
+    tracker_checkpoint checkpoint;
+    checkpoint.stamp = ros::WallTime::now().toSec();
+    checkpoint.result_frame_id = result_frame_id;
+
+    for (const std::unique_ptr<camera_input>& camera : cameras) {
+        if (!camera->received_proj_matrix) {
+            break;
+        }
+        checkpoint.cameras.push_back({camera->camera_info_topic, camera->frame_id, camera->proj_matrix, camera->received_extrinsics, camera->camera_to_result});
+    }
+
+    for (const std::unique_ptr<dlo_track>& dlo : dlos) {
+        if (dlo->initialized && !dlo->restored) {
+            checkpoint.dlos.push_back({dlo->name, dlo->good_Y, dlo->good_sigma2, dlo->converted_node_coord, dlo->good_vis});
+        }
+    }
+    return checkpoint;
+}
+
+// restores the camera intrinsics and extrinsics and the DLOs from a recent checkpoint. the restored DLOs are
+// checked against the first frame before they are tracked
+void restore_checkpoint () {
+    tracker_checkpoint checkpoint;
+    try {
+        checkpoint = read_checkpoint(checkpoint_path);
+    }
+    catch (const std::invalid_argument& e) {
+        ROS_INFO_STREAM(std::string("Not restoring a checkpoint: ") + e.what());
+        return;
+    }
+
+    double age = ros::WallTime::now().toSec() - checkpoint.stamp;
+    if (age > checkpoint_max_age) {
+        ROS_INFO_STREAM("Not restoring the checkpoint from " + std::to_string(age) + " s ago");
+        return;
+    }
+    if (checkpoint.result_frame_id != result_frame_id) {
+        ROS_WARN_STREAM("Not restoring the checkpoint in frame " + checkpoint.result_frame_id + " (results are in " + result_frame_id + ")");
+        return;
+    }
+
+    // cameras match by index and camera_info topic; camera_info still overwrites the restored intrinsics
+    for (int c = 0; c < std::min(cameras.size(), checkpoint.cameras.size()); c ++) {
+        const camera_state& state = checkpoint.cameras[c];
+        camera_input& camera = *cameras[c];
+        if (state.camera_info_topic != camera.camera_info_topic) {
+            break;
+        }
+        camera.proj_matrix = state.proj_matrix;
+        camera.frame_id = state.frame_id;
+        camera.received_proj_matrix = true;
+        if (state.has_extrinsics) {
+            camera.camera_to_result = state.camera_to_result;
+            camera.received_extrinsics = true;
+        }
+    }
+
+    // DLOs match by name
+    for (const dlo_state& state : checkpoint.dlos) {
+        for (std::unique_ptr<dlo_track>& dlo : dlos) {
+            if (dlo->name != state.name) {
+                continue;
             }
-            cv::circle(tracking_img, cv::Point(static_cast<int>(image_coords(idx+1, 0)/image_coords(idx+1, 2)), 
-                                                static_cast<int>(image_coords(idx+1, 1)/image_coords(idx+1, 2))),
-                                                7, point_color, -1);
+            dlo->init_nodes = state.Y;
+            initialize_dlo(*dlo, state.geodesic_coord);
+            dlo->tracker.set_sigma2(state.sigma2);
+            dlo->vis = state.vis;
+            dlo->good_vis = state.vis;
+            dlo->good_sigma2 = state.sigma2;
+            dlo->restored = true;
+            ROS_INFO_STREAM(dlo->name + ": restored " + std::to_string(state.Y.rows()) + " nodes from the checkpoint from " + std::to_string(age) + " s ago");
         }
+    }
+}
 
-        // add text
-        if (updated_opencv_mask && simulated_occlusion) {
-            cv::putText(tracking_img, "occlusion", cv::Point(occlusion_corner_j, occlusion_corner_i-10), cv::FONT_HERSHEY_DUPLEX, 1.2, cv::Scalar(0, 0, 240), 2);
+// a restored DLO is kept if at least checkpoint_min_overlap of its nodes project onto its (dilated) mask in the
+// primary camera's frame. otherwise it is initialized again like a new DLO
+void check_restored_dlo (dlo_track& dlo, const Mat& image, const camera_input& camera, const dlo_classifier& classifier, int dlo_class) {
+    Mat mask;
+    classifier.lut.classify(image, mask, dlo_class);
+    cv::dilate(mask, mask, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(2*dlo_pixel_width+1, 2*dlo_pixel_width+1)));
+
+    MatrixXd Y_camera = to_camera_frame(dlo.Y, camera.camera_to_result);
+    MatrixXd image_coords = (camera.proj_matrix.leftCols(3) * Y_camera.transpose()).colwise() + camera.proj_matrix.col(3);
+    int on_mask = 0;
+    for (int i = 0; i < Y_camera.rows(); i ++) {
+        if (image_coords(2, i) <= 0) {
+            continue;
         }
+        int col = static_cast<int>(image_coords(0, i) / image_coords(2, i));
+        int row = static_cast<int>(image_coords(1, i) / image_coords(2, i));
+        if (col >= 0 && col < mask.cols && row >= 0 && row < mask.rows && mask.at<uchar>(row, col) != 0) {
+            on_mask += 1;
+        }
+    }
 
-        // publish image
-        tracking_img_msg = cv_bridge::CvImage(std_msgs::Header(), "bgr8", tracking_img).toImageMsg();
+    double overlap = static_cast<double>(on_mask) / Y_camera.rows();
+    if (overlap >= checkpoint_min_overlap) {
+        dlo.restored = false;
+        dlo.received_init_nodes = true;
+        dlo.init_nodes_sub.shutdown();
+        ROS_INFO_STREAM(dlo.name + ": resuming from the checkpoint (" + std::to_string(on_mask) + " of " + std::to_string(Y_camera.rows()) + " nodes on the mask)");
+    }
+    else {
+        dlo.restored = false;
+        dlo.initialized = false;
+        dlo.received_init_nodes = false;
+        ROS_WARN_STREAM(dlo.name + ": the checkpoint does not match the frame (" + std::to_string(on_mask) + " of " + std::to_string(Y_camera.rows()) + " nodes on the mask), initializing again");
+    }
+}
+
+// inputs holds one frame per camera, the primary camera's first. a secondary camera without a frame close enough
+// in time has a null image and is left out of this frame. depth is the aligned depth image, or null if cloud holds
+// a registered organized point cloud instead
+sensor_msgs::ImagePtr Callback(const std::vector<input_frame>& inputs) {
+    TRACE_SCOPE("Callback");
+    metrics.record_latency(metrics.start_latency, inputs[0].image->header.stamp);
 
-        // publish the results as a marker array
-        visualization_msgs::MarkerArray results = MatrixXd2MarkerArray(Y, result_frame_id, "node_results", {0.0, 149.0/255.0, 203.0/255.0, 1.0}, {0.0, 149.0/255.0, 203.0/255.0, 1.0}, 0.01, 0.005, vis, {1.0, 0.0, 0.0, 1.0}, {1.0, 0.0, 0.0, 1.0});
-        // visualization_msgs::MarkerArray results = MatrixXd2MarkerArray(Y, result_frame_id, "node_results", {1.0, 150.0/255.0, 0.0, 1.0}, {0.0, 1.0, 0.0, 1.0}, 0.01, 0.005);
-        visualization_msgs::MarkerArray guide_nodes_results = MatrixXd2MarkerArray(guide_nodes, result_frame_id, "guide_node_results", {0.0, 0.0, 0.0, 0.5}, {0.0, 0.0, 1.0, 0.5});
-        visualization_msgs::MarkerArray corr_priors_results = MatrixXd2MarkerArray(priors, result_frame_id, "corr_prior_results", {0.0, 0.0, 0.0, 0.5}, {1.0, 0.0, 0.0, 0.5});
+    Mat cur_image_orig = cv_bridge::toCvShare(inputs[0].image, "bgr8")->image;
 
-        // convert to pointcloud2 for eval
-        pcl::PointCloud<pcl::PointXYZ> trackdlo_pc;
-        for (int i = 0; i < Y.rows(); i++) {
-            pcl::PointXYZ temp;
-            temp.x = Y(i, 0);
-            temp.y = Y(i, 1);
-            temp.z = Y(i, 2);
-            trackdlo_pc.points.push_back(temp);
+    // will get overwritten later if intialized
+    sensor_msgs::ImagePtr tracking_img_msg = cv_bridge::CvImage(std_msgs::Header(), "bgr8", cur_image_orig).toImageMsg();
+
+    // cameras with a frame, intrinsics and extrinsics
+    std::vector<int> active_cameras = {};
+    for (int c = 0; c < inputs.size(); c ++) {
+        if (inputs[c].image && update_extrinsics(*cameras[c])) {
+            active_cameras.push_back(c);
         }
+    }
+    if (active_cameras.empty() || active_cameras[0] != 0) {
+        return tracking_img_msg;
+    }
 
-        // get self-occluded nodes
-        pcl::PointCloud<pcl::PointXYZ> self_occluded_pc;
-        for (auto i : self_occluded_nodes) {
-            pcl::PointXYZ temp;
-            temp.x = Y(i, 0);
-            temp.y = Y(i, 1);
-            temp.z = Y(i, 2);
-            self_occluded_pc.points.push_back(temp);
+    std::shared_ptr<const dlo_classifier> classifier = std::atomic_load(&dlo_lut);
+
+    // DLOs restored from a checkpoint are checked against this frame first
+    for (std::unique_ptr<dlo_track>& dlo : dlos) {
+        if (dlo->restored) {
+            auto it = std::find(classifier->names.begin(), classifier->names.end(), dlo->name);
+            if (it != classifier->names.end()) {
+                check_restored_dlo(*dlo, cur_image_orig, *cameras[0], *classifier, it - classifier->names.begin());
+            }
         }
+    }
 
-        // publish filtered point cloud
-        pcl::PCLPointCloud2 cur_pc_pointcloud2;
-        pcl::PCLPointCloud2 result_pc_poincloud2;
-        pcl::PCLPointCloud2 self_occluded_pc_poincloud2;
-        pcl::toPCLPointCloud2(cur_pc_downsampled, cur_pc_pointcloud2);
-        pcl::toPCLPointCloud2(trackdlo_pc, result_pc_poincloud2);
-        pcl::toPCLPointCloud2(self_occluded_pc, self_occluded_pc_poincloud2);
+    // DLOs initialized before this frame are tracked in it. without init nodes from the init_nodes topic, the
+    // others are initialized from this frame and tracked from the next one
+    std::vector<dlo_track*> tracked_dlos = {};
+    std::vector<dlo_track*> uninitialized_dlos = {};
+    for (std::unique_ptr<dlo_track>& dlo : dlos) {
+        if (dlo->lost) {
+            reinitialize_lost_dlo(*dlo);
+        }
+        if (dlo->initialized) {
+            tracked_dlos.push_back(dlo.get());
+        }
+        else if (dlo->received_init_nodes) {
+            initialize_dlo(*dlo);
+        }
+        else if (native_init) {
+            uninitialized_dlos.push_back(dlo.get());
+        }
+    }
+    if (tracked_dlos.empty() && uninitialized_dlos.empty()) {
+        return tracking_img_msg;
+    }
+    int num_of_tracked_dlos = tracked_dlos.size();
+    tracked_dlos.insert(tracked_dlos.end(), uninitialized_dlos.begin(), uninitialized_dlos.end());
+
+    // color classes of the tracked DLOs, then of the ones to initialize
+    std::vector<dlo_track*> classified_dlos = {};
+    std::vector<int> classes = {};
+    int num_of_classified_tracked_dlos = 0;
+    for (int k = 0; k < tracked_dlos.size(); k ++) {
+        dlo_track* dlo = tracked_dlos[k];
+        auto it = std::find(classifier->names.begin(), classifier->names.end(), dlo->name);
+        if (it == classifier->names.end()) {
+            ROS_ERROR_STREAM("The color profile has no DLO named " + dlo->name);
+            continue;
+        }
+        classified_dlos.push_back(dlo);
+        classes.push_back(it - classifier->names.begin());
+        num_of_classified_tracked_dlos += (k < num_of_tracked_dlos);
+    }
 
-        // Convert to ROS data type
-        sensor_msgs::PointCloud2 cur_pc_msg;
-        sensor_msgs::PointCloud2 result_pc_msg;
-        sensor_msgs::PointCloud2 self_occluded_pc_msg;
-        pcl_conversions::moveFromPCL(cur_pc_pointcloud2, cur_pc_msg);
-        pcl_conversions::moveFromPCL(result_pc_poincloud2, result_pc_msg);
-        pcl_conversions::moveFromPCL(self_occluded_pc_poincloud2, self_occluded_pc_msg);
+    // the cameras are independent until their points are merged, so they are pre-processed in parallel
+    std::vector<camera_frame> frames(active_cameras.size());
+    std::vector<char> prepared(active_cameras.size(), false);
+    run_parallel(active_cameras.size(), [&](int i) {
+        int c = active_cameras[i];
+        prepared[i] = prepare_camera_frame(inputs[c], *cameras[c], *classifier, classes, frames[i]);
+        frames[i].camera = c;
+    });
+    if (!prepared[0]) {
+        return tracking_img_msg;
+    }
+    for (int i = frames.size()-1; i > 0; i --) {
+        if (!prepared[i]) {
+            frames.erase(frames.begin() + i);
+        }
+    }
 
-        // for evaluation sync
-        cur_pc_msg.header.frame_id = result_frame_id;
-        result_pc_msg.header.frame_id = result_frame_id;
-        result_pc_msg.header.stamp = image_msg->header.stamp;
-        self_occluded_pc_msg.header.frame_id = result_frame_id;
-        self_occluded_pc_msg.header.stamp = image_msg->header.stamp;
+    // initialize the remaining DLOs from the primary camera's frame
+    if (num_of_classified_tracked_dlos < classified_dlos.size()) {
+        Mat full_res_image = cv_bridge::toCvShare(inputs[0].image, "bgr8")->image;
+        run_parallel(classified_dlos.size() - num_of_classified_tracked_dlos, [&](int i) {
+            int k = num_of_classified_tracked_dlos + i;
+            initialize_dlo_from_frame(*classified_dlos[k], frames[0].color_masks[k], full_res_image, frames[0], *cameras[0], *classifier, classes[k]);
+        });
+
+        classified_dlos.resize(num_of_classified_tracked_dlos);
+        if (classified_dlos.empty()) {
+            return tracking_img_msg;
+        }
+    }
+
+    // update cur image for visualization. the simulated occlusion applies to the primary camera
+    camera_frame& primary = frames[0];
+    Mat cur_image;
+    if (updated_opencv_mask) {
+        cv::cvtColor(occlusion_mask, primary.occlusion_mask_gray, cv::COLOR_BGR2GRAY);
+        cv::bitwise_and(cur_image_orig, occlusion_mask, cur_image);
+    }
+    else {
+        cur_image_orig.copyTo(cur_image);
+    }
 
-        results_pub.publish(results);
-        guide_nodes_pub.publish(guide_nodes_results);
-        corr_priors_pub.publish(corr_priors_results);
-        pc_pub.publish(cur_pc_msg);
-        result_pc_pub.publish(result_pc_msg);
-        self_occluded_pc_pub.publish(self_occluded_pc_msg);
+    Mat occlusion_mask_gray = primary.occlusion_mask_gray;
+    if (processing_scale > 1) {
+        cv::Size proc_size = primary.image.size();
+        cv::Rect blocks(0, 0, proc_size.width*processing_scale, proc_size.height*processing_scale);
+        cv::resize(cur_image(blocks), cur_image, proc_size, 0, 0, cv::INTER_AREA);
+        if (updated_opencv_mask) {
+            cv::resize(primary.occlusion_mask_gray(blocks), occlusion_mask_gray, proc_size, 0, 0, cv::INTER_NEAREST);
+        }
+    }
 
-        // reset all guide nodes
-        for (int i = 0; i < guide_nodes_results.markers.size(); i ++) {
-            guide_nodes_results.markers[i].action = visualization_msgs::Marker::DELETEALL;
+    // first occluded pixel of the simulated occlusion, for the text label (visualization)
+    bool simulated_occlusion = false;
+    int occlusion_corner_i = -1;
+    int occlusion_corner_j = -1;
+    if (updated_opencv_mask) {
+        std::vector<cv::Point> occluded_pixels;
+        cv::findNonZero(occlusion_mask_gray == 0, occluded_pixels);
+        if (!occluded_pixels.empty()) {
+            occlusion_corner_i = occluded_pixels[0].y;
+            occlusion_corner_j = occluded_pixels[0].x;
+            simulated_occlusion = true;
         }
-        for (int i = 0; i < corr_priors_results.markers.size(); i ++) {
-            corr_priors_results.markers[i].action = visualization_msgs::Marker::DELETEALL;
+    }
+
+    // the DLOs are independent from here on, so they are tracked in parallel
+    run_parallel(classified_dlos.size(), [&](int k) {
+        track_dlo(*classified_dlos[k], k, frames);
+    });
+    metrics.record_latency(metrics.result_latency, primary.stamp);
+
+    // re-initialize lost DLOs from this frame in the background
+    for (int k = 0; k < classified_dlos.size(); k ++) {
+        if (classified_dlos[k]->lost) {
+            start_reinitialization(*classified_dlos[k], frames[0].color_masks[k], cur_image_orig, frames[0], *cameras[0], classifier, classes[k]);
         }
+    }
 
-        // log time
-        time_diff = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - cur_time).count() / 1000.0;
-        ROS_INFO_STREAM("Pub data: " + std::to_string(time_diff) + " ms");
-        pub_data_total += time_diff;
+    std::chrono::steady_clock::time_point render_start = std::chrono::steady_clock::now();
+    Mat tracking_img;
+    tracking_img = 0.5*primary.image + 0.5*cur_image;
 
-        frames += 1;
+    // drawing sizes follow the processing resolution
+    int line_width = std::max(1, 5 / processing_scale);
+    int node_radius = std::max(2, 7 / processing_scale);
+    for (dlo_track* dlo : classified_dlos) {
+        draw_dlo(tracking_img, to_camera_frame(dlo->good_Y, primary.camera_to_result), dlo->good_vis, primary.proj_matrix, line_width, node_radius);
+    }
 
-        ROS_INFO_STREAM("Avg before tracking step: " + std::to_string(pre_proc_total / frames) + " ms");
-        ROS_INFO_STREAM("Avg tracking step: " + std::to_string(algo_total / frames) + " ms");
-        ROS_INFO_STREAM("Avg pub data: " + std::to_string(pub_data_total / frames) + " ms");
-        ROS_INFO_STREAM("Avg total: " + std::to_string((pre_proc_total + algo_total + pub_data_total) / frames) + " ms");
+    // add text
+    if (updated_opencv_mask && simulated_occlusion) {
+        cv::putText(tracking_img, "occlusion", cv::Point(occlusion_corner_j, occlusion_corner_i-10/processing_scale), cv::FONT_HERSHEY_DUPLEX, 1.2/processing_scale, cv::Scalar(0, 0, 240), std::max(1, 2/processing_scale));
     }
-        
+
+    // publish image
+    tracking_img_msg = cv_bridge::CvImage(std_msgs::Header(), "bgr8", tracking_img).toImageMsg();
+    metrics.record_stage(stage_render, render_start);
+
     return tracking_img_msg;
 }
 
+// writes the recent trace events of every thread to a new file in trace_dir. returns its path
+std::string write_trace () {
+    std::string path = trace_dir + "/trackdlo_trace_" + std::to_string(static_cast<long long>(ros::WallTime::now().toSec())) + ".json";
+    int num_of_events = dump_trace(path, trace_window);
+    ROS_INFO_STREAM("Wrote " + std::to_string(num_of_events) + " trace events of the last " + std::to_string(trace_window) + " s to " + path);
+    return path;
+}
+
+bool dump_trace_service (std_srvs::Trigger::Request& req, std_srvs::Trigger::Response& res) {
+    try {
+        res.message = write_trace();
+        res.success = true;
+    }
+    catch (const std::runtime_error& e) {
+        res.message = e.what();
+        res.success = false;
+    }
+    return true;
+}
+
+// only sets a flag, the trace is written by the tracking loop
+void request_trace (int signal) {
+    trace_requested = true;
+}
+
+// builds one classifier holding every DLO of the color profile as its own class. throws std::invalid_argument on
+// a bad profile or if it does not have color_profile_dlo
+void load_dlo_lut () {
+    std::vector<dlo_colors> profile = load_color_profile(color_profile);
+
+    std::vector<std::vector<color_range>> classes = {};
+    std::vector<std::vector<color_range>> tip_classes = {};
+    std::vector<bool> has_tip = {};
+    std::vector<std::string> names = {};
+    for (const dlo_colors& dlo : profile) {
+        classes.push_back(dlo.ranges);
+        names.push_back(dlo.name);
+
+        std::vector<color_range> tip_ranges = {};
+        for (const color_range& range : dlo.ranges) {
+            if (range.name == "tip") {
+                tip_ranges.push_back(range);
+            }
+        }
+        tip_classes.push_back(tip_ranges);
+        has_tip.push_back(!tip_ranges.empty());
+    }
+    if (color_profile_dlo != "" && std::find(names.begin(), names.end(), color_profile_dlo) == names.end()) {
+        throw std::invalid_argument("Color profile " + color_profile + " has no DLO named " + color_profile_dlo);
+    }
+
+    // the tip table is only built if some DLO has a tip
+    color_lut tip_lut;
+    if (std::find(has_tip.begin(), has_tip.end(), true) != has_tip.end()) {
+        tip_lut = color_lut(tip_classes);
+    }
+
+    std::shared_ptr<const dlo_classifier> classifier = std::make_shared<const dlo_classifier>(dlo_classifier{color_lut(classes), names, std::move(tip_lut), has_tip});
+    std::atomic_store(&dlo_lut, classifier);
+    ROS_INFO_STREAM("Loaded color profile " + color_profile + " (" + std::to_string(names.size()) + " DLOs)");
+}
+
+// reloads the color profile in the background when the file changes on disk; tracking keeps using the previous
+// classifier until the new one is built
+void check_color_profile (const ros::TimerEvent&) {
+    struct stat file_stat;
+    if (stat(color_profile.c_str(), &file_stat) != 0 || file_stat.st_mtime == color_profile_mtime) {
+        return;
+    }
+    if (rebuilding_lut.exchange(true)) {
+        return;
+    }
+    color_profile_mtime = file_stat.st_mtime;
+
+    std::thread([]() {
+        try {
+            load_dlo_lut();
+        }
+        catch (const std::exception& e) {
+            ROS_ERROR_STREAM(std::string("Keeping the current color profile: ") + e.what());
+        }
+        rebuilding_lut = false;
+    }).detach();
+}
+
 int main(int argc, char **argv) {
     ros::init(argc, argv, "tracker_node");
     ros::NodeHandle nh;
@@ -542,11 +1357,81 @@ int main(int argc, char **argv) {
 
     nh.getParam("/trackdlo/multi_color_dlo", multi_color_dlo);
     nh.getParam("/trackdlo/downsample_leaf_size", downsample_leaf_size);
+    nh.getParam("/trackdlo/mixed_precision", mixed_precision);
+    nh.getParam("/trackdlo/validate_precision", validate_precision);
+    nh.getParam("/trackdlo/fused_registration", fused_registration);
+    nh.getParam("/trackdlo/color_profile", color_profile);
+    nh.getParam("/trackdlo/color_profile_dlo", color_profile_dlo);
+    nh.getParam("/trackdlo/track_all_dlos", track_all_dlos);
+    nh.getParam("/trackdlo/color_profile_check_period", color_profile_check_period);
+    nh.getParam("/trackdlo/processing_scale", processing_scale);
+    nh.getParam("/trackdlo/native_init", native_init);
+    nh.getParam("/trackdlo/num_of_nodes", num_of_nodes);
+    nh.getParam("/trackdlo/depth_filter", depth_filter);
+    nh.getParam("/trackdlo/health_max_sigma2", tracking_health_thresholds.max_sigma2);
+    nh.getParam("/trackdlo/health_min_visible_fraction", tracking_health_thresholds.min_visible_fraction);
+    nh.getParam("/trackdlo/health_max_mean_point_dist", tracking_health_thresholds.max_mean_point_dist);
+    nh.getParam("/trackdlo/health_require_convergence", tracking_health_thresholds.require_convergence);
+    nh.getParam("/trackdlo/health_loss_frames", tracking_health_thresholds.loss_frames);
+    nh.getParam("/trackdlo/checkpoint_path", checkpoint_path);
+    nh.getParam("/trackdlo/checkpoint_period", checkpoint_period);
+    nh.getParam("/trackdlo/checkpoint_max_age", checkpoint_max_age);
+    nh.getParam("/trackdlo/checkpoint_min_overlap", checkpoint_min_overlap);
+    nh.getParam("/trackdlo/diagnostics_period", diagnostics_period);
+    nh.getParam("/trackdlo/trace_enabled", trace_enabled);
+    nh.getParam("/trackdlo/trace_window", trace_window);
+    nh.getParam("/trackdlo/trace_dir", trace_dir);
+    nh.getParam("/trackdlo/shm_channel", shm_channel);
+    nh.getParam("/trackdlo/shm_max_nodes", shm_max_nodes);
+    nh.getParam("/trackdlo/shm_slots", shm_slots);
+    nh.getParam("/trackdlo/predict_rate", predict_rate);
+    nh.getParam("/trackdlo/predict_history", predict_history);
+    nh.getParam("/trackdlo/predict_delay", predict_delay);
+    nh.getParam("/trackdlo/predict_max_horizon", predict_max_horizon);
+    set_tracing_enabled(trace_enabled);
+    processing_scale = std::max(1, processing_scale);
 
     nh.getParam("/trackdlo/camera_info_topic", camera_info_topic);
     nh.getParam("/trackdlo/rgb_topic", rgb_topic);
     nh.getParam("/trackdlo/depth_topic", depth_topic);
+    nh.getParam("/trackdlo/use_organized_cloud", use_organized_cloud);
+    nh.getParam("/trackdlo/pointcloud_topic", pointcloud_topic);
+    nh.getParam("/trackdlo/rgb_transport", rgb_transport);
+    nh.getParam("/trackdlo/depth_transport", depth_transport);
+    nh.getParam("/trackdlo/decode_threads", decode_threads);
+    nh.getParam("/trackdlo/static_skip_threshold", static_skip_threshold);
+    nh.getParam("/trackdlo/static_skip_max", static_skip_max);
+    nh.getParam("/trackdlo/static_skip_stride", static_skip_stride);
+    nh.getParam("/trackdlo/static_skip_depth_tolerance", static_skip_depth_tolerance);
+    static_skip_stride = std::max(1, static_skip_stride);
     nh.getParam("/trackdlo/result_frame_id", result_frame_id);
+    nh.getParam("/trackdlo/camera_sync_tolerance", camera_sync_tolerance);
+    nh.getParam("/trackdlo/newest_frame_only", newest_frame_only);
+
+    // the primary camera, then any extra cameras as a list of {rgb_topic, depth_topic, camera_info_topic}
+    cameras.push_back(std::unique_ptr<camera_input>(new camera_input()));
+    cameras[0]->rgb_topic = rgb_topic;
+    cameras[0]->depth_topic = depth_topic;
+    cameras[0]->camera_info_topic = camera_info_topic;
+
+    XmlRpc::XmlRpcValue extra_cameras;
+    if (nh.getParam("/trackdlo/extra_cameras", extra_cameras)) {
+        if (extra_cameras.getType() != XmlRpc::XmlRpcValue::TypeArray) {
+            ROS_ERROR_STREAM("extra_cameras must be a list of {rgb_topic, depth_topic, camera_info_topic}");
+            return 1;
+        }
+        for (int i = 0; i < extra_cameras.size(); i ++) {
+            XmlRpc::XmlRpcValue& extra_camera = extra_cameras[i];
+            if (extra_camera.getType() != XmlRpc::XmlRpcValue::TypeStruct || !extra_camera.hasMember("rgb_topic") || !extra_camera.hasMember("depth_topic") || !extra_camera.hasMember("camera_info_topic")) {
+                ROS_ERROR_STREAM("extra_cameras[" + std::to_string(i) + "] must have rgb_topic, depth_topic and camera_info_topic");
+                return 1;
+            }
+            cameras.push_back(std::unique_ptr<camera_input>(new camera_input()));
+            cameras.back()->rgb_topic = static_cast<std::string>(extra_camera["rgb_topic"]);
+            cameras.back()->depth_topic = static_cast<std::string>(extra_camera["depth_topic"]);
+            cameras.back()->camera_info_topic = static_cast<std::string>(extra_camera["camera_info_topic"]);
+        }
+    }
 
     nh.getParam("/trackdlo/hsv_threshold_upper_limit", hsv_threshold_upper_limit);
     nh.getParam("/trackdlo/hsv_threshold_lower_limit", hsv_threshold_lower_limit);
@@ -579,55 +1464,321 @@ int main(int argc, char **argv) {
         }
         
         if (i == hsv_threshold_lower_limit.length()-1) {
-            upper.push_back(std::stoi(rgb_val));
+            lower.push_back(std::stoi(rgb_val));
+        }
+    }
+
+    // color segmentation lookup table
+    if (color_profile != "") {
+        struct stat file_stat;
+        if (stat(color_profile.c_str(), &file_stat) == 0) {
+            color_profile_mtime = file_stat.st_mtime;
+        }
+        try {
+            load_dlo_lut();
         }
+        catch (const std::exception& e) {
+            ROS_ERROR_STREAM(e.what());
+            return 1;
+        }
+    }
+    else {
+        std::vector<color_range> ranges;
+        std::vector<color_range> tip_ranges;
+        if (!multi_color_dlo) {
+            ranges.push_back({"user", true, cv::Scalar(lower[0], lower[1], lower[2]), cv::Scalar(upper[0], upper[1], upper[2])});
+        }
+        else {
+            // blue and green
+            ranges.push_back({"blue", true, cv::Scalar(90, 90, 30), cv::Scalar(130, 255, 255)});
+            ranges.push_back({"green", true, cv::Scalar(58, 130, 50), cv::Scalar(90, 255, 255)});
+            // tape green marks the tip
+            tip_ranges.push_back({"tip", true, cv::Scalar(58, 130, 50), cv::Scalar(90, 255, 89)});
+        }
+        std::atomic_store(&dlo_lut, std::make_shared<const dlo_classifier>(dlo_classifier{color_lut({ranges}), {"dlo"}, multi_color_dlo ? color_lut({tip_ranges}) : color_lut(), {multi_color_dlo}}));
     }
 
     int pub_queue_size = 30;
 
+    ros::Timer color_profile_timer;
+    if (color_profile != "" && color_profile_check_period > 0) {
+        color_profile_timer = nh.createTimer(ros::Duration(color_profile_check_period), check_color_profile);
+    }
+
     image_transport::ImageTransport it(nh);
     image_transport::Subscriber opencv_mask_sub = it.subscribe("/mask_with_occlusion", 10, update_opencv_mask);
-    init_nodes_sub = nh.subscribe("/trackdlo/init_nodes", 1, update_init_nodes);
-    camera_info_sub = nh.subscribe(camera_info_topic, 1, update_camera_info);
+
+    // camera extrinsics
+    tf_buffer.reset(new tf2_ros::Buffer());
+    tf2_ros::TransformListener tf_listener(*tf_buffer);
+
+    for (std::unique_ptr<camera_input>& camera_ptr : cameras) {
+        camera_input* camera = camera_ptr.get();
+        boost::function<void(const sensor_msgs::CameraInfoConstPtr&)> camera_info_callback = [camera](const sensor_msgs::CameraInfoConstPtr& cam_msg) {
+            update_camera_info(cam_msg, *camera);
+        };
+        camera->camera_info_sub = nh.subscribe<sensor_msgs::CameraInfo>(camera->camera_info_topic, 1, camera_info_callback);
+    }
 
     image_transport::Publisher tracking_img_pub = it.advertise("/trackdlo/results_img", pub_queue_size);
-    pc_pub = nh.advertise<sensor_msgs::PointCloud2>("/trackdlo/filtered_pointcloud", pub_queue_size);
-    results_pub = nh.advertise<visualization_msgs::MarkerArray>("/trackdlo/results_marker", pub_queue_size);
-    guide_nodes_pub = nh.advertise<visualization_msgs::MarkerArray>("/trackdlo/guide_nodes", pub_queue_size);
-    corr_priors_pub = nh.advertise<visualization_msgs::MarkerArray>("/trackdlo/corr_priors", pub_queue_size);
-
-    // trackdlo point cloud topic
-    result_pc_pub = nh.advertise<sensor_msgs::PointCloud2>("/trackdlo/results_pc", pub_queue_size);
-    self_occluded_pc_pub = nh.advertise<sensor_msgs::PointCloud2>("/trackdlo/self_occluded_pc", pub_queue_size);
-
-    message_filters::Subscriber<sensor_msgs::Image> image_sub(nh, rgb_topic, 10);
-    message_filters::Subscriber<sensor_msgs::Image> depth_sub(nh, depth_topic, 10);
-    message_filters::TimeSynchronizer<sensor_msgs::Image, sensor_msgs::Image> sync(image_sub, depth_sub, 10);
-
-    sync.registerCallback<std::function<void(const sensor_msgs::ImageConstPtr&, 
-                                             const sensor_msgs::ImageConstPtr&,
-                                             const boost::shared_ptr<const message_filters::NullType>,
-                                             const boost::shared_ptr<const message_filters::NullType>,
-                                             const boost::shared_ptr<const message_filters::NullType>,
-                                             const boost::shared_ptr<const message_filters::NullType>,
-                                             const boost::shared_ptr<const message_filters::NullType>,
-                                             const boost::shared_ptr<const message_filters::NullType>,
-                                             const boost::shared_ptr<const message_filters::NullType>)>>
-    (
-        [&](const sensor_msgs::ImageConstPtr& img_msg, 
-            const sensor_msgs::ImageConstPtr& depth_msg,
-            const boost::shared_ptr<const message_filters::NullType> var1,
-            const boost::shared_ptr<const message_filters::NullType> var2,
-            const boost::shared_ptr<const message_filters::NullType> var3,
-            const boost::shared_ptr<const message_filters::NullType> var4,
-            const boost::shared_ptr<const message_filters::NullType> var5,
-            const boost::shared_ptr<const message_filters::NullType> var6,
-            const boost::shared_ptr<const message_filters::NullType> var7)
+
+    // stage latency percentiles and counters, reported on the tracking thread in between frames
+    ros::Publisher diagnostics_pub = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+    ros::WallTimer diagnostics_timer;
+    if (diagnostics_period > 0) {
+        diagnostics_timer = nh.createWallTimer(ros::WallDuration(diagnostics_period), [&](const ros::WallTimerEvent&) {
+            diagnostic_msgs::DiagnosticArray diagnostics;
+            diagnostics.header.stamp = ros::Time::now();
+            diagnostics.status.push_back(metrics.take_diagnostics(diagnostics_period));
+            diagnostics_pub.publish(diagnostics);
+        });
+    }
+
+    // tracked DLOs: every DLO of the color profile if track_all_dlos is set, otherwise color_profile_dlo (or the
+    // first DLO of the profile)
+    std::vector<std::string> dlo_names = {};
+    std::vector<std::string> profile_names = std::atomic_load(&dlo_lut)->names;
+    if (track_all_dlos) {
+        dlo_names = profile_names;
+    }
+    else if (color_profile != "" && color_profile_dlo != "") {
+        dlo_names = {color_profile_dlo};
+    }
+    else {
+        dlo_names = {profile_names[0]};
+    }
+
+    for (const std::string& name : dlo_names) {
+        dlos.push_back(std::unique_ptr<dlo_track>(new dlo_track()));
+        dlo_track* dlo = dlos.back().get();
+        dlo->name = name;
+
+        // a single DLO keeps the original topics, several DLOs get one namespace each
+        std::string ns = (dlo_names.size() == 1) ? "/trackdlo/" : "/trackdlo/" + name + "/";
+
+        boost::function<void(const sensor_msgs::PointCloud2ConstPtr&)> init_nodes_callback = [dlo](const sensor_msgs::PointCloud2ConstPtr& pc_msg) {
+            update_init_nodes(pc_msg, *dlo);
+        };
+        dlo->init_nodes_sub = nh.subscribe<sensor_msgs::PointCloud2>(ns + "init_nodes", 1, init_nodes_callback);
+        dlo->init_nodes_markers_pub = nh.advertise<visualization_msgs::MarkerArray>(ns + "init_nodes_markers", pub_queue_size);
+
+        dlo->pc_pub = nh.advertise<sensor_msgs::PointCloud2>(ns + "filtered_pointcloud", pub_queue_size);
+        dlo->results_pub = nh.advertise<visualization_msgs::MarkerArray>(ns + "results_marker", pub_queue_size);
+        dlo->guide_nodes_pub = nh.advertise<visualization_msgs::MarkerArray>(ns + "guide_nodes", pub_queue_size);
+        dlo->corr_priors_pub = nh.advertise<visualization_msgs::MarkerArray>(ns + "corr_priors", pub_queue_size);
+
+        // trackdlo point cloud topic
+        dlo->result_pc_pub = nh.advertise<sensor_msgs::PointCloud2>(ns + "results_pc", pub_queue_size);
+        dlo->self_occluded_pc_pub = nh.advertise<sensor_msgs::PointCloud2>(ns + "self_occluded_pc", pub_queue_size);
+
+        // compact results for controllers
+        dlo->tracking_result_pub.advertise(nh, ns + "results", pub_queue_size);
+        if (shm_channel != "") {
+            std::string channel = (dlo_names.size() == 1) ? shm_channel : shm_channel + "_" + name;
+            try {
+                dlo->shm_writer.reset(new shm_result_writer(channel, shm_max_nodes, shm_slots));
+                ROS_INFO_STREAM(name + ": writing results to shared memory " + channel);
+            }
+            catch (const std::exception& e) {
+                ROS_ERROR_STREAM(name + ": " + e.what());
+            }
+        }
+
+        // predictions at a higher rate than the camera's, on their own thread
+        if (predict_rate > 0) {
+            dlo->predicted_pub = nh.advertise<sensor_msgs::PointCloud2>(ns + "results_predicted", pub_queue_size);
+            dlo->predictor.reset(new motion_predictor(predict_history, predict_max_horizon));
+            dlo->prediction_pub.reset(new prediction_publisher(*dlo->predictor, dlo->predicted_pub, result_frame_id, predict_rate, predict_delay));
+        }
+    }
+
+    // the input subscriptions have their own callback queue, so image_transport decodes (compressed rgb,
+    // compressedDepth) on the decode threads while this thread tracks the previous frame
+    ros::CallbackQueue decode_queue;
+    ros::NodeHandle decode_nh;
+    decode_nh.setCallbackQueue(&decode_queue);
+    image_transport::ImageTransport decode_it(decode_nh);
+
+    image_transport::SubscriberFilter image_sub(decode_it, rgb_topic, 10, image_transport::TransportHints(rgb_transport));
+    // arrivals are noted before the synchronizers see the messages
+    image_sub.registerCallback(boost::function<void(const sensor_msgs::ImageConstPtr&)>([](const sensor_msgs::ImageConstPtr& msg) {
+        note_arrival(msg->header.stamp);
+    }));
+    image_transport::SubscriberFilter depth_sub;
+    message_filters::Subscriber<sensor_msgs::PointCloud2> cloud_sub;
+    message_filters::TimeSynchronizer<sensor_msgs::Image, sensor_msgs::Image> sync(10);
+    message_filters::TimeSynchronizer<sensor_msgs::Image, sensor_msgs::PointCloud2> cloud_sync(10);
+
+    if (!use_organized_cloud) {
+        depth_sub.subscribe(decode_it, depth_topic, 10, image_transport::TransportHints(depth_transport));
+        depth_sub.registerCallback(boost::function<void(const sensor_msgs::ImageConstPtr&)>([](const sensor_msgs::ImageConstPtr& msg) {
+            note_arrival(msg->header.stamp);
+        }));
+        sync.connectInput(image_sub, depth_sub);
+
+        sync.registerCallback<std::function<void(const sensor_msgs::ImageConstPtr&, 
+                                                 const sensor_msgs::ImageConstPtr&,
+                                                 const boost::shared_ptr<const message_filters::NullType>,
+                                                 const boost::shared_ptr<const message_filters::NullType>,
+                                                 const boost::shared_ptr<const message_filters::NullType>,
+                                                 const boost::shared_ptr<const message_filters::NullType>,
+                                                 const boost::shared_ptr<const message_filters::NullType>,
+                                                 const boost::shared_ptr<const message_filters::NullType>,
+                                                 const boost::shared_ptr<const message_filters::NullType>)>>
+        (
+            [&](const sensor_msgs::ImageConstPtr& img_msg, 
+                const sensor_msgs::ImageConstPtr& depth_msg,
+                const boost::shared_ptr<const message_filters::NullType> var1,
+                const boost::shared_ptr<const message_filters::NullType> var2,
+                const boost::shared_ptr<const message_filters::NullType> var3,
+                const boost::shared_ptr<const message_filters::NullType> var4,
+                const boost::shared_ptr<const message_filters::NullType> var5,
+                const boost::shared_ptr<const message_filters::NullType> var6,
+                const boost::shared_ptr<const message_filters::NullType> var7)
+            {
+                note_synced(img_msg->header.stamp);
+                push_frame(0, {img_msg, depth_msg, nullptr});
+            }
+        );
+    }
+    else {
+        // registered organized cloud in the camera's optical frame instead of the depth image
+        cloud_sub.subscribe(decode_nh, pointcloud_topic, 10);
+        cloud_sub.registerCallback(boost::function<void(const sensor_msgs::PointCloud2ConstPtr&)>([](const sensor_msgs::PointCloud2ConstPtr& msg) {
+            note_arrival(msg->header.stamp);
+        }));
+        cloud_sync.connectInput(image_sub, cloud_sub);
+
+        cloud_sync.registerCallback<std::function<void(const sensor_msgs::ImageConstPtr&, 
+                                                       const sensor_msgs::PointCloud2ConstPtr&,
+                                                       const boost::shared_ptr<const message_filters::NullType>,
+                                                       const boost::shared_ptr<const message_filters::NullType>,
+                                                       const boost::shared_ptr<const message_filters::NullType>,
+                                                       const boost::shared_ptr<const message_filters::NullType>,
+                                                       const boost::shared_ptr<const message_filters::NullType>,
+                                                       const boost::shared_ptr<const message_filters::NullType>,
+                                                       const boost::shared_ptr<const message_filters::NullType>)>>
+        (
+            [&](const sensor_msgs::ImageConstPtr& img_msg, 
+                const sensor_msgs::PointCloud2ConstPtr& cloud_msg,
+                const boost::shared_ptr<const message_filters::NullType> var1,
+                const boost::shared_ptr<const message_filters::NullType> var2,
+                const boost::shared_ptr<const message_filters::NullType> var3,
+                const boost::shared_ptr<const message_filters::NullType> var4,
+                const boost::shared_ptr<const message_filters::NullType> var5,
+                const boost::shared_ptr<const message_filters::NullType> var6,
+                const boost::shared_ptr<const message_filters::NullType> var7)
+            {
+                note_synced(img_msg->header.stamp);
+                push_frame(0, {img_msg, nullptr, cloud_msg});
+            }
+        );
+    }
+
+    // the extra cameras always use depth images. each one is synced on its own, frames are matched across cameras
+    // by their stamps in the tracking loop
+    std::vector<std::unique_ptr<image_transport::SubscriberFilter>> extra_image_subs;
+    std::vector<std::unique_ptr<image_transport::SubscriberFilter>> extra_depth_subs;
+    std::vector<std::unique_ptr<message_filters::TimeSynchronizer<sensor_msgs::Image, sensor_msgs::Image>>> extra_syncs;
+    for (int c = 1; c < cameras.size(); c ++) {
+        extra_image_subs.emplace_back(new image_transport::SubscriberFilter(decode_it, cameras[c]->rgb_topic, 10, image_transport::TransportHints(rgb_transport)));
+        extra_depth_subs.emplace_back(new image_transport::SubscriberFilter(decode_it, cameras[c]->depth_topic, 10, image_transport::TransportHints(depth_transport)));
+        extra_syncs.emplace_back(new message_filters::TimeSynchronizer<sensor_msgs::Image, sensor_msgs::Image>(*extra_image_subs.back(), *extra_depth_subs.back(), 10));
+
+        extra_syncs.back()->registerCallback<std::function<void(const sensor_msgs::ImageConstPtr&, 
+                                                                const sensor_msgs::ImageConstPtr&,
+                                                                const boost::shared_ptr<const message_filters::NullType>,
+                                                                const boost::shared_ptr<const message_filters::NullType>,
+                                                                const boost::shared_ptr<const message_filters::NullType>,
+                                                                const boost::shared_ptr<const message_filters::NullType>,
+                                                                const boost::shared_ptr<const message_filters::NullType>,
+                                                                const boost::shared_ptr<const message_filters::NullType>,
+                                                                const boost::shared_ptr<const message_filters::NullType>)>>
+        (
+            [c](const sensor_msgs::ImageConstPtr& img_msg, 
+                const sensor_msgs::ImageConstPtr& depth_msg,
+                const boost::shared_ptr<const message_filters::NullType> var1,
+                const boost::shared_ptr<const message_filters::NullType> var2,
+                const boost::shared_ptr<const message_filters::NullType> var3,
+                const boost::shared_ptr<const message_filters::NullType> var4,
+                const boost::shared_ptr<const message_filters::NullType> var5,
+                const boost::shared_ptr<const message_filters::NullType> var6,
+                const boost::shared_ptr<const message_filters::NullType> var7)
+            {
+                push_frame(c, {img_msg, depth_msg, nullptr});
+            }
+        );
+    }
+
+    // trace dumps on request
+    ros::ServiceServer dump_trace_srv = nh.advertiseService("/trackdlo/dump_trace", dump_trace_service);
+    signal(SIGUSR1, request_trace);
+    set_trace_thread_name("tracking");
+
+    // warm restart: resume from the last checkpoint, and keep writing new ones in the background
+    std::unique_ptr<checkpoint_writer> checkpoints;
+    ros::WallTime last_checkpoint = ros::WallTime::now();
+    if (checkpoint_path != "") {
+        restore_checkpoint();
+        checkpoints.reset(new checkpoint_writer(checkpoint_path));
+    }
+
+    ros::AsyncSpinner decode_spinner(std::max(1, decode_threads), &decode_queue);
+    decode_spinner.start();
+
+    // tracking runs on this thread, in between the other callbacks
+    while (ros::ok()) {
+        ros::spinOnce();
+
+        if (trace_requested.exchange(false)) {
+            try {
+                write_trace();
+            }
+            catch (const std::runtime_error& e) {
+                ROS_ERROR_STREAM(e.what());
+            }
+        }
+
+        input_frame frame;
         {
-            sensor_msgs::ImagePtr tracking_img = Callback(img_msg, depth_msg);
-            tracking_img_pub.publish(tracking_img);
+            std::unique_lock<std::mutex> lock(frame_mutex);
+            if (!frame_ready.wait_for(lock, std::chrono::milliseconds(10), [] { return !pending_frames.empty(); })) {
+                continue;
+            }
+            if (newest_frame_only) {
+                frame = pending_frames.back();
+                metrics.superseded_frames += pending_frames.size() - 1;
+                pending_frames.clear();
+            }
+            else {
+                frame = pending_frames.front();
+                pending_frames.pop_front();
+            }
         }
-    );
-    
-    ros::spin();
+
+        // the extra cameras' frames closest in time to the primary camera's frame
+        std::vector<input_frame> inputs = {frame};
+        for (int c = 1; c < cameras.size(); c ++) {
+            inputs.push_back(closest_frame(c, frame.image->header.stamp));
+        }
+
+        TRACE_SCOPE("frame");
+        std::chrono::steady_clock::time_point frame_start = std::chrono::steady_clock::now();
+        sensor_msgs::ImagePtr tracking_img = Callback(inputs);
+
+        std::chrono::steady_clock::time_point publish_start = std::chrono::steady_clock::now();
+        tracking_img_pub.publish(tracking_img);
+        metrics.record_stage(stage_image_publish, publish_start);
+        metrics.frame_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - frame_start).count());
+        metrics.record_latency(metrics.publish_latency, frame.image->header.stamp);
+        metrics.frames += 1;
+
+        if (checkpoints && (ros::WallTime::now() - last_checkpoint).toSec() >= checkpoint_period) {
+            checkpoints->submit(take_checkpoint());
+            last_checkpoint = ros::WallTime::now();
+        }
+    }
+
+    // joins the DLOs' background threads while ROS is still up
+    dlos.clear();
 }
\ No newline at end of file
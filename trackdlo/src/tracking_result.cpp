@@ -0,0 +1,62 @@
+#include "../include/tracking_result.h"
+
+#include <trackdlo/TrackingResult.h>
+#include <cstring>
+
+struct tracking_result_publisher::state {
+    ros::Publisher pub;
+    trackdlo::TrackingResult msg;
+    bool has_msg = false;
+};
+
+tracking_result_publisher::tracking_result_publisher () : state_(new state()) {}
+
+tracking_result_publisher::~tracking_result_publisher () {}
+
+void tracking_result_publisher::advertise (ros::NodeHandle& nh, const std::string& topic, int queue_size) {
+    state_->pub = nh.advertise<trackdlo::TrackingResult>(topic, queue_size);
+}
+
+void tracking_result_publisher::publish (const ros::Time& stamp,
+                                         const std::string& frame_id,
+                                         const Eigen::MatrixXd& Y,
+                                         const std::vector<bool>& vis,
+                                         double sigma2,
+                                         int pre_proc_iterations,
+                                         int main_iterations,
+                                         double pre_proc_em_time,
+                                         double priors_time,
+                                         double main_em_time) {
+    trackdlo::TrackingResult& msg = state_->msg;
+    msg.header.stamp = stamp;
+    msg.header.frame_id = frame_id;
+
+    // the vectors keep their capacity, so they only reallocate when the node count grows
+    msg.num_of_nodes = Y.rows();
+    msg.nodes.resize(Y.size());
+    memcpy(msg.nodes.data(), Y.data(), Y.size() * sizeof(double));
+    msg.visibility.assign((Y.rows() + 7) / 8, 0);
+    for (int i = 0; i < vis.size() && i < Y.rows(); i ++) {
+        if (vis[i]) {
+            msg.visibility[i / 8] |= 1 << (i % 8);
+        }
+    }
+
+    msg.sigma2 = sigma2;
+    msg.pre_proc_iterations = pre_proc_iterations;
+    msg.main_iterations = main_iterations;
+    msg.pre_proc_em_time = pre_proc_em_time;
+    msg.priors_time = priors_time;
+    msg.main_em_time = main_em_time;
+
+    state_->has_msg = true;
+    state_->pub.publish(msg);
+}
+
+void tracking_result_publisher::republish (const ros::Time& stamp) {
+    if (!state_->has_msg) {
+        return;
+    }
+    state_->msg.header.stamp = stamp;
+    state_->pub.publish(state_->msg);
+}
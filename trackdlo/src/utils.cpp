@@ -10,14 +10,6 @@ void signal_callback_handler(int signum) {
    exit(signum);
 }
 
-double pt2pt_dis_sq (MatrixXd pt1, MatrixXd pt2) {
-    return (pt1 - pt2).rowwise().squaredNorm().sum();
-}
-
-double pt2pt_dis (MatrixXd pt1, MatrixXd pt2) {
-    return (pt1 - pt2).rowwise().norm().sum();
-}
-
 void reg (MatrixXd pts, MatrixXd& Y, double& sigma2, int M, double mu, int max_iter) {
     // initial guess
     MatrixXd X = pts.replicate(1, 1);
@@ -169,75 +161,291 @@ MatrixXd sort_pts (MatrixXd Y_0) {
     return Y_0_sorted;
 }
 
-bool isBetween (MatrixXd x, MatrixXd a, MatrixXd b) {
-    bool in_bound = true;
+int polyline_sphere_exit (const MatrixXd& vertices, int lo, int hi, int direction, const Eigen::Vector3d& sphere_center, double radius, double& t) {
+    typedef Eigen::Array<double, sphere_exit_batch_size, 1> batch_array;
+    typedef Eigen::Array<double, sphere_exit_batch_size, 3> batch_array3;
+    int num_of_segs = hi - lo;
+
+    // segments in walking order, sphere_exit_batch_size at a time in fixed-size arrays (no allocations, called for
+    // every node of every march). lane j of a batch holds walking step k0+j, i.e. segment i joining rows lo+i and
+    // lo+i+1, with start and direction vectors following the walking direction. unused lanes keep a zero direction
+    for (int k0 = 0; k0 < num_of_segs; k0 += sphere_exit_batch_size) {
+        int num_of_lanes = std::min(sphere_exit_batch_size, num_of_segs - k0);
+        batch_array3 seg_start = batch_array3::Zero();
+        batch_array3 seg_dir = batch_array3::Zero();
+        for (int j = 0; j < num_of_lanes; j ++) {
+            int i = (direction > 0) ? k0 + j : num_of_segs-1 - (k0 + j);
+            seg_start.row(j) = ((direction > 0) ? vertices.row(lo+i) : vertices.row(lo+i+1)) - sphere_center.transpose();
+            seg_dir.row(j) = (vertices.row(lo+i+1) - vertices.row(lo+i)) * direction;
+        }
+
+        // |start + t*dir - center|^2 = radius^2, solved for every lane at once
+        batch_array a = seg_dir.square().rowwise().sum();
+        batch_array b = 2 * (seg_start * seg_dir).rowwise().sum();
+        batch_array c = seg_start.square().rowwise().sum() - radius*radius;
+        batch_array delta = b.square() - 4*a*c;
 
-    for (int i = 0; i < 3; i ++) {
-        if (!(a(0, i)-0.0001 <= x(0, i) && x(0, i) <= b(0, i)+0.0001) && 
-            !(b(0, i)-0.0001 <= x(0, i) && x(0, i) <= a(0, i)+0.0001)) {
-            in_bound = false;
+        // the larger root is where the segment leaves the sphere; allow 0.1 mm of slack at the segment ends
+        batch_array exit_t = (-b + delta.max(0).sqrt()) / (2*a);
+        batch_array slack = 0.0001 / a.sqrt();
+
+        for (int j = 0; j < num_of_lanes; j ++) {
+            if (a(j) > 0 && delta(j) >= 0 && exit_t(j) >= -slack(j) && exit_t(j) <= 1 + slack(j)) {
+                t = std::min(std::max(exit_t(j), 0.0), 1.0);
+                return lo + ((direction > 0) ? k0 + j : num_of_segs-1 - (k0 + j));
+            }
         }
     }
-    
-    return in_bound;
+
+    return -1;
 }
 
-std::vector<MatrixXd> line_sphere_intersection (MatrixXd point_A, MatrixXd point_B, MatrixXd sphere_center, double radius) {
-    std::vector<MatrixXd> intersections = {};
-    
-    double a = pt2pt_dis_sq(point_A, point_B);
-    double b = 2 * ((point_B(0, 0) - point_A(0, 0))*(point_A(0, 0) - sphere_center(0, 0)) + 
-                    (point_B(0, 1) - point_A(0, 1))*(point_A(0, 1) - sphere_center(0, 1)) + 
-                    (point_B(0, 2) - point_A(0, 2))*(point_A(0, 2) - sphere_center(0, 2)));
-    double c = pt2pt_dis_sq(point_A, sphere_center) - pow(radius, 2);
-    
-    double delta = pow(b, 2) - 4*a*c;
+double point_polyline_distance (const MatrixXd& vertices, const Eigen::RowVector3d& pt, Eigen::RowVector3d& closest_pt) {
+    if (vertices.rows() == 0) {
+        throw std::invalid_argument("Polyline has no vertices");
+    }
+    int num_of_segs = vertices.rows() - 1;
+    if (num_of_segs < 1) {
+        closest_pt = vertices.row(0);
+        return (closest_pt - pt).norm();
+    }
 
-    double d1 = (-b + sqrt(delta)) / (2*a);
-    double d2 = (-b - sqrt(delta)) / (2*a);
+    // project pt onto every segment at once and clamp the projection to the segment
+    Eigen::ArrayX3d AB = (vertices.bottomRows(num_of_segs) - vertices.topRows(num_of_segs)).array();
+    Eigen::ArrayX3d AE = (-(vertices.topRows(num_of_segs).rowwise() - pt)).array();
+    Eigen::ArrayXd AB_sq = AB.square().rowwise().sum();
+    Eigen::ArrayXd t = ((AE * AB).rowwise().sum() / AB_sq.max(1e-12)).max(0).min(1);
 
-    if (delta < 0) {
-        // no solution
-        return {};
-    }
-    else if (delta > 0) {
-        // two solutions
-        // the first one
-        double x1 = point_A(0, 0) + d1*(point_B(0, 0) - point_A(0, 0));
-        double y1 = point_A(0, 1) + d1*(point_B(0, 1) - point_A(0, 1));
-        double z1 = point_A(0, 2) + d1*(point_B(0, 2) - point_A(0, 2));
-        MatrixXd pt1(1, 3);
-        pt1 << x1, y1, z1;
-
-        // the second one
-        double x2 = point_A(0, 0) + d2*(point_B(0, 0) - point_A(0, 0));
-        double y2 = point_A(0, 1) + d2*(point_B(0, 1) - point_A(0, 1));
-        double z2 = point_A(0, 2) + d2*(point_B(0, 2) - point_A(0, 2));
-        MatrixXd pt2(1, 3);
-        pt2 << x2, y2, z2;
-
-        if (isBetween(pt1, point_A, point_B)) {
-            intersections.push_back(pt1);
+    // squared distance between pt and its projection onto every segment
+    Eigen::ArrayX3d diff = AE - AB.colwise() * t;
+    int closest_seg;
+    double dis_sq = diff.square().rowwise().sum().minCoeff(&closest_seg);
+
+    closest_pt = vertices.row(closest_seg) + t(closest_seg) * (vertices.row(closest_seg+1) - vertices.row(closest_seg));
+    return sqrt(dis_sq);
+}
+
+// pooling loop for one depth type; depth values of 0 (and NaN for float depth) are missing measurements
+template <typename T>
+static void pool_mask_and_depth_impl (const Mat& mask, const Mat& depth, int factor, Mat& pooled_mask, Mat& pooled_depth) {
+    int rows = mask.rows / factor;
+    int cols = mask.cols / factor;
+    pooled_mask.create(rows, cols, CV_8U);
+    pooled_depth.create(rows, cols, depth.type());
+
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i ++) {
+            uchar* mask_out = pooled_mask.ptr<uchar>(i);
+            T* depth_out = pooled_depth.ptr<T>(i);
+
+            for (int j = 0; j < cols; j ++) {
+                T closest_masked = 0;
+                T closest = 0;
+                for (int r = i*factor; r < (i+1)*factor; r ++) {
+                    const uchar* mask_in = mask.ptr<uchar>(r);
+                    const T* depth_in = depth.ptr<T>(r);
+                    for (int c = j*factor; c < (j+1)*factor; c ++) {
+                        T d = depth_in[c];
+                        if (!(d > 0)) {
+                            continue;
+                        }
+                        if (closest == 0 || d < closest) {
+                            closest = d;
+                        }
+                        if (mask_in[c] != 0 && (closest_masked == 0 || d < closest_masked)) {
+                            closest_masked = d;
+                        }
+                    }
+                }
+
+                mask_out[j] = (closest_masked > 0) ? 255 : 0;
+                depth_out[j] = (closest_masked > 0) ? closest_masked : closest;
+            }
         }
-        if (isBetween(pt2, point_A, point_B)) {
-            intersections.push_back(pt2);
+    });
+}
+
+void pool_mask_and_depth (const Mat& mask, const Mat& depth, int factor, Mat& pooled_mask, Mat& pooled_depth) {
+    if (depth.type() == CV_32FC1) {
+        pool_mask_and_depth_impl<float>(mask, depth, factor, pooled_mask, pooled_depth);
+    }
+    else {
+        pool_mask_and_depth_impl<uint16_t>(mask, depth, factor, pooled_mask, pooled_depth);
+    }
+}
+
+MatrixXd scale_projection (const MatrixXd& proj_matrix, int factor) {
+    // full-resolution u = factor*u' + (factor-1)/2 at the block center
+    MatrixXd scaled = proj_matrix;
+    double offset = (factor - 1) / 2.0;
+    scaled.row(0) = (proj_matrix.row(0) - offset*proj_matrix.row(2)) / factor;
+    scaled.row(1) = (proj_matrix.row(1) - offset*proj_matrix.row(2)) / factor;
+    return scaled;
+}
+
+// meters per depth unit, resolved at compile time so the back-projection loop does not branch on the encoding
+template <typename T> struct depth_traits;
+template <> struct depth_traits<uint16_t> {
+    static constexpr float scale = 0.001f;
+    static bool valid (uint16_t d) { return d != 0; }
+};
+template <> struct depth_traits<float> {
+    static constexpr float scale = 1.0f;
+    static bool valid (float d) { return d > 0 && std::isfinite(d); }
+};
+
+template <typename T>
+static void mask_to_point_cloud_impl (const Mat& mask, const Mat& depth, const Mat& bgr_image, const MatrixXd& proj_matrix, pcl::PointCloud<pcl::PointXYZRGB>& cloud) {
+    float fx = proj_matrix(0, 0);
+    float fy = proj_matrix(1, 1);
+    float cx = proj_matrix(0, 2);
+    float cy = proj_matrix(1, 2);
+
+    for (int i = 0; i < mask.rows; i ++) {
+        const uchar* mask_row = mask.ptr<uchar>(i);
+        const T* depth_row = depth.ptr<T>(i);
+        const cv::Vec3b* color_row = bgr_image.ptr<cv::Vec3b>(i);
+        float y_scale = (i - cy) / fy;
+
+        for (int j = 0; j < mask.cols; j ++) {
+            if (mask_row[j] == 0 || !depth_traits<T>::valid(depth_row[j])) {
+                continue;
+            }
+
+            pcl::PointXYZRGB point;
+            point.z = depth_row[j] * depth_traits<T>::scale;
+            point.x = (j - cx) / fx * point.z;
+            point.y = y_scale * point.z;
+
+            // currently something so color doesn't show up in rviz
+            point.r = color_row[j][0];
+            point.g = color_row[j][1];
+            point.b = color_row[j][2];
+
+            cloud.push_back(point);
         }
     }
+}
+
+void mask_to_point_cloud (const Mat& mask, const Mat& depth, const Mat& bgr_image, const MatrixXd& proj_matrix, pcl::PointCloud<pcl::PointXYZRGB>& cloud) {
+    if (depth.type() == CV_16UC1) {
+        mask_to_point_cloud_impl<uint16_t>(mask, depth, bgr_image, proj_matrix, cloud);
+    }
+    else if (depth.type() == CV_32FC1) {
+        mask_to_point_cloud_impl<float>(mask, depth, bgr_image, proj_matrix, cloud);
+    }
     else {
-        // one solution
-        d1 = -b / (2*a);
-        double x1 = point_A(0, 0) + d1*(point_B(0, 0) - point_A(0, 0));
-        double y1 = point_A(0, 1) + d1*(point_B(0, 1) - point_A(0, 1));
-        double z1 = point_A(0, 2) + d1*(point_B(0, 2) - point_A(0, 2));
-        MatrixXd pt1(1, 3);
-        pt1 << x1, y1, z1;
-
-        if (isBetween(pt1, point_A, point_B)) {
-            intersections.push_back(pt1);
+        throw std::invalid_argument("Unsupported depth image type " + std::to_string(depth.type()));
+    }
+}
+
+template <typename T>
+static double mask_change_fraction_impl (const Mat& mask, const Mat& depth, const Mat& prev_mask, const Mat& prev_depth, cv::Rect roi, int stride, double depth_tolerance) {
+    double tolerance = depth_tolerance / depth_traits<T>::scale;
+    int dlo_pixels = 0;
+    int changed = 0;
+
+    for (int i = roi.y; i < roi.y + roi.height; i += stride) {
+        const uchar* mask_row = mask.ptr<uchar>(i);
+        const uchar* prev_mask_row = prev_mask.ptr<uchar>(i);
+        const T* depth_row = depth.ptr<T>(i);
+        const T* prev_depth_row = prev_depth.ptr<T>(i);
+
+        for (int j = roi.x; j < roi.x + roi.width; j += stride) {
+            bool in_mask = mask_row[j] != 0;
+            bool in_prev_mask = prev_mask_row[j] != 0;
+            if (!in_mask && !in_prev_mask) {
+                continue;
+            }
+
+            dlo_pixels += 1;
+            if (in_mask != in_prev_mask || fabs(static_cast<double>(depth_row[j]) - static_cast<double>(prev_depth_row[j])) > tolerance) {
+                changed += 1;
+            }
         }
     }
-    
-    return intersections;
+
+    return (dlo_pixels == 0) ? 0.0 : static_cast<double>(changed) / dlo_pixels;
+}
+
+double mask_change_fraction (const Mat& mask, const Mat& depth, const Mat& prev_mask, const Mat& prev_depth, cv::Rect roi, int stride, double depth_tolerance) {
+    roi &= cv::Rect(0, 0, mask.cols, mask.rows);
+    if (depth.type() == CV_32FC1) {
+        return mask_change_fraction_impl<float>(mask, depth, prev_mask, prev_depth, roi, stride, depth_tolerance);
+    }
+    return mask_change_fraction_impl<uint16_t>(mask, depth, prev_mask, prev_depth, roi, stride, depth_tolerance);
+}
+
+organized_cloud_view::organized_cloud_view () {
+    data_ = nullptr;
+    rows_ = 0;
+    cols_ = 0;
+    row_step_ = 0;
+    point_step_ = 0;
+    x_offset_ = 0;
+    y_offset_ = 0;
+    z_offset_ = 0;
+}
+
+organized_cloud_view::organized_cloud_view (const sensor_msgs::PointCloud2& cloud_msg) {
+    if (cloud_msg.height <= 1) {
+        throw std::invalid_argument("Point cloud is not organized (height " + std::to_string(cloud_msg.height) + ")");
+    }
+
+    x_offset_ = -1;
+    y_offset_ = -1;
+    z_offset_ = -1;
+    for (const sensor_msgs::PointField& field : cloud_msg.fields) {
+        if (field.datatype != sensor_msgs::PointField::FLOAT32) {
+            continue;
+        }
+        if (field.name == "x") {
+            x_offset_ = field.offset;
+        }
+        else if (field.name == "y") {
+            y_offset_ = field.offset;
+        }
+        else if (field.name == "z") {
+            z_offset_ = field.offset;
+        }
+    }
+    if (x_offset_ == -1 || y_offset_ == -1 || z_offset_ == -1) {
+        throw std::invalid_argument("Point cloud has no FLOAT32 x, y and z fields");
+    }
+
+    // the fields are read in place, so the layout has to hold every point and match the host byte order
+    bool host_bigendian = (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
+    if (cloud_msg.is_bigendian != host_bigendian) {
+        throw std::invalid_argument("Point cloud byte order does not match the host");
+    }
+    if (std::max({x_offset_, y_offset_, z_offset_}) + sizeof(float) > cloud_msg.point_step) {
+        throw std::invalid_argument("Point cloud fields exceed its point step (" + std::to_string(cloud_msg.point_step) + ")");
+    }
+    if (static_cast<uint64_t>(cloud_msg.width) * cloud_msg.point_step > cloud_msg.row_step) {
+        throw std::invalid_argument("Point cloud row step " + std::to_string(cloud_msg.row_step) + " is smaller than width * point step");
+    }
+    if (static_cast<uint64_t>(cloud_msg.height) * cloud_msg.row_step > cloud_msg.data.size()) {
+        throw std::invalid_argument("Point cloud data (" + std::to_string(cloud_msg.data.size()) + " bytes) is smaller than height * row step");
+    }
+
+    data_ = cloud_msg.data.data();
+    rows_ = cloud_msg.height;
+    cols_ = cloud_msg.width;
+    row_step_ = cloud_msg.row_step;
+    point_step_ = cloud_msg.point_step;
+}
+
+Mat organized_cloud_view::depth_image () const {
+    Mat depth(rows_, cols_, CV_32FC1);
+    cv::parallel_for_(cv::Range(0, rows_), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i ++) {
+            float* out = depth.ptr<float>(i);
+            for (int j = 0; j < cols_; j ++) {
+                out[j] = z(i, j);
+            }
+        }
+    });
+    return depth;
 }
 
 // node color and object color are in rgba format and range from 0-1
@@ -473,17 +681,97 @@ visualization_msgs::MarkerArray MatrixXd2MarkerArray (std::vector<MatrixXd> Y,
 
     return results;
 }
+static std_msgs::ColorRGBA to_color (const std::vector<float>& color) {
+    std_msgs::ColorRGBA rgba;
+    rgba.r = color[0];
+    rgba.g = color[1];
+    rgba.b = color[2];
+    rgba.a = color[3];
+    return rgba;
+}
 
-MatrixXd cross_product (MatrixXd vec1, MatrixXd vec2) {
-    MatrixXd ret = MatrixXd::Zero(1, 3);
-    
-    ret(0, 0) = vec1(0, 1)*vec2(0, 2) - vec1(0, 2)*vec2(0, 1);
-    ret(0, 1) = -(vec1(0, 0)*vec2(0, 2) - vec1(0, 2)*vec2(0, 0));
-    ret(0, 2) = vec1(0, 0)*vec2(0, 1) - vec1(0, 1)*vec2(0, 0);
-
-    return ret;
+void MatrixXd2MarkerList (visualization_msgs::MarkerArray& markers,
+                          const MatrixXd& Y,
+                          const std::string& marker_frame,
+                          const std::string& marker_ns,
+                          const std::vector<float>& node_color,
+                          const std::vector<float>& line_color,
+                          double node_scale,
+                          double line_scale,
+                          const std::vector<bool>& vis,
+                          const std::vector<float>& occluded_node_color,
+                          const std::vector<float>& occluded_line_color) {
+    markers.markers.resize(2);
+    visualization_msgs::Marker& nodes = markers.markers[0];
+    visualization_msgs::Marker& lines = markers.markers[1];
+
+    nodes.header.frame_id = marker_frame;
+    nodes.ns = marker_ns + "_nodes";
+    nodes.id = 0;
+    nodes.type = visualization_msgs::Marker::SPHERE_LIST;
+    nodes.action = visualization_msgs::Marker::ADD;
+    nodes.pose.orientation.w = 1.0;
+    nodes.scale.x = node_scale;
+    nodes.scale.y = node_scale;
+    nodes.scale.z = node_scale;
+
+    lines.header.frame_id = marker_frame;
+    lines.ns = marker_ns + "_lines";
+    lines.id = 0;
+    lines.type = visualization_msgs::Marker::LINE_LIST;
+    lines.action = visualization_msgs::Marker::ADD;
+    lines.pose.orientation.w = 1.0;
+    lines.scale.x = line_scale;
+
+    std_msgs::ColorRGBA visible_node = to_color(node_color);
+    std_msgs::ColorRGBA visible_line = to_color(line_color);
+    std_msgs::ColorRGBA occluded_node = vis.empty() ? visible_node : to_color(occluded_node_color);
+    std_msgs::ColorRGBA occluded_line = vis.empty() ? visible_line : to_color(occluded_line_color);
+
+    int num_of_nodes = Y.rows();
+    int num_of_edges = std::max(num_of_nodes - 1, 0);
+    nodes.points.resize(num_of_nodes);
+    nodes.colors.resize(num_of_nodes);
+    lines.points.resize(2 * num_of_edges);
+    lines.colors.resize(2 * num_of_edges);
+
+    for (int i = 0; i < num_of_nodes; i ++) {
+        bool cur_node_visible = vis.empty() || vis[i];
+        nodes.points[i].x = Y(i, 0);
+        nodes.points[i].y = Y(i, 1);
+        nodes.points[i].z = Y(i, 2);
+        nodes.colors[i] = cur_node_visible ? visible_node : occluded_node;
+
+        // every edge is a pair of points, both colored like the edge
+        if (i == 0) {
+            continue;
+        }
+        bool last_node_visible = vis.empty() || vis[i-1];
+        lines.points[2*(i-1)] = nodes.points[i-1];
+        lines.points[2*(i-1) + 1] = nodes.points[i];
+        lines.colors[2*(i-1)] = (last_node_visible && cur_node_visible) ? visible_line : occluded_line;
+        lines.colors[2*(i-1) + 1] = lines.colors[2*(i-1)];
+    }
 }
 
-double dot_product (MatrixXd vec1, MatrixXd vec2) {
-    return vec1(0, 0)*vec2(0, 0) + vec1(0, 1)*vec2(0, 1) + vec1(0, 2)*vec2(0, 2);
-}
\ No newline at end of file
+void MatrixXd2PointCloud2 (sensor_msgs::PointCloud2& pc_msg, const MatrixXd& Y) {
+    // the layout only has to be set up once
+    if (pc_msg.fields.size() != 3) {
+        pc_msg.fields.resize(3);
+        for (int d = 0; d < 3; d ++) {
+            pc_msg.fields[d].name = std::string(1, "xyz"[d]);
+            pc_msg.fields[d].offset = d * sizeof(float);
+            pc_msg.fields[d].datatype = sensor_msgs::PointField::FLOAT32;
+            pc_msg.fields[d].count = 1;
+        }
+        pc_msg.height = 1;
+        pc_msg.point_step = 3 * sizeof(float);
+        pc_msg.is_bigendian = false;
+        pc_msg.is_dense = true;
+    }
+
+    pc_msg.width = Y.rows();
+    pc_msg.row_step = pc_msg.point_step * pc_msg.width;
+    pc_msg.data.resize(pc_msg.row_step);
+    Eigen::Map<Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor>>(reinterpret_cast<float*>(pc_msg.data.data()), Y.rows(), 3) = Y.cast<float>();
+}
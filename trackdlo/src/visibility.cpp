@@ -0,0 +1,182 @@
+#include "../include/utils.h"
+#include "../include/visibility.h"
+
+using Eigen::MatrixXd;
+using cv::Mat;
+
+// observed depth at (row, col) in meters, 0 if there is no measurement
+static double observed_depth (const Mat& depth_image, int row, int col) {
+    if (depth_image.type() == CV_16UC1) {
+        return depth_image.at<uint16_t>(row, col) / 1000.0;
+    }
+    else if (depth_image.type() == CV_32FC1) {
+        float depth = depth_image.at<float>(row, col);
+        return std::isfinite(depth) ? depth : 0.0;
+    }
+    return 0.0;
+}
+
+// pixel coordinate (already floored or ceiled) as an int, clamped to [-1, limit] first: a node just in front of the
+// image plane projects far outside the image, past the range of int
+static int clamped_pixel (double value, int limit) {
+    return static_cast<int>(std::min(std::max(value, -1.0), static_cast<double>(limit)));
+}
+
+node_visibility compute_node_visibility (const MatrixXd& Y,
+                                         const MatrixXd& proj_matrix,
+                                         const Mat& depth_image,
+                                         const std::vector<double>& node_pt_dists,
+                                         double visibility_threshold,
+                                         int dlo_pixel_width)
+{
+    int M = Y.rows();
+    int img_rows = depth_image.rows;
+    int img_cols = depth_image.cols;
+
+    node_visibility result;
+    result.visible.assign(M, false);
+    result.self_occluded.assign(M, false);
+
+    // project Y onto the image plane; row 2 of image_coords is the node depth. only nodes in front of the camera
+    // with a finite projection are drawn or looked up
+    MatrixXd image_coords = (proj_matrix.leftCols(3) * Y.transpose()).colwise() + proj_matrix.col(3);
+    std::vector<double> cols(M);
+    std::vector<double> rows(M);
+    std::vector<bool> in_front(M);
+    for (int i = 0; i < M; i ++) {
+        cols[i] = image_coords(0, i) / image_coords(2, i);
+        rows[i] = image_coords(1, i) / image_coords(2, i);
+        in_front[i] = image_coords(2, i) > 0 && std::isfinite(cols[i]) && std::isfinite(rows[i]);
+    }
+
+    // bounding box of the projected chain (nodes in front of the camera), widened by half the line width
+    double half_width = dlo_pixel_width / 2.0;
+    double box_col_min = img_cols;
+    double box_col_max = -1;
+    double box_row_min = img_rows;
+    double box_row_max = -1;
+    for (int i = 0; i < M; i ++) {
+        if (!in_front[i]) {
+            continue;
+        }
+        box_col_min = std::min(box_col_min, cols[i] - half_width);
+        box_col_max = std::max(box_col_max, cols[i] + half_width);
+        box_row_min = std::min(box_row_min, rows[i] - half_width);
+        box_row_max = std::max(box_row_max, rows[i] + half_width);
+    }
+    int col_min = std::max(0, clamped_pixel(floor(box_col_min), img_cols));
+    int col_max = std::min(img_cols-1, clamped_pixel(ceil(box_col_max), img_cols));
+    int row_min = std::max(0, clamped_pixel(floor(box_row_min), img_rows));
+    int row_max = std::min(img_rows-1, clamped_pixel(ceil(box_row_max), img_rows));
+    if (col_min > col_max || row_min > row_max) {
+        // the chain is out of view
+        return result;
+    }
+
+    // depth buffer and the edge that wrote each pixel, reused across frames
+    int box_cols = col_max - col_min + 1;
+    int box_rows = row_max - row_min + 1;
+    thread_local std::vector<double> z_buffer;
+    thread_local std::vector<int> edge_buffer;
+    z_buffer.assign(box_rows * box_cols, std::numeric_limits<double>::infinity());
+    edge_buffer.assign(box_rows * box_cols, -1);
+
+    // rasterize edge i (node i to node i+1) as a band of width dlo_pixel_width, keeping the closest depth
+    for (int i = 0; i < M-1; i ++) {
+        if (!in_front[i] || !in_front[i+1]) {
+            continue;
+        }
+
+        int c_lo = std::max(col_min, clamped_pixel(floor(std::min(cols[i], cols[i+1]) - half_width), img_cols));
+        int c_hi = std::min(col_max, clamped_pixel(ceil(std::max(cols[i], cols[i+1]) + half_width), img_cols));
+        int r_lo = std::max(row_min, clamped_pixel(floor(std::min(rows[i], rows[i+1]) - half_width), img_rows));
+        int r_hi = std::min(row_max, clamped_pixel(ceil(std::max(rows[i], rows[i+1]) + half_width), img_rows));
+
+        double seg_col = cols[i+1] - cols[i];
+        double seg_row = rows[i+1] - rows[i];
+        double seg_len_sq = seg_col*seg_col + seg_row*seg_row;
+
+        for (int r = r_lo; r <= r_hi; r ++) {
+            for (int c = c_lo; c <= c_hi; c ++) {
+                // closest point on the projected edge
+                double t = 0;
+                if (seg_len_sq > 0) {
+                    t = ((c - cols[i])*seg_col + (r - rows[i])*seg_row) / seg_len_sq;
+                    t = std::min(std::max(t, 0.0), 1.0);
+                }
+                double d_col = c - (cols[i] + t*seg_col);
+                double d_row = r - (rows[i] + t*seg_row);
+                if (d_col*d_col + d_row*d_row > half_width*half_width) {
+                    continue;
+                }
+
+                double depth = image_coords(2, i) + t*(image_coords(2, i+1) - image_coords(2, i));
+                int idx = (r - row_min)*box_cols + (c - col_min);
+                if (depth < z_buffer[idx]) {
+                    z_buffer[idx] = depth;
+                    edge_buffer[idx] = i;
+                }
+            }
+        }
+    }
+
+    // arc length along the chain
+    std::vector<double> arc(M, 0.0);
+    for (int i = 1; i < M; i ++) {
+        arc[i] = arc[i-1] + pt2pt_dis(Y.row(i), Y.row(i-1));
+    }
+
+    double fx = proj_matrix(0, 0);
+    for (int i = 0; i < M; i ++) {
+        if (!in_front[i]) {
+            // behind the camera
+            continue;
+        }
+        int col = clamped_pixel(floor(cols[i]), img_cols);
+        int row = clamped_pixel(floor(rows[i]), img_rows);
+        double node_depth = image_coords(2, i);
+        if (col < col_min || col > col_max || row < row_min || row > row_max) {
+            // out of view
+            continue;
+        }
+
+        // the line width in meters at the node's depth. parts of the chain closer to the node than this (along
+        // the chain) only cover its pixel because of the line width, so they are not counted as occluders
+        double metric_width = dlo_pixel_width * node_depth / fx;
+        double metric_half_width = metric_width / 2;
+
+        // self-occluded if the front-most edge at this pixel is a different part of the chain in front of the node
+        int idx = (row - row_min)*box_cols + (col - col_min);
+        int front_edge = edge_buffer[idx];
+        if (front_edge != -1 && z_buffer[idx] < node_depth) {
+            double arc_dist = std::min(fabs(arc[front_edge] - arc[i]), fabs(arc[front_edge+1] - arc[i]));
+            if (front_edge != i-1 && front_edge != i && arc_dist > metric_width) {
+                result.self_occluded[i] = true;
+            }
+        }
+
+        // an observed surface clearly in front of the node hides it
+        double observed = observed_depth(depth_image, row, col);
+        bool behind_observed_surface = observed > 0 && observed < node_depth - metric_half_width;
+
+        result.visible[i] = !result.self_occluded[i] && !behind_observed_surface && node_pt_dists[i] <= visibility_threshold;
+    }
+
+    return result;
+}
+
+std::vector<int> extend_visible_nodes (const std::vector<int>& visible_nodes, const std::vector<double>& geodesic_coord, double d_vis) {
+    std::vector<int> visible_nodes_extended = {};
+    for (int i = 0; i + 1 < visible_nodes.size(); i ++) {
+        visible_nodes_extended.push_back(visible_nodes[i]);
+        if (fabs(geodesic_coord[visible_nodes[i+1]] - geodesic_coord[visible_nodes[i]]) <= d_vis) {
+            for (int j = 1; j < visible_nodes[i+1] - visible_nodes[i]; j ++) {
+                visible_nodes_extended.push_back(visible_nodes[i] + j);
+            }
+        }
+    }
+    if (!visible_nodes.empty()) {
+        visible_nodes_extended.push_back(visible_nodes.back());
+    }
+    return visible_nodes_extended;
+}
@@ -0,0 +1,155 @@
+#include "../include/shm_channel.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+
+// producer/consumer tests of the shared-memory result channel. a result's values are derived from its sequence
+// number, so a reader can tell a torn copy (values of two results) from a consistent one
+
+static const char* channel_name = "/trackdlo_test_shm_channel";
+
+// node i of result s at (s*1000 + i, s*1000 + num_of_nodes + i, s*1000 + 2*num_of_nodes + i), column-major as
+// the tracker hands it over
+static void fill_result (uint64_t sequence, int num_of_nodes, std::vector<double>& nodes, std::vector<bool>& visible) {
+    nodes.resize(3 * num_of_nodes);
+    visible.resize(num_of_nodes);
+    for (int i = 0; i < 3 * num_of_nodes; i ++) {
+        nodes[i] = sequence * 1000.0 + i;
+    }
+    for (int i = 0; i < num_of_nodes; i ++) {
+        visible[i] = (sequence + i) % 2;
+    }
+}
+
+// whether result is exactly what fill_result wrote for its sequence number
+static bool consistent (const shm_result& result, int num_of_nodes) {
+    if (result.num_of_nodes != num_of_nodes || result.stamp != static_cast<int64_t>(result.sequence)) {
+        return false;
+    }
+    for (int i = 0; i < num_of_nodes; i ++) {
+        for (int d = 0; d < 3; d ++) {
+            if (result.nodes[3*i + d] != result.sequence * 1000.0 + d*num_of_nodes + i) {
+                return false;
+            }
+        }
+        if (result.visible[i] != (result.sequence + i) % 2) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(shm_channel, round_trip) {
+    shm_result_writer writer(channel_name, 8, 4);
+    shm_result_reader reader(channel_name);
+    shm_result result;
+    EXPECT_FALSE(reader.read_latest(result));
+
+    std::vector<double> nodes;
+    std::vector<bool> visible;
+    fill_result(1, 5, nodes, visible);
+    writer.write(1, nodes.data(), visible, 5);
+
+    ASSERT_TRUE(reader.read_latest(result));
+    EXPECT_EQ(result.sequence, 1u);
+    EXPECT_TRUE(consistent(result, 5));
+    EXPECT_EQ(reader.max_nodes(), 8);
+}
+
+TEST(shm_channel, overwritten_results) {
+    shm_result_writer writer(channel_name, 8, 4);
+    shm_result_reader reader(channel_name);
+    std::vector<double> nodes;
+    std::vector<bool> visible;
+    for (uint64_t s = 1; s <= 10; s ++) {
+        fill_result(s, 8, nodes, visible);
+        writer.write(s, nodes.data(), visible, 8);
+    }
+
+    shm_result result;
+    EXPECT_FALSE(reader.read(6, result));
+    EXPECT_FALSE(reader.read(11, result));
+    for (uint64_t s = 7; s <= 10; s ++) {
+        ASSERT_TRUE(reader.read(s, result));
+        EXPECT_TRUE(consistent(result, 8));
+    }
+}
+
+TEST(shm_channel, no_torn_or_out_of_order_reads) {
+    const int num_of_nodes = 60;
+    const uint64_t num_of_writes = 500000;
+    shm_result_writer writer(channel_name, 64, 4);
+
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> reads(0);
+    std::atomic<uint64_t> torn_reads(0);
+    std::atomic<uint64_t> out_of_order_reads(0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; r ++) {
+        readers.push_back(std::thread([&]() {
+            shm_result_reader reader(channel_name);
+            shm_result result;
+            uint64_t last_sequence = 0;
+            while (!done) {
+                if (!reader.read_latest(result)) {
+                    continue;
+                }
+                reads += 1;
+                if (!consistent(result, num_of_nodes)) {
+                    torn_reads += 1;
+                }
+                if (result.sequence < last_sequence) {
+                    out_of_order_reads += 1;
+                }
+                last_sequence = result.sequence;
+            }
+        }));
+    }
+
+    std::vector<double> nodes;
+    std::vector<bool> visible;
+    for (uint64_t s = 1; s <= num_of_writes; s ++) {
+        fill_result(s, num_of_nodes, nodes, visible);
+        writer.write(s, nodes.data(), visible, num_of_nodes);
+    }
+    done = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    EXPECT_GT(reads.load(), 0u);
+    EXPECT_EQ(torn_reads.load(), 0u);
+    EXPECT_EQ(out_of_order_reads.load(), 0u);
+}
+
+TEST(shm_channel, dead_writer_does_not_block_readers) {
+    shm_result_writer writer(channel_name, 8, 1);
+    std::vector<double> nodes;
+    std::vector<bool> visible;
+    fill_result(1, 8, nodes, visible);
+    writer.write(1, nodes.data(), visible, 8);
+
+    // leave the only slot locked, as a writer killed in the middle of a write would
+    int fd = shm_open(channel_name, O_RDWR, 0);
+    ASSERT_GE(fd, 0);
+    size_t size = sizeof(shm_channel_header) + shm_slot_size(8);
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    ASSERT_NE(mem, MAP_FAILED);
+    shm_slot_header* slot_header = reinterpret_cast<shm_slot_header*>(static_cast<uint8_t*>(mem) + sizeof(shm_channel_header));
+    slot_header->lock.fetch_add(1);
+
+    shm_result_reader reader(channel_name);
+    shm_result result;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(reader.read_latest(result));
+    EXPECT_FALSE(reader.read(1, result));
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(), 100);
+    munmap(mem, size);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}